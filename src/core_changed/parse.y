@@ -246,7 +246,7 @@ id(A) ::= INDEXED(X).    {A = X;}
 %left CONCAT.
 %left COLLATE.
 %right BITNOT.
-%right JSONGET.
+%right JSONGET JSONHAS.
 
 // And "ids" is an identifer-or-string.
 //
@@ -844,6 +844,9 @@ expr(A) ::= ID(X) LP distinct(D) exprlist(Y) RP(E). {
   if( Y && Y->nExpr>pParse->db->aLimit[SQLITE_LIMIT_FUNCTION_ARG] ){
     sqlite3ErrorMsg(pParse, "too many arguments on function %T", &X);
   }
+  if( Y && isJsonBuildFunction(&X) ){
+    jsonRawArgs(pParse, Y, X.n==11);
+  }
   A.pExpr = sqlite3ExprFunction(pParse, Y, &X);
   spanSet(&A,&X,&E);
   if( D && A.pExpr ){
@@ -879,8 +882,8 @@ term(A) ::= CTIME_KW(OP). {
 expr(A) ::= expr(X) AND(OP) expr(Y).    {spanBinaryExpr(&A,pParse,@OP,&X,&Y);}
 expr(A) ::= expr(X) OR(OP) expr(Y).     {spanBinaryExpr(&A,pParse,@OP,&X,&Y);}
 expr(A) ::= expr(X) LT|GT|GE|LE(OP) expr(Y).
-                                        {spanBinaryExpr(&A,pParse,@OP,&X,&Y);}
-expr(A) ::= expr(X) EQ|NE(OP) expr(Y).  {spanBinaryExpr(&A,pParse,@OP,&X,&Y);}
+                                        {spanJsonCompareExpr(&A,pParse,@OP,&X,&Y);}
+expr(A) ::= expr(X) EQ|NE(OP) expr(Y).  {spanJsonCompareExpr(&A,pParse,@OP,&X,&Y);}
 expr(A) ::= expr(X) BITAND|BITOR|LSHIFT|RSHIFT(OP) expr(Y).
                                         {spanBinaryExpr(&A,pParse,@OP,&X,&Y);}
 expr(A) ::= expr(X) PLUS|MINUS(OP) expr(Y).
@@ -1019,6 +1022,11 @@ expr(A) ::= expr(W) between_op(N) expr(X) AND expr(Y). [BETWEEN] {
       */
       A.pExpr = sqlite3PExpr(pParse, TK_INTEGER, 0, 0, &sqlite3IntTokens[N]);
       sqlite3ExprDelete(pParse->db, X.pExpr);
+    }else if( isJsonInList(X.pExpr, Y) ){
+      /* doc->k IN (...) is rewritten to json_in() function which
+      ** probes prebuilt hash set of values with raw json value */
+      A.pExpr = jsonFuseInFunction(pParse, X.pExpr, Y);
+      if( N ) A.pExpr = sqlite3PExpr(pParse, TK_NOT, A.pExpr, 0, 0);
     }else{
       A.pExpr = sqlite3PExpr(pParse, TK_IN, X.pExpr, 0, 0);
       if( A.pExpr ){
@@ -1415,6 +1423,8 @@ anylist ::= anylist ANY.
 // > val
 // SELECT '{"key": "val", "arr": ["v0", "v1"]}'->arr->0;
 // > v0
+// SELECT '{"key": "val", "arr": ["v0", "v1"]}'->?; // Key or index is bound parameter
+// SELECT '{"key": "val", "arr": ["v0", "v1"]}'->('k' || 'ey');
 // This operator rewrites expression to use extension function json_get:
 // SELECT json_get('{"key": "val", "arr": ["v0", "v1"]}', 'key');
 // SELECT json_get('{"key": "val", "arr": ["v0", "v1"]}', 'arr', 0);
@@ -1423,6 +1433,7 @@ anylist ::= anylist ANY.
 %include {
 
   // Concatenate two ExprList
+  // Expressions are moved from b to a, b is deleted
   ExprList* concatExprList(Parse* pParse, ExprList* a, ExprList* b)
   {
     if (b) 
@@ -1431,10 +1442,249 @@ anylist ::= anylist ANY.
       for (i = 0; i < b->nExpr; i++)
       {
           a = sqlite3ExprListAppend(pParse, a, b->a[i].pExpr);
+          b->a[i].pExpr = 0;
       }
+      sqlite3ExprListDelete(pParse->db, b);
     }
     return a;
   }
+
+  // Make path step expression (->*, ->[?(@.k > 0)], ->..k) as BLOB literal
+  // of bytes 00 'J' 'S' followed by step text, same as json_step() returns.
+  // json_get interprets only BLOB path elements with this prefix as steps
+  static void spanJsonStep(
+    ExprSpan *pOut,     /* Write the result here */
+    Parse *pParse,      /* The parsing context.  Errors accumulate here */
+    const char *zStep,  /* Text of step expression */
+    int nStep,          /* Length of zStep */
+    Token *pStart,      /* First token of step */
+    Token *pEnd         /* Last token of step */
+  ){
+    static const char hex[] = "0123456789abcdef";
+    static const char prefix[] = "004a53";
+    char *zBlob = sqlite3DbMallocRaw(pParse->db, nStep * 2 + 10);
+    pOut->pExpr = 0;
+    if (zBlob)
+    {
+      int i;
+      zBlob[0] = 'x';
+      zBlob[1] = '\'';
+      memcpy(&zBlob[2], prefix, 6);
+      for (i = 0; i < nStep; i++)
+      {
+        zBlob[8 + i * 2] = hex[(unsigned char)zStep[i] >> 4];
+        zBlob[9 + i * 2] = hex[zStep[i] & 0x0f];
+      }
+      zBlob[8 + nStep * 2] = '\'';
+      zBlob[9 + nStep * 2] = 0;
+      pOut->pExpr = sqlite3Expr(pParse->db, TK_BLOB, zBlob);
+      sqlite3DbFree(pParse->db, zBlob);
+    }
+    pOut->zStart = pStart->z;
+    pOut->zEnd = &pEnd->z[pEnd->n];
+  }
+
+  // Check if bracket-quoted identifier [...] is step expression:
+  // [*], [?(...)], [..key] or slice [a:b:step]. Other text in brackets
+  // is a quoted key, so doc->[first name] still means key "first name"
+  static int isJsonStepText(const char *z, int n)
+  {
+    int i, bColon = 0;
+    if (n < 2 || z[0] != '[' || z[n - 1] != ']') return 0;
+    z++;
+    n -= 2;
+    while (n > 0 && sqlite3Isspace(z[0])) { z++; n--; }
+    if (n >= 1 && z[0] == '*') return 1;
+    if (n >= 2 && z[0] == '?' && z[1] == '(') return 1;
+    if (n >= 2 && z[0] == '.' && z[1] == '.') return 1;
+    for (i = 0; i < n; i++)
+    {
+      if (z[i] == ':') bColon = 1;
+      else if (!sqlite3Isdigit(z[i]) && z[i] != '-' && !sqlite3Isspace(z[i])) return 0;
+    }
+    return bColon;
+  }
+
+  // Make recursive descent step expression ..key, pKey may be quoted
+  static void spanJsonDescentStep(ExprSpan *pOut, Parse *pParse, Token *pStart, Token *pKey)
+  {
+    char *zStep = sqlite3MPrintf(pParse->db, "..%.*s", pKey->n, pKey->z);
+    if (zStep)
+    {
+      sqlite3Dequote(&zStep[2]);
+      spanJsonStep(pOut, pParse, zStep, sqlite3Strlen30(zStep), pStart, pKey);
+      sqlite3DbFree(pParse->db, zStep);
+    }
+    else
+    {
+      pOut->pExpr = 0;
+      spanSet(pOut, pStart, pKey);
+    }
+  }
+
+  // Check if expression is json_get function call made by -> operator
+  // Paths with step expressions can match several values, so they are not fused
+  static int isJsonGetExpr(Expr *p)
+  {
+    int i;
+    if (!p || p->op != TK_FUNCTION || ExprHasProperty(p, EP_xIsSelect) || !p->x.pList
+           || sqlite3StrICmp(p->u.zToken, "json_get") != 0) return 0;
+    for (i = 1; i < p->x.pList->nExpr; i++)
+    {
+      if (p->x.pList->a[i].pExpr && p->x.pList->a[i].pExpr->op == TK_BLOB) return 0;
+    }
+    return 1;
+  }
+
+  // Check if function token is json_object or json_array constructor
+  static int isJsonBuildFunction(Token *pName)
+  {
+    return (pName->n == 11 && sqlite3StrNICmp(pName->z, "json_object", 11) == 0)
+        || (pName->n == 10 && sqlite3StrNICmp(pName->z, "json_array", 10) == 0);
+  }
+
+  // Values of json constructor which are json already are passed as raw json:
+  // json_object('k', doc->a)          =>  json_object('k', json_raw(doc, 'a'))
+  // json_array(json_array(1, 2))      =>  json_array(json_raw(json_array(1, 2)))
+  // Keys of json_object (even arguments) are left as is
+  static void jsonRawArgs(Parse *pParse, ExprList *pList, int bObject)
+  {
+    int i;
+    for (i = bObject ? 1 : 0; i < pList->nExpr; i += bObject ? 2 : 1)
+    {
+      Expr *p = pList->a[i].pExpr;
+      Token name;
+      if (!p || p->op != TK_FUNCTION || ExprHasProperty(p, EP_xIsSelect)) continue;
+      name.z = p->u.zToken;
+      name.n = sqlite3Strlen30(p->u.zToken);
+      if (sqlite3StrICmp(p->u.zToken, "json_get") == 0)
+      {
+        // Function name is stored inside expression and has the same length
+        memcpy(p->u.zToken, "json_raw", 8);
+      }
+      else if (isJsonBuildFunction(&name))
+      {
+        Token raw_token;
+        raw_token.z = "json_raw";
+        raw_token.n = 8;
+        pList->a[i].pExpr = sqlite3ExprFunction(pParse, sqlite3ExprListAppend(pParse, 0, p), &raw_token);
+      }
+    }
+  }
+
+  // Check if expression is constant operand of fused json function:
+  // literal or bound parameter
+  static int isJsonConstOperand(Expr *p)
+  {
+    return p && (p->op == TK_STRING || p->op == TK_INTEGER || 
+                 p->op == TK_FLOAT || p->op == TK_VARIABLE);
+  }
+
+  // Replace json_get(json, path...) function with zName(json, path..., pLast)
+  static Expr* jsonFuseFunction(Parse *pParse, Expr *pJsonGet, Expr *pLast, const char *zName)
+  {
+    Token func_token;
+    ExprList *pList = pJsonGet->x.pList;
+    pJsonGet->x.pList = 0;
+    sqlite3ExprDelete(pParse->db, pJsonGet);
+    pList = sqlite3ExprListAppend(pParse, pList, pLast);
+    func_token.z = zName;
+    func_token.n = sqlite3Strlen30(zName);
+    return sqlite3ExprFunction(pParse, pList, &func_token);
+  }
+
+  // Check if IN-list can be checked by json_in function:
+  // left operand is -> expression and all list items are constant operands
+  static int isJsonInList(Expr *pLeft, ExprList *pList)
+  {
+    int i;
+    if (!isJsonGetExpr(pLeft) || !pList) return 0;
+    for (i = 0; i < pList->nExpr; i++)
+    {
+      if (!isJsonConstOperand(pList->a[i].pExpr)) return 0;
+    }
+    return 1;
+  }
+
+  // Replace json_get(json, path...) IN (v1, v2...)
+  // with json_in(json, path_count, path..., v1, v2...)
+  static Expr* jsonFuseInFunction(Parse *pParse, Expr *pJsonGet, ExprList *pValues)
+  {
+    Token func_token;
+    char zCount[20];
+    ExprList *pList = pJsonGet->x.pList;
+    ExprList *pArgs;
+    int i;
+    pJsonGet->x.pList = 0;
+    sqlite3ExprDelete(pParse->db, pJsonGet);
+
+    // First item of pList is json, others are path elements
+    sqlite3_snprintf(sizeof(zCount), zCount, "%d", pList->nExpr - 1);
+    pArgs = sqlite3ExprListAppend(pParse, 0, pList->a[0].pExpr);
+    pList->a[0].pExpr = 0;
+    pArgs = sqlite3ExprListAppend(pParse, pArgs, sqlite3Expr(pParse->db, TK_INTEGER, zCount));
+    for (i = 1; i < pList->nExpr; i++)
+    {
+      pArgs = sqlite3ExprListAppend(pParse, pArgs, pList->a[i].pExpr);
+      pList->a[i].pExpr = 0;
+    }
+    sqlite3ExprListDelete(pParse->db, pList);
+    pArgs = concatExprList(pParse, pArgs, pValues);
+
+    func_token.z = "json_in";
+    func_token.n = 7;
+    return sqlite3ExprFunction(pParse, pArgs, &func_token);
+  }
+
+  // Comparison of -> expression with literal or bound parameter is rewritten
+  // to fused function which compares json value in place, without extracting it:
+  // doc->status = 'active'  =>  json_eq(doc, 'status', 'active')
+  // 10 < doc->total         =>  json_gt(doc, 'total', 10)
+  // Other comparisons are built as usual binary expressions
+  static void spanJsonCompareExpr(
+    ExprSpan *pOut,     /* Write the result here */
+    Parse *pParse,      /* The parsing context.  Errors accumulate here */
+    int op,             /* One of TK_EQ, TK_NE, TK_LT, TK_LE, TK_GT, TK_GE */
+    ExprSpan *pLeft,    /* The left operand */
+    ExprSpan *pRight    /* The right operand */
+  ){
+    const char *zName;
+    if (isJsonGetExpr(pRight->pExpr) && isJsonConstOperand(pLeft->pExpr))
+    {
+      ExprSpan tmp = *pLeft;
+      *pLeft = *pRight;
+      *pRight = tmp;
+      switch (op)
+      {
+        case TK_LT: op = TK_GT; break;
+        case TK_LE: op = TK_GE; break;
+        case TK_GT: op = TK_LT; break;
+        case TK_GE: op = TK_LE; break;
+      }
+      pOut->zStart = pRight->zStart;
+      pOut->zEnd = pLeft->zEnd;
+    }
+    else if (isJsonGetExpr(pLeft->pExpr) && isJsonConstOperand(pRight->pExpr))
+    {
+      pOut->zStart = pLeft->zStart;
+      pOut->zEnd = pRight->zEnd;
+    }
+    else
+    {
+      spanBinaryExpr(pOut, pParse, op, pLeft, pRight);
+      return;
+    }
+    switch (op)
+    {
+      case TK_EQ: zName = "json_eq"; break;
+      case TK_NE: zName = "json_ne"; break;
+      case TK_LT: zName = "json_lt"; break;
+      case TK_LE: zName = "json_le"; break;
+      case TK_GT: zName = "json_gt"; break;
+      default:    zName = "json_ge"; break;
+    }
+    pOut->pExpr = jsonFuseFunction(pParse, pLeft->pExpr, pRight->pExpr, zName);
+  }
 }
 
 // Nonterminal for json key path
@@ -1454,16 +1704,76 @@ expr(A) ::= expr(X) JSONGET json_key_list(Y). {
   A.pExpr = sqlite3ExprFunction(pParse, pList, &json_get_token);
 }
 
+// Operator ?? checks if key exists in json:
+// SELECT '{"key": null}' ?? key;        // SAME AS json_has('{"key": null}', 'key')
+// > 1
+// Unlike doc->key IS NOT NULL value is not extracted and json null is
+// distinguished from missing key
+expr(A) ::= expr(X) JSONHAS json_key_list(Y). {
+  Token json_has_token;
+  
+  ExprList *pList;
+  pList = sqlite3ExprListAppend(pParse,0,X.pExpr);
+  pList = concatExprList(pParse, pList, Y);
+
+  json_has_token.z = "json_has";
+  json_has_token.n = 8;
+  A.pExpr = sqlite3ExprFunction(pParse, pList, &json_has_token);
+}
+
 // Nonterminals for json key and json index
 %type json_key {ExprSpan}
 %destructor json_key {sqlite3ExprDelete(pParse->db, $$.pExpr);}
 %type json_index {ExprSpan}
 %destructor json_index {sqlite3ExprDelete(pParse->db, $$.pExpr);}
 
-json_key(A) ::= id(X).              {spanExpr(&A, pParse, TK_STRING, &X);}
+json_key(A) ::= id(X).              {
+  // Bracket-quoted step expression: doc->items->[?(@.qty > 0)]
+  if (isJsonStepText(X.z, X.n)) spanJsonStep(&A, pParse, X.z, X.n, &X, &X);
+  else spanExpr(&A, pParse, TK_STRING, &X);
+}
 json_key(A) ::= STRING(X).          {spanExpr(&A, pParse, @X, &X);}
 json_key(A) ::= JOIN_KW(X).         {spanExpr(&A, pParse, TK_STRING, &X);}
 json_index(A) ::= INTEGER(X).       {spanExpr(&A, pParse, @X, &X);}
+// Negative index counts from the end: doc->samples->-1 is the last element
+json_index(A) ::= MINUS(B) INTEGER(X). {
+  A.pExpr = sqlite3PExpr(pParse, TK_UMINUS, sqlite3PExpr(pParse, @X, 0, 0, &X), 0, 0);
+  spanSet(&A, &B, &X);
+}
+
+// Dynamic path elements: doc->?, doc->:name, doc->(expr)
+// Bound value or expression result is used as index if it is integer,
+// otherwise as key, so one prepared statement serves any key
+json_key(A) ::= VARIABLE(X).        {
+  spanExpr(&A, pParse, TK_VARIABLE, &X);
+  sqlite3ExprAssignVarNumber(pParse, A.pExpr);
+  spanSet(&A, &X, &X);
+}
+json_key(A) ::= LP(B) expr(X) RP(E). {A.pExpr = X.pExpr; spanSet(&A,&B,&E);}
+
+// Wildcard step: all elements of array or values of object
+// SELECT '{"items": [{"price": 1}, {"price": 2}]}'->items->*->price;
+// > [1,2]
+json_key(A) ::= STAR(X).            {spanJsonStep(&A, pParse, "*", 1, &X, &X);}
+
+// Bracket steps are written as bracket-quoted identifiers, so they can't contain ']'
+// Filter step: elements where filter is true
+// SELECT '{"items": [{"qty": 0, "sku": "a"}, {"qty": 2, "sku": "b"}]}'->items->[?(@.qty > 0)]->sku;
+// > ["b"]
+
+// Slice step: [start:end:step], each part is optional, negative start and end
+// count from the end
+// SELECT '[0, 1, 2, 3, 4, 5]'->[1:5:2];
+// > [1,3]
+
+// Recursive descent: ..key is first field key at any depth, search stops at it
+// [..key] is json array of all fields key at any depth
+// SELECT '{"a": {"id": 1, "b": {"id": 2}}}'->..id;
+// > 1
+// SELECT '{"a": {"id": 1, "b": {"id": 2}}}'->[..id];
+// > [1,2]
+json_key(A) ::= DOT(B) DOT id(X).   {spanJsonDescentStep(&A, pParse, &B, &X);}
+json_key(A) ::= DOT(B) DOT STRING(X). {spanJsonDescentStep(&A, pParse, &B, &X);}
 
 json_key_list(A) ::= json_key_list(X) JSONGET json_key(Y). {
   A = sqlite3ExprListAppend(pParse,X,Y.pExpr);
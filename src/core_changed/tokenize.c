@@ -306,6 +306,14 @@ int sqlite3GetToken(const unsigned char *z, int *tokenType){
       return i;
     }
     case '?': {
+#     ifdef SQLITE_ENABLE_JSON
+        if (z[1]=='?'){
+          // This adds support json key existence operator ('??')
+          // Two adjacent parameters are never valid SQL, so there is no ambiguity
+          *tokenType = TK_JSONHAS;
+          return 2;
+        }
+#     endif
       *tokenType = TK_VARIABLE;
       for(i=1; sqlite3Isdigit(z[i]); i++){}
       return i;
@@ -41,6 +41,9 @@ typedef struct
 	int len;
 } JsonGetUtf8Char;
 
+// Number of elements jsonget_move_index can take from the end of array in one pass
+#define JSONGET_FROM_END_RING_SIZE 16
+
 // Condtion for fake do-while loop used in multiline macros
 // Switch to second line if you want disable VS warning C4127: conditional expression is constant
 #define JSONGET_FAKE_LOOP_CONDITION 0
@@ -84,10 +87,11 @@ typedef struct
 
 
 // Make cursor with type JSON_PAIR and specified str pointer
+// Pair starts with quoted key, so closing } of empty object is not a pair
 static JsonGetCursor pjsonget_make_pair_cursor(const char *pstr)
 {
 	JSONGET_SKIP_SPACES(pstr);
-	if (*pstr)
+	if (*pstr == '"')
 	{
 		JsonGetCursor ret_val;
 		ret_val.pstr = pstr;
@@ -248,28 +252,35 @@ static int pjson_read_string_char(const char *pstr, JsonGetUtf8Char* out_char)
 static int pjson_eat_int(const char** ppstr)
 {
 	int sign = **ppstr == '-';
-	int res = 0;	
+	unsigned res = 0; // unsigned, so too long number wraps instead of overflow
 	if (**ppstr == '-' || **ppstr == '+') (*ppstr)++;
 	while (JSONGET_IS_DIGIT(**ppstr)) 
 	{
 		res = res * 10 + (**ppstr - '0');
 		(*ppstr)++;
 	} 
-	return sign ? -res : res;
+	return (int)(sign ? 0u - res : res);
 }
 
 // Read integer and double representation of number under pstr
 static void pjson_read_number(const char* pstr, int *out_as_int, double *out_as_double)
 {
 	const char *p = pstr;
+	const char *q = pstr;
 	// Read int 
 	*out_as_int = pjson_eat_int(&p);
 
-	// Read double
-	*out_as_double = *out_as_int;
+	// Read double, integer part is read again: it may not fit in int
+	*out_as_double = 0;
+	if (*q == '-' || *q == '+') q++;
+	while (JSONGET_IS_DIGIT(*q))
+	{
+		*out_as_double = *out_as_double * 10 + (*q - '0');
+		q++;
+	}
 	if (*p == '.')
 	{
-		double scale = *out_as_int > 0 ? 0.1 : -0.1;
+		double scale = 0.1;
 		p++;
 		while (JSONGET_IS_DIGIT(*p))
 		{
@@ -278,6 +289,7 @@ static void pjson_read_number(const char* pstr, int *out_as_int, double *out_as_
 			p++;
 		}
 	}
+	if (*pstr == '-') *out_as_double = -*out_as_double;
 
 	// Read mantissa
 	if (*p == 'e' || *p == 'E')
@@ -285,7 +297,7 @@ static void pjson_read_number(const char* pstr, int *out_as_int, double *out_as_
 		int e;
 		p++;
 		e = pjson_eat_int(&p);
-		if (e >= 0) while (e) { *out_as_double *= 10; *out_as_int *= 10;  e--; }
+		if (e >= 0) while (e) { *out_as_double *= 10; *out_as_int = (int)((unsigned)*out_as_int * 10);  e--; }
 		else while (e) { *out_as_double /= 10; *out_as_int /= 10;  e++; }
 	}
 }
@@ -334,9 +346,9 @@ static int pjson_skip_val(const char **ppstr, int is_pair)
 			else return 0;
 			break;
 		}
-		case 't': if (!pjson_skip_word(ppstr, "true")) return 0;
-		case 'f': if (!pjson_skip_word(ppstr, "false")) return 0;
-		case 'n': if (!pjson_skip_word(ppstr, "null")) return 0;
+		case 't': if (!pjson_skip_word(ppstr, "true")) return 0; break;
+		case 'f': if (!pjson_skip_word(ppstr, "false")) return 0; break;
+		case 'n': if (!pjson_skip_word(ppstr, "null")) return 0; break;
 		default:
 			// Skip '-' of negative number
 			if (**ppstr == '-') (*ppstr)++;
@@ -348,7 +360,7 @@ static int pjson_skip_val(const char **ppstr, int is_pair)
 			}
 			else 
 			{
-				(*ppstr)++; // skip wrong char
+				if (**ppstr) (*ppstr)++; // skip wrong char, but never the terminating zero
 				return 0;
 			}
 	}
@@ -363,34 +375,47 @@ static int pjson_skip_val(const char **ppstr, int is_pair)
 	return 1;
 }
 
-// Compare string representation of cursor value with _str2_
-static int pjsonget_string_compare(const JsonGetCursor cursor, const char *str2, const char** out_token_end)
+// Compare string representation of cursor value with first _length_ bytes of _str2_
+// Bytes are compared as unsigned chars, so order of results is the same as memcmp order.
+// Unescaped parts of STRING values are compared in place, escape sequences are decoded char by char
+static int pjsonget_string_ncompare(const JsonGetCursor cursor, const char *str2, int length, const char** out_token_end)
 {
+	const unsigned char *s2 = (const unsigned char*)str2;
 	const char *p = cursor.pstr;
 	if (cursor.type == JSONGET_INVALID) return -1;
-	
+
 	*out_token_end = cursor.pstr;
 	if (cursor.type == JSONGET_STRING || cursor.type == JSONGET_PAIR)
 	{
-		int read;
-		JsonGetUtf8Char uchar;
 		int diff = 0;
 		if (*p == '\"') p++; // skip "
 		else return -1;
-		while (!diff && *str2 && (read = pjson_read_string_char(p, &uchar)) > 0)
+		while (!diff)
 		{
-			int i;
-			p += read;
-			for (i = 0; i < uchar.len && diff == 0 && *str2; i++, str2++) diff = uchar.c[i] - *str2;
-			if (!*str2 && i != uchar.len) diff = uchar.c[i];
-		}
-		if (!read) diff = 0 - *str2;
-		else 
-		{ 
-			// Move to end of string value			
-			JSONGET_SKIP_STRING_CONTENT(p, '"', '\\');
+			// Compare unescaped characters as raw bytes
+			while (length && *p && *p != '"' && *p != '\\' && (unsigned char)*p == *s2)
+			{
+				p++;
+				s2++;
+				length--;
+			}
+			if (!*p || *p == '"') diff = length ? -1 : 0;
+			else if (*p == '\\')
+			{
+				int i;
+				JsonGetUtf8Char uchar;
+				p += pjson_read_string_char(p, &uchar);
+				for (i = 0; i < uchar.len && !diff; i++, s2++, length--)
+				{
+					diff = length ? (unsigned char)uchar.c[i] - *s2 : 1;
+				}
+			}
+			else diff = length ? (unsigned char)*p - *s2 : 1;
+			if (!*p || *p == '"') break;
 		}
-		
+
+		// Move to end of string value
+		if (*p != '"') JSONGET_SKIP_STRING_CONTENT(p, '"', '\\');
 		if (*p == '"') p++;
 		*out_token_end = p;
 		return diff;
@@ -399,14 +424,25 @@ static int pjsonget_string_compare(const JsonGetCursor cursor, const char *str2,
 	{
 		// Move to end of value
 		if (!pjson_skip_val(out_token_end, 0)) return -1;
-		while (p != *out_token_end && *str2 && *str2 == *p)
+		while (p != *out_token_end && length && (unsigned char)*p == *s2)
 		{
 			p++;
-			str2++;
+			s2++;
+			length--;
 		}
-		return (p != *out_token_end ? *p : 0) - *str2;
+		if (p == *out_token_end) return length ? -1 : 0;
+		return length ? (unsigned char)*p - *s2 : 1;
 	}
 }
+
+// Compare string representation of cursor value with NULL-terminated _str2_
+static int pjsonget_string_compare(const JsonGetCursor cursor, const char *str2, const char** out_token_end)
+{
+	int length = 0;
+	while (str2[length]) length++;
+	return pjsonget_string_ncompare(cursor, str2, length, out_token_end);
+}
+
 /*
 ** ------------------------------------------
 ** Init cursor
@@ -428,6 +464,14 @@ JsonGetCursor jsonget(const char *json_str)
 
 // Move to _key_ field of current json object
 JsonGetCursor jsonget_move_key(const JsonGetCursor cursor, const char* key)
+{
+	int length = 0;
+	while (key[length]) length++;
+	return jsonget_move_nkey(cursor, key, length);
+}
+
+// Move to field of current json object with key of _length_ bytes
+JsonGetCursor jsonget_move_nkey(const JsonGetCursor cursor, const char* key, const int length)
 {
 	if (cursor.type == JSONGET_OBJECT)
 	{
@@ -438,7 +482,7 @@ JsonGetCursor jsonget_move_key(const JsonGetCursor cursor, const char* key)
 		while(not_found && *p && *p != '}')
 		{
 			ckey = pjsonget_decode_cursor(p);
-			not_found = pjsonget_string_compare(ckey, key, &p);
+			not_found = pjsonget_string_ncompare(ckey, key, length, &p);
 			if (not_found)
 			{
 				JSONGET_SKIP_SPACES(p);
@@ -462,10 +506,46 @@ JsonGetCursor jsonget_move_key(const JsonGetCursor cursor, const char* key)
 	else JSONGET_RETURN_INVALID_CURSOR;
 }
 
+// Move to element _count_ from the end of current json array or json object
+// Starts of last _count_ elements are kept in ring buffer on the stack, so the
+// array is walked once. For large _count_ elements are counted first
+static JsonGetCursor pjsonget_move_from_end(const JsonGetCursor cursor, const int count)
+{
+	const char *ring[JSONGET_FROM_END_RING_SIZE];
+	const char *p = cursor.pstr;
+	char closec = *p == '[' ? ']' : '}';
+	int i = 0;
+	if (count > JSONGET_FROM_END_RING_SIZE)
+	{
+		int total = jsonget_array_count(cursor);
+		if (count > total) JSONGET_RETURN_INVALID_CURSOR;
+		return jsonget_move_index(cursor, total - count);
+	}
+	if (*p) p++; // skip [ or {
+	JSONGET_SKIP_SPACES(p);
+	while (*p && *p != closec)
+	{
+		ring[i % count] = p;
+		if (!pjson_skip_val(&p, cursor.type == JSONGET_OBJECT)) JSONGET_RETURN_INVALID_CURSOR;
+		JSONGET_SKIP_SPACES(p);
+		if (*p == ',') p++;
+		JSONGET_SKIP_SPACES(p);
+		i++;
+	}
+	if (i < count) JSONGET_RETURN_INVALID_CURSOR;
+	// Element i - count is in ring[(i - count) % count] == ring[i % count]
+	if (cursor.type == JSONGET_OBJECT) return pjsonget_make_pair_cursor(ring[i % count]);
+	else return pjsonget_decode_cursor(ring[i % count]);
+}
+
 // Move to _index_ index of current json array
 JsonGetCursor jsonget_move_index(const JsonGetCursor cursor, const int index)
 {
-	if (cursor.type == JSONGET_ARRAY || cursor.type == JSONGET_OBJECT)
+	if ((cursor.type == JSONGET_ARRAY || cursor.type == JSONGET_OBJECT) && index < 0)
+	{
+		return pjsonget_move_from_end(cursor, -index);
+	}
+	else if (cursor.type == JSONGET_ARRAY || cursor.type == JSONGET_OBJECT)
 	{
 		int i = 0;
 		const char *p = cursor.pstr;
@@ -522,6 +602,559 @@ JsonGetCursor jsonget_move_pair_value(const JsonGetCursor cursor)
 }
 
 
+/*
+** ------------------------------------------
+** Recursive search
+** ------------------------------------------
+*/
+
+// Start search of keys at any depth inside current json object or array
+JsonGetSearch jsonget_search(const JsonGetCursor cursor)
+{
+	JsonGetSearch search;
+	search.pstr = cursor.type == JSONGET_OBJECT || cursor.type == JSONGET_ARRAY ? cursor.pstr : 0;
+	search.depth = 0;
+	return search;
+}
+
+// Move to value of next field with _key_ of _length_ bytes at any depth
+JsonGetCursor jsonget_search_next_nkey(JsonGetSearch *search, const char *key, const int length)
+{
+	const char *p = search->pstr;
+	if (!p) JSONGET_RETURN_INVALID_CURSOR;
+	while (*p)
+	{
+		switch (*p)
+		{
+			case '{':
+			case '[':
+				search->depth++;
+				p++;
+				break;
+			case '}':
+			case ']':
+				search->depth--;
+				p++;
+				if (search->depth <= 0)
+				{
+					// End of searched value
+					search->pstr = 0;
+					JSONGET_RETURN_INVALID_CURSOR;
+				}
+				break;
+			case '"':
+			{
+				// Compare every string with key, string followed by : is field key
+				JsonGetCursor ckey;
+				int diff;
+				ckey.pstr = p;
+				ckey.type = JSONGET_STRING;
+				diff = pjsonget_string_ncompare(ckey, key, length, &p);
+				JSONGET_SKIP_SPACES(p);
+				if (*p == ':')
+				{
+					p++;
+					if (!diff)
+					{
+						JsonGetCursor ret_val = pjsonget_decode_cursor(p);
+						// Continue search from found value
+						search->pstr = ret_val.type != JSONGET_INVALID ? ret_val.pstr : 0;
+						return ret_val;
+					}
+				}
+				break;
+			}
+			default:
+				p++;
+		}
+	}
+	search->pstr = 0;
+	JSONGET_RETURN_INVALID_CURSOR;
+}
+
+/*
+** ------------------------------------------
+** Stream parsing
+** ------------------------------------------
+*/
+
+// Lexer states of stream parser
+#define PJSONGET_STREAM_ROOT            0	// between root values
+#define PJSONGET_STREAM_VALUE           1	// expect value after , or :
+#define PJSONGET_STREAM_VALUE_OR_CLOSE  2	// expect value or ] after [
+#define PJSONGET_STREAM_KEY             3	// expect key after ,
+#define PJSONGET_STREAM_KEY_OR_CLOSE    4	// expect key or } after {
+#define PJSONGET_STREAM_KEY_STRING      5	// inside key
+#define PJSONGET_STREAM_COLON           6	// expect : after key
+#define PJSONGET_STREAM_AFTER_VALUE     7	// expect , or closing bracket
+#define PJSONGET_STREAM_STRING          8	// inside string value
+#define PJSONGET_STREAM_NUMBER          9	// inside number
+#define PJSONGET_STREAM_WORD            10	// inside true, false or null
+#define PJSONGET_STREAM_FAILED          11	// invalid json was found
+
+// String states are combined with escape flags
+#define PJSONGET_STREAM_ESCAPE          0x100	// after backslash
+
+// Results of parsing one character
+#define PJSONGET_STREAM_CHAR_OK         0	// character is consumed
+#define PJSONGET_STREAM_CHAR_MATCH      1	// character is consumed and completes match
+#define PJSONGET_STREAM_CHAR_MATCH_BEFORE 2	// match is complete before character, it is not consumed
+#define PJSONGET_STREAM_CHAR_ERROR      3	// invalid character
+
+// Parts of number parsed by stream parser
+#define PJSONGET_NUMBER_SIGN       0	// after -
+#define PJSONGET_NUMBER_ZERO       1	// after leading 0 of integer part
+#define PJSONGET_NUMBER_INTEGER    2	// in integer part
+#define PJSONGET_NUMBER_POINT      3	// after .
+#define PJSONGET_NUMBER_FRACTION   4	// in fraction part
+#define PJSONGET_NUMBER_EXP        5	// after e or E
+#define PJSONGET_NUMBER_EXP_SIGN   6	// after sign of exponent
+#define PJSONGET_NUMBER_EXP_DIGITS 7	// in exponent digits
+
+// Number may end after these parts
+#define PJSONGET_NUMBER_CAN_END(part) ((part) == PJSONGET_NUMBER_ZERO || (part) == PJSONGET_NUMBER_INTEGER \
+	|| (part) == PJSONGET_NUMBER_FRACTION || (part) == PJSONGET_NUMBER_EXP_DIGITS)
+
+#define PJSONGET_STREAM_IS_OBJECT(s, d) ((s)->is_object[(d) >> 3] & (1 << ((d) & 7)))
+
+// Copy character of value being matched to value buffer
+static void pjsonget_stream_append(JsonGetStream *s, char c)
+{
+	if (s->value_length < s->buffer_size - 1) s->value_buffer[s->value_length] = c;
+	s->value_length++;
+}
+
+// NULL-terminate matched value
+static void pjsonget_stream_terminate(JsonGetStream *s)
+{
+	if (s->buffer_size > 0)
+		s->value_buffer[s->value_length < s->buffer_size ? s->value_length : s->buffer_size - 1] = 0;
+}
+
+// Return part of number after character c, -1 if c doesn't continue number
+static int pjsonget_number_next(int part, char c)
+{
+	int digit = JSONGET_IS_DIGIT(c);
+	switch (part)
+	{
+		case PJSONGET_NUMBER_SIGN: return c == '0' ? PJSONGET_NUMBER_ZERO : digit ? PJSONGET_NUMBER_INTEGER : -1;
+		case PJSONGET_NUMBER_INTEGER: if (digit) return PJSONGET_NUMBER_INTEGER; break;
+		case PJSONGET_NUMBER_POINT: return digit ? PJSONGET_NUMBER_FRACTION : -1;
+		case PJSONGET_NUMBER_FRACTION: if (digit) return PJSONGET_NUMBER_FRACTION; break;
+		case PJSONGET_NUMBER_EXP: if (c == '-' || c == '+') return PJSONGET_NUMBER_EXP_SIGN; // fall through
+		case PJSONGET_NUMBER_EXP_SIGN:
+		case PJSONGET_NUMBER_EXP_DIGITS: return digit ? PJSONGET_NUMBER_EXP_DIGITS : -1;
+	}
+	// After integer or fraction part
+	if (c == '.' && part != PJSONGET_NUMBER_FRACTION) return PJSONGET_NUMBER_POINT;
+	if (c == 'e' || c == 'E') return PJSONGET_NUMBER_EXP;
+	return -1;
+}
+
+// Complete value at current depth, return 1 if it is the matched value
+static int pjsonget_stream_end_value(JsonGetStream *s)
+{
+	s->state = s->depth ? PJSONGET_STREAM_AFTER_VALUE : PJSONGET_STREAM_ROOT;
+	if (s->capture_depth != s->depth) return 0;
+	s->capture_depth = -1;
+	return 1;
+}
+
+// Complete element of object or array at current depth
+static void pjsonget_stream_end_element(JsonGetStream *s)
+{
+	if (s->match_depth == s->depth) s->match_depth--;
+}
+
+// Start value with first character c. Return 0 if c can't start value
+static int pjsonget_stream_begin_value(JsonGetStream *s, char c)
+{
+	int type;
+	switch (c)
+	{
+		case '{': type = JSONGET_OBJECT; break;
+		case '[': type = JSONGET_ARRAY; break;
+		case '"': type = JSONGET_STRING; break;
+		case 't':
+		case 'f': type = JSONGET_BOOLEAN; break;
+		case 'n': type = JSONGET_NULL; break;
+		default:
+			if (c != '-' && !JSONGET_IS_DIGIT(c)) return 0;
+			type = JSONGET_INTEGER;
+	}
+
+	if (!s->depth) s->root_index++;
+	else if (!PJSONGET_STREAM_IS_OBJECT(s, s->depth - 1) && s->match_depth == s->depth - 1
+		&& s->depth <= s->path_length)
+	{
+		// Array element is on path if its index matches path step
+		const JsonGetStreamStep *step = &s->path[s->depth - 1];
+		if (!step->key && (step->index == JSONGET_STREAM_ANY_INDEX || step->index == s->index[s->depth - 1]))
+			s->match_depth = s->depth;
+	}
+	if (s->capture_depth < 0 && s->match_depth == s->depth && s->depth == s->path_length)
+	{
+		s->capture_depth = s->depth;
+		s->value_type = type;
+		s->value_length = 0;
+	}
+
+	switch (type)
+	{
+		case JSONGET_OBJECT:
+		case JSONGET_ARRAY:
+			if (s->depth >= JSONGET_STREAM_MAX_DEPTH) return 0;
+			if (type == JSONGET_OBJECT) s->is_object[s->depth >> 3] |= 1 << (s->depth & 7);
+			else s->is_object[s->depth >> 3] &= ~(1 << (s->depth & 7));
+			s->depth++;
+			if (s->depth <= s->path_length) s->index[s->depth - 1] = 0;
+			s->state = type == JSONGET_OBJECT ? PJSONGET_STREAM_KEY_OR_CLOSE : PJSONGET_STREAM_VALUE_OR_CLOSE;
+			break;
+		case JSONGET_STRING:
+			s->state = PJSONGET_STREAM_STRING;
+			break;
+		case JSONGET_INTEGER:
+			s->state = PJSONGET_STREAM_NUMBER;
+			s->number_part = c == '-' ? PJSONGET_NUMBER_SIGN : c == '0' ? PJSONGET_NUMBER_ZERO : PJSONGET_NUMBER_INTEGER;
+			break;
+		default:
+			s->state = PJSONGET_STREAM_WORD;
+			s->word = c == 't' ? "true" : c == 'f' ? "false" : "null";
+			s->word_pos = 1;
+	}
+	return 1;
+}
+
+// Start key of object field
+static void pjsonget_stream_begin_key(JsonGetStream *s)
+{
+	s->state = PJSONGET_STREAM_KEY_STRING;
+	s->key_pos = s->match_depth == s->depth - 1 && s->depth <= s->path_length
+		&& s->path[s->depth - 1].key ? 0 : -1;
+}
+
+// Close object or array with character c
+static int pjsonget_stream_close(JsonGetStream *s, char c)
+{
+	if ((c == '}') != (PJSONGET_STREAM_IS_OBJECT(s, s->depth - 1) != 0)) return PJSONGET_STREAM_CHAR_ERROR;
+	pjsonget_stream_end_element(s);
+	s->depth--;
+	return pjsonget_stream_end_value(s) ? PJSONGET_STREAM_CHAR_MATCH : PJSONGET_STREAM_CHAR_OK;
+}
+
+// Parse string character c, return 1 when closing quote is found
+static int pjsonget_stream_string_char(JsonGetStream *s, char c)
+{
+	if (s->state & PJSONGET_STREAM_ESCAPE)
+	{
+		if (s->hex_left)
+		{
+			if (JSONGET_CHAR_HEX(c) < 0) s->state = PJSONGET_STREAM_FAILED;
+			else if (!--s->hex_left) s->state &= ~PJSONGET_STREAM_ESCAPE;
+		}
+		else if (c == 'u') s->hex_left = 4;
+		else if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't')
+			s->state &= ~PJSONGET_STREAM_ESCAPE;
+		else s->state = PJSONGET_STREAM_FAILED;
+		return 0;
+	}
+	if (c == '"') return 1;
+	if (c == '\\') s->state |= PJSONGET_STREAM_ESCAPE;
+	else if ((unsigned char)c < 0x20) s->state = PJSONGET_STREAM_FAILED;
+	return 0;
+}
+
+// Parse one character
+static int pjsonget_stream_char(JsonGetStream *s, char c)
+{
+	switch (s->state & ~PJSONGET_STREAM_ESCAPE)
+	{
+		case PJSONGET_STREAM_STRING:
+			if (!pjsonget_stream_string_char(s, c)) break;
+			return pjsonget_stream_end_value(s) ? PJSONGET_STREAM_CHAR_MATCH : PJSONGET_STREAM_CHAR_OK;
+		case PJSONGET_STREAM_KEY_STRING:
+		{
+			// Key is compared with path key byte by byte, key_pos is -1 if key is not on path
+			const JsonGetStreamStep *step = s->key_pos >= 0 ? &s->path[s->depth - 1] : 0;
+			if (!pjsonget_stream_string_char(s, c))
+			{
+				if (step)
+				{
+					if (s->key_pos < step->key_length && step->key[s->key_pos] == c) s->key_pos++;
+					else s->key_pos = -1;
+				}
+				break;
+			}
+			if (step && s->key_pos == step->key_length) s->match_depth = s->depth;
+			s->state = PJSONGET_STREAM_COLON;
+			break;
+		}
+		case PJSONGET_STREAM_NUMBER:
+		{
+			int part = pjsonget_number_next(s->number_part, c);
+			if (part >= 0)
+			{
+				s->number_part = part;
+				if (s->capture_depth == s->depth && (c == '.' || c == 'e' || c == 'E')) s->value_type = JSONGET_DOUBLE;
+				break;
+			}
+			// Incomplete number and leading zero are errors
+			if (!PJSONGET_NUMBER_CAN_END(s->number_part) || JSONGET_IS_DIGIT(c)) return PJSONGET_STREAM_CHAR_ERROR;
+			// Number ends before c, c is parsed after it
+			if (pjsonget_stream_end_value(s)) return PJSONGET_STREAM_CHAR_MATCH_BEFORE;
+			return pjsonget_stream_char(s, c);
+		}
+		case PJSONGET_STREAM_WORD:
+			if (s->word[s->word_pos] != c) return PJSONGET_STREAM_CHAR_ERROR;
+			if (s->word[++s->word_pos]) break;
+			return pjsonget_stream_end_value(s) ? PJSONGET_STREAM_CHAR_MATCH : PJSONGET_STREAM_CHAR_OK;
+		case PJSONGET_STREAM_FAILED:
+			return PJSONGET_STREAM_CHAR_ERROR;
+		default:
+			if (JSONGET_IS_WHITESPACE(c)) break;
+			switch (s->state)
+			{
+				case PJSONGET_STREAM_ROOT:
+				case PJSONGET_STREAM_VALUE:
+					if (!pjsonget_stream_begin_value(s, c)) return PJSONGET_STREAM_CHAR_ERROR;
+					break;
+				case PJSONGET_STREAM_VALUE_OR_CLOSE:
+					if (c == ']') return pjsonget_stream_close(s, c);
+					if (!pjsonget_stream_begin_value(s, c)) return PJSONGET_STREAM_CHAR_ERROR;
+					break;
+				case PJSONGET_STREAM_KEY_OR_CLOSE:
+					if (c == '}') return pjsonget_stream_close(s, c);
+					// fall through
+				case PJSONGET_STREAM_KEY:
+					if (c != '"') return PJSONGET_STREAM_CHAR_ERROR;
+					pjsonget_stream_begin_key(s);
+					break;
+				case PJSONGET_STREAM_COLON:
+					if (c != ':') return PJSONGET_STREAM_CHAR_ERROR;
+					s->state = PJSONGET_STREAM_VALUE;
+					break;
+				case PJSONGET_STREAM_AFTER_VALUE:
+					if (c == '}' || c == ']') return pjsonget_stream_close(s, c);
+					if (c != ',') return PJSONGET_STREAM_CHAR_ERROR;
+					pjsonget_stream_end_element(s);
+					if (PJSONGET_STREAM_IS_OBJECT(s, s->depth - 1)) s->state = PJSONGET_STREAM_KEY;
+					else
+					{
+						if (s->depth <= s->path_length) s->index[s->depth - 1]++;
+						s->state = PJSONGET_STREAM_VALUE;
+					}
+					break;
+			}
+	}
+	return s->state == PJSONGET_STREAM_FAILED ? PJSONGET_STREAM_CHAR_ERROR : PJSONGET_STREAM_CHAR_OK;
+}
+
+// Init stream parser
+void jsonget_stream_init(JsonGetStream *stream, const JsonGetStreamStep *path, int path_length,
+	char *value_buffer, int buffer_size)
+{
+	int i;
+	char *p = (char*)stream;
+	for (i = 0; i < (int)sizeof(*stream); i++) p[i] = 0;
+	stream->path = path;
+	stream->path_length = path_length <= JSONGET_STREAM_MAX_PATH ? path_length : JSONGET_STREAM_MAX_PATH;
+	stream->value_buffer = value_buffer;
+	stream->buffer_size = buffer_size;
+	stream->value_type = JSONGET_INVALID;
+	stream->root_index = -1;
+	stream->capture_depth = -1;
+	stream->key_pos = -1;
+	if (path_length > JSONGET_STREAM_MAX_PATH) stream->state = PJSONGET_STREAM_FAILED;
+}
+
+// Parse chunk of json
+int jsonget_stream_feed(JsonGetStream *stream, const char *chunk, int length, int *out_consumed)
+{
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		int was_capturing = stream->capture_depth >= 0;
+		int rc = pjsonget_stream_char(stream, chunk[i]);
+		switch (rc)
+		{
+			case PJSONGET_STREAM_CHAR_ERROR:
+				stream->state = PJSONGET_STREAM_FAILED;
+				*out_consumed = i;
+				return JSONGET_STREAM_ERROR;
+			case PJSONGET_STREAM_CHAR_MATCH_BEFORE:
+				pjsonget_stream_terminate(stream);
+				*out_consumed = i;
+				return JSONGET_STREAM_MATCH;
+		}
+		// Characters from the first to the last one of matched value are copied
+		if (was_capturing || stream->capture_depth >= 0) pjsonget_stream_append(stream, chunk[i]);
+		if (rc == PJSONGET_STREAM_CHAR_MATCH)
+		{
+			pjsonget_stream_terminate(stream);
+			*out_consumed = i + 1;
+			return JSONGET_STREAM_MATCH;
+		}
+	}
+	*out_consumed = length;
+	return JSONGET_STREAM_MORE;
+}
+
+// Finish input of stream parser
+int jsonget_stream_end(JsonGetStream *stream)
+{
+	if (stream->state == PJSONGET_STREAM_NUMBER && PJSONGET_NUMBER_CAN_END(stream->number_part)
+		&& pjsonget_stream_end_value(stream))
+	{
+		pjsonget_stream_terminate(stream);
+		return JSONGET_STREAM_MATCH;
+	}
+	if (stream->state == PJSONGET_STREAM_ROOT) return JSONGET_STREAM_END;
+	stream->state = PJSONGET_STREAM_FAILED;
+	return JSONGET_STREAM_ERROR;
+}
+
+/*
+** ------------------------------------------
+** Batch extraction
+** ------------------------------------------
+*/
+
+// Number of documents walked together by jsonget_batch
+#define PJSONGET_BATCH_GROUP 8
+
+// Hint to load document start into cache
+#if defined(__GNUC__)
+#define PJSONGET_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PJSONGET_PREFETCH(p) ((void)0)
+#endif
+
+// Compile path of keys and indexes separated by '.'
+int jsonget_path_compile(JsonGetPath *path, const char *path_str, int length)
+{
+	int pos = 0;
+	if (length < 0)
+	{
+		length = 0;
+		while (path_str[length]) length++;
+	}
+	path->length = 0;
+	if (length == 0) return 0;
+	for (;;)
+	{
+		JsonGetStreamStep *step;
+		int start = pos, digit_start, is_index, index = 0, i;
+		if (path->length == JSONGET_STREAM_MAX_PATH) return 0;
+		while (pos < length && path_str[pos] != '.') pos++;
+		if (pos == start) return 0;
+
+		// Step of up to 9 digits with optional '-' is index, "-0" is no index from the end
+		digit_start = path_str[start] == '-' ? start + 1 : start;
+		is_index = digit_start < pos && pos - digit_start < 10;
+		for (i = digit_start; is_index && i < pos; i++)
+		{
+			if (!JSONGET_IS_DIGIT(path_str[i])) is_index = 0;
+			else index = index * 10 + (path_str[i] - '0');
+		}
+		if (digit_start > start && index == 0) is_index = 0;
+
+		step = &path->step[path->length++];
+		step->key = is_index ? 0 : path_str + start;
+		step->key_length = is_index ? 0 : pos - start;
+		step->index = digit_start > start ? -index : index;
+		if (pos == length) return 1;
+		pos++;
+	}
+}
+
+// Write value under cursor to columns of batch output, return 1 if value is not null
+static int pjsonget_batch_store(JsonGetBatchColumns *out, int i, JsonGetCursor cursor)
+{
+	jsonget_int64 as_int = 0;
+	double as_double = 0;
+	const char *slice = 0;
+	int slice_length = 0;
+	int is_valid = cursor.type != JSONGET_INVALID && cursor.type != JSONGET_NULL;
+	switch (cursor.type)
+	{
+		case JSONGET_BOOLEAN:
+			as_int = *cursor.pstr == 't';
+			as_double = (double)as_int;
+			break;
+		case JSONGET_INTEGER:
+		case JSONGET_DOUBLE:
+		{
+			const char *p = cursor.pstr;
+			jsonget_uint64 digits = 0; // unsigned, so too long number wraps instead of overflow
+			int unused;
+			pjson_read_number(cursor.pstr, &unused, &as_double);
+			// Integer is read again, jsonget_int is limited to int
+			if (*p == '-' || *p == '+') p++;
+			while (JSONGET_IS_DIGIT(*p)) digits = digits * 10 + (*p++ - '0');
+			as_int = (jsonget_int64)(*cursor.pstr == '-' ? 0 - digits : digits);
+			if (*p == 'e' || *p == 'E' || *p == '.')
+			{
+				// Truncated double, out of range value is clamped
+				if (as_double >= 9223372036854775807.0) as_int = (jsonget_int64)(((jsonget_uint64)1 << 63) - 1);
+				else if (as_double <= -9223372036854775808.0) as_int = (jsonget_int64)((jsonget_uint64)1 << 63);
+				else as_int = (jsonget_int64)as_double;
+			}
+			break;
+		}
+		default: break;
+	}
+	if (cursor.type != JSONGET_INVALID && (out->slice || out->slice_length))
+	{
+		jsonget_raw(cursor, &slice, &slice_length);
+		if (cursor.type == JSONGET_STRING && slice_length >= 2)
+		{
+			slice++;
+			slice_length -= 2;
+		}
+	}
+	if (out->type) out->type[i] = cursor.type;
+	if (out->as_int) out->as_int[i] = as_int;
+	if (out->as_double) out->as_double[i] = as_double;
+	if (out->slice) out->slice[i] = slice;
+	if (out->slice_length) out->slice_length[i] = slice_length;
+	if (out->valid && is_valid) out->valid[i / 8] |= (unsigned char)(1 << (i % 8));
+	return is_valid;
+}
+
+// Take value under path from each document
+int jsonget_batch(const char *const *docs, int count, const JsonGetPath *path, JsonGetBatchColumns *out)
+{
+	int first, i, s, valid_count = 0;
+	if (out->valid) for (i = 0; i < (count + 7) / 8; i++) out->valid[i] = 0;
+	for (first = 0; first < count; first += PJSONGET_BATCH_GROUP)
+	{
+		JsonGetCursor cursor[PJSONGET_BATCH_GROUP];
+		int n = count - first < PJSONGET_BATCH_GROUP ? count - first : PJSONGET_BATCH_GROUP;
+		for (i = 0; i < n; i++)
+		{
+			if (docs[first + i]) cursor[i] = jsonget(docs[first + i]);
+			else cursor[i].type = JSONGET_INVALID;
+			if (first + PJSONGET_BATCH_GROUP + i < count && docs[first + PJSONGET_BATCH_GROUP + i])
+			{
+				PJSONGET_PREFETCH(docs[first + PJSONGET_BATCH_GROUP + i]);
+			}
+		}
+		// Step is taken in all documents of group before the next one
+		for (s = 0; s < path->length; s++)
+		{
+			const JsonGetStreamStep *step = &path->step[s];
+			for (i = 0; i < n; i++)
+			{
+				if (cursor[i].type == JSONGET_INVALID) continue;
+				cursor[i] = step->key ? jsonget_move_nkey(cursor[i], step->key, step->key_length)
+					: jsonget_move_index(cursor[i], step->index);
+			}
+		}
+		for (i = 0; i < n; i++) valid_count += pjsonget_batch_store(out, first + i, cursor[i]);
+	}
+	return valid_count;
+}
+
 /*
 ** ------------------------------------------
 ** Read values from cursor
@@ -586,6 +1219,34 @@ int jsonget_raw_copy(const JsonGetCursor cursor, char *dest_buffer, int buffer_s
 	return ok;
 }
 
+// Copy raw representation of cursor value without whitespace outside of strings
+int jsonget_minify(const JsonGetCursor cursor, char *dest_buffer, int buffer_size, int *out_real_length)
+{
+	const char *p, *end;
+	int length = 0;
+	if (!jsonget_raw(cursor, &p, &length)) return 0;
+	end = p + length;
+	length = 0;
+	while (p < end)
+	{
+		// Copy run of characters up to next whitespace or string at once
+		const char *run = p;
+		while (p < end && *p != '"' && !JSONGET_IS_WHITESPACE(*p)) p++;
+		if (p < end && *p == '"')
+		{
+			p++;
+			JSONGET_SKIP_STRING_CONTENT(p, '"', '\\');
+			if (*p == '"') p++;
+		}
+		if (buffer_size - 1 - length > 0) pjsonget_copy_str(run, p - run, dest_buffer + length, buffer_size - length);
+		length += p - run;
+		while (p < end && JSONGET_IS_WHITESPACE(*p)) p++;
+	}
+	if (buffer_size > 0 && length < buffer_size) dest_buffer[length] = 0;
+	*out_real_length = length;
+	return 1;
+}
+
 // Function to get string from cursor
 int jsonget_string(const JsonGetCursor cursor, char *dest_buffer, int buffer_size, int *out_real_length)
 {
@@ -664,3 +1325,10 @@ int jsonget_string_compare(const JsonGetCursor cursor, const char *str2)
 	const char *unused;
 	return pjsonget_string_compare(cursor, str2, &unused);
 }
+
+// Compare string representation of cursor value with first _length_ bytes of _str2_
+int jsonget_string_ncompare(const JsonGetCursor cursor, const char *str2, int length)
+{
+	const char *unused;
+	return pjsonget_string_ncompare(cursor, str2, length, &unused);
+}
\ No newline at end of file
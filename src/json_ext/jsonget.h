@@ -102,6 +102,92 @@ typedef struct
 	int type;		// type of json value
 } JsonGetCursor;
 
+// State of recursive key search
+//
+typedef struct
+{
+	const char* pstr;		// current position of search, NULL when search is finished
+	int depth;		// nesting depth of current position inside searched value
+} JsonGetSearch;
+
+// Limits of stream parser
+#define JSONGET_STREAM_MAX_PATH   16	// max number of path steps
+#define JSONGET_STREAM_MAX_DEPTH  256	// max nesting depth of json
+
+// Path step of stream parser matching every element of array
+#define JSONGET_STREAM_ANY_INDEX  -1
+
+// Results of stream parser
+#define JSONGET_STREAM_MORE   0	// chunk is parsed, feed the next one
+#define JSONGET_STREAM_MATCH  1	// value under path is complete
+#define JSONGET_STREAM_END    2	// input is complete json
+#define JSONGET_STREAM_ERROR  3	// input is not valid json
+
+// Path step of stream parser
+//
+typedef struct
+{
+	const char *key;		// key of object field, NULL for array element
+	int key_length;		// length of key in bytes
+	int index;		// index of array element or JSONGET_STREAM_ANY_INDEX
+} JsonGetStreamStep;
+
+// State of stream parser, see jsonget_stream_init
+//
+typedef struct
+{
+	const JsonGetStreamStep *path;		// path of values to match
+	int path_length;		// number of path steps
+	char *value_buffer;		// buffer receiving matched value
+	int buffer_size;		// size of value_buffer
+	int value_type;		// type of matched value
+	int value_length;		// real length of matched value, may be greater than buffer_size - 1
+	int root_index;		// index of root value containing match (line of NDJSON), starting from 0
+
+	// Parser state, kept between chunks
+	int state;		// lexer state
+	int depth;		// number of open objects and arrays
+	int match_depth;		// number of open objects and arrays whose current element is on path
+	int capture_depth;		// depth of value being copied to value_buffer, -1 if none
+	int key_pos;		// number of key bytes equal to path key, -1 on mismatch
+	const char *word;		// true, false or null being parsed
+	int word_pos;		// position in word
+	int number_part;		// part of number being parsed
+	int hex_left;		// hex digits left in \u escape
+	int index[JSONGET_STREAM_MAX_PATH];		// index of current element of arrays on path
+	unsigned char is_object[JSONGET_STREAM_MAX_DEPTH / 8];		// bit set per depth of open objects
+} JsonGetStream;
+
+// 64-bit integer of batch extraction
+#if defined(_MSC_VER) || defined(__BORLANDC__)
+typedef __int64 jsonget_int64;
+typedef unsigned __int64 jsonget_uint64;
+#else
+typedef long long int jsonget_int64;
+typedef unsigned long long int jsonget_uint64;
+#endif
+
+// Compiled path of batch extraction, see jsonget_path_compile
+//
+typedef struct
+{
+	JsonGetStreamStep step[JSONGET_STREAM_MAX_PATH];		// keys and indexes, negative index counts from the end
+	int length;		// number of steps
+} JsonGetPath;
+
+// Output columns of batch extraction, see jsonget_batch
+// Every array has an element per document and may be NULL if it is not needed
+//
+typedef struct
+{
+	int *type;		// type of value, JSONGET_INVALID if value is missing
+	jsonget_int64 *as_int;		// INTEGER, BOOLEAN and truncated DOUBLE value, otherwise 0
+	double *as_double;		// INTEGER, BOOLEAN and DOUBLE value, otherwise 0
+	const char **slice;		// raw value in document, STRING without quotes, NULL if value is missing
+	int *slice_length;		// length of slice
+	unsigned char *valid;		// bitmap, bit (i % 8) of byte (i / 8) is set if value i exists and is not null
+} JsonGetBatchColumns;
+
 /*
 ** ------------------------------------------
 ** Init cursor
@@ -120,7 +206,12 @@ extern JsonGetCursor jsonget(const char *json_str);
 // Move to _key_ field of current json object
 extern JsonGetCursor jsonget_move_key(const JsonGetCursor cursor, const char *key);
 
+// Move to field of current json object with key of _length_ bytes
+// Unlike jsonget_move_key, _key_ need not be NULL-terminated
+extern JsonGetCursor jsonget_move_nkey(const JsonGetCursor cursor, const char *key, const int length);
+
 // Move to _index_ index of current json array or _index_ pair in json object
+// Negative _index_ counts from the end: -1 is the last element
 extern JsonGetCursor jsonget_move_index(const JsonGetCursor cursor, const int index);
 
 // Move to next element in array
@@ -130,6 +221,101 @@ extern JsonGetCursor jsonget_move_next(const JsonGetCursor cursor);
 // Move to pair value 
 extern JsonGetCursor jsonget_move_pair_value(const JsonGetCursor cursor);
 
+/*
+** ------------------------------------------
+** Recursive search
+** ------------------------------------------
+*/
+
+// Start search of keys at any depth inside current json object or array
+extern JsonGetSearch jsonget_search(const JsonGetCursor cursor);
+
+// Move to value of next field with _key_ of _length_ bytes at any depth
+// Fields are found in document order, including fields inside previously found values.
+// Each part of json is scanned only once, so finding all fields takes one pass
+// Return INVALID cursor when there are no more fields
+extern JsonGetCursor jsonget_search_next_nkey(JsonGetSearch *search, const char *key, const int length);
+
+/*
+** ------------------------------------------
+** Stream parsing
+** ------------------------------------------
+** Stream parser takes json in chunks of any size, so document need not be
+** in memory as one buffer. Values under path are copied to value_buffer as
+** soon as they are complete. Memory use is constant: parser keeps no input.
+** Input may be a sequence of json values (NDJSON), path is matched in each.
+**
+**    JsonGetStreamStep path[2] = {{"items", 5, 0}, {0, 0, JSONGET_STREAM_ANY_INDEX}};
+**    JsonGetStream stream;
+**    char value[255];
+**    int consumed, rc, len;
+**
+**    jsonget_stream_init(&stream, path, 2, value, sizeof(value));
+**    while ((len = read_chunk(chunk)) > 0)
+**    {
+**      const char *p = chunk;
+**      while ((rc = jsonget_stream_feed(&stream, p, len, &consumed)) == JSONGET_STREAM_MATCH)
+**      {
+**        // value holds element of "items" array
+**        p += consumed;
+**        len -= consumed;
+**      }
+**      if (rc == JSONGET_STREAM_ERROR) break;
+**    }
+**    while ((rc = jsonget_stream_end(&stream)) == JSONGET_STREAM_MATCH) ... // number at the end of input
+*/
+
+// Init stream parser to match path of _path_length_ steps and copy matched values to _value_buffer_
+// Keys of path are compared with raw keys of json, escape sequences are not decoded
+// Path of 0 steps matches every root value
+extern void jsonget_stream_init(JsonGetStream *stream, const JsonGetStreamStep *path, int path_length,
+	char *value_buffer, int buffer_size);
+
+// Parse _length_ bytes of _chunk_
+// Return JSONGET_STREAM_MATCH when value under path is complete: value is in value_buffer
+// (NULL-terminated and truncated to buffer_size), its type in value_type and real length in
+// value_length. Then feed the rest of chunk after _out_consumed_ bytes.
+// Return JSONGET_STREAM_MORE when the whole chunk is parsed, JSONGET_STREAM_ERROR on invalid json
+extern int jsonget_stream_feed(JsonGetStream *stream, const char *chunk, int length, int *out_consumed);
+
+// Finish input: number at the end of input is complete only here
+// Return JSONGET_STREAM_MATCH if it completes value under path (call again then),
+// JSONGET_STREAM_END if input is complete json, otherwise JSONGET_STREAM_ERROR
+extern int jsonget_stream_end(JsonGetStream *stream);
+
+/*
+** ------------------------------------------
+** Batch extraction
+** ------------------------------------------
+** Batch extraction takes value under one path from many documents and
+** writes typed columns. Path is parsed once, documents are walked in groups:
+** each path step is taken in every document of group before the next step,
+** so memory loads of different documents overlap.
+**
+**    JsonGetPath path;
+**    jsonget_int64 ids[1000];
+**    unsigned char valid[1000 / 8 + 1];
+**    JsonGetBatchColumns out = {0};
+**
+**    jsonget_path_compile(&path, "user.id", -1);
+**    out.as_int = ids;
+**    out.valid = valid;
+**    jsonget_batch(docs, 1000, &path, &out);
+*/
+
+// Compile path of _length_ bytes (-1 if NULL-terminated): keys and indexes separated by '.',
+// e.g. "items.0.price". Keys point into _path_str_, so it must outlive compiled path
+// Step of up to 9 digits, optionally preceded by '-', is always index: keys like "2024"
+// and keys containing '.' can't be reached, walk to them with jsonget_move_nkey instead.
+// "-0" and longer digit steps are keys
+// Return 0 if path is empty, has empty step or more than JSONGET_STREAM_MAX_PATH steps
+extern int jsonget_path_compile(JsonGetPath *path, const char *path_str, int length);
+
+// Take value under _path_ from each of _count_ NULL-terminated documents (NULL document has no value)
+// and write it to columns of _out_. STRING slice keeps escape sequences
+// Return number of documents with non-null value
+extern int jsonget_batch(const char *const *docs, int count, const JsonGetPath *path, JsonGetBatchColumns *out);
+
 /*
 ** ------------------------------------------
 ** Read values from cursor
@@ -171,6 +357,13 @@ extern int jsonget_raw(const JsonGetCursor cursor, const char **out_string_start
 // Return 0 if cursor type is INVALID
 extern int jsonget_raw_copy(const JsonGetCursor cursor, char *dest_buffer, int buffer_size, int *out_real_length);
 
+// Copy raw representation of cursor value to buffer dest without whitespace outside of strings
+// Strings are copied as is, escape sequences are not decoded. Result is truncated to buffer_size,
+// real length is never greater than length of raw representation.
+// ! This function does not allocate any memory.
+// Return 0 if cursor type is INVALID
+extern int jsonget_minify(const JsonGetCursor cursor, char *dest_buffer, int buffer_size, int *out_real_length);
+
 // Function to get string from cursor
 // Unlike jsonget_raw this function also unescape string
 // If cursor type is not STRING, result is equivalent to jsonget_raw_copy
@@ -202,6 +395,13 @@ extern int jsonget_array_count(const JsonGetCursor cursor);
 // Return 0 if strings are equal
 extern int jsonget_string_compare(const JsonGetCursor cursor, const char *str2);
 
+// Compare string representation of cursor value with first _length_ bytes of _str2_
+// STRING value is compared unescaped, other values are compared by raw representation
+// Bytes are compared as unsigned chars (like memcmp), _str2_ need not be NULL-terminated
+// ! This function does not allocate any memory.
+// Return 0 if strings are equal, negative if cursor value is less, positive if greater
+extern int jsonget_string_ncompare(const JsonGetCursor cursor, const char *str2, int length);
+
 
 #ifdef __cplusplus
 }
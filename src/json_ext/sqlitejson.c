@@ -15,6 +15,8 @@
 #if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_JSON)
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifndef SQLITE_CORE
   #include "sqlite3ext.h"
@@ -24,6 +26,19 @@
 #endif
 
 #include "jsonget.h"
+#include "sqlitejson.h"
+
+/* Worker threads of sqlite3_json_bulk_load, documents are processed inline without them */
+#if !defined(SQLITE_THREADSAFE) || SQLITE_THREADSAFE
+  #define SQLITEJSON_THREADS 1
+  #ifdef _WIN32
+    #include <windows.h>
+  #else
+    #include <pthread.h>
+  #endif
+#else
+  #define SQLITEJSON_THREADS 0
+#endif
 
 static void sqlitejsonDestructor(void *p)
 {
@@ -33,6 +48,813 @@ static void sqlitejsonDestructor(void *p)
 
 #define SQLITEJSON_STATIC_STRING_BUFFER_SIZE 512
 
+/* Largest allocation accepted by sqlite3_malloc() */
+#define SQLITEJSON_MAX_ALLOC 0x7ffffeff
+
+/*
+** Growable output buffer. Small output is kept in zSpace on the stack,
+** larger output grows in memory from sqlite3_malloc and is handed off
+** to SQLite without copy
+*/
+typedef struct SqlitejsonBuf SqlitejsonBuf;
+struct SqlitejsonBuf {
+  char *z;                 /* Buffer content */
+  int n;                   /* Number of bytes used */
+  int nAlloc;              /* Number of bytes allocated */
+  int bOom;                /* True if out of memory */
+  char zSpace[SQLITEJSON_STATIC_STRING_BUFFER_SIZE];
+};
+
+static void sqlitejsonBufInit(SqlitejsonBuf *p){
+  p->z = p->zSpace;
+  p->n = 0;
+  p->nAlloc = sizeof(p->zSpace);
+  p->bOom = 0;
+}
+
+static void sqlitejsonBufReset(SqlitejsonBuf *p){
+  if (p->z != p->zSpace) sqlite3_free(p->z);
+  sqlitejsonBufInit(p);
+}
+
+/* Make room for nNeed more bytes. Return 0 if out of memory */
+static int sqlitejsonBufGrow(SqlitejsonBuf *p, int nNeed){
+  char *zNew = 0;
+  sqlite3_int64 nNew;
+  if (p->bOom) return 0;
+  if ((sqlite3_int64)p->n + nNeed <= p->nAlloc) return 1;
+  // Size is computed in 64 bits, doubling of buffer over 1 GB overflows int
+  nNew = (sqlite3_int64)p->nAlloc * 2 + nNeed;
+  if (nNew > SQLITEJSON_MAX_ALLOC) nNew = SQLITEJSON_MAX_ALLOC;
+  if (nNeed < 0 || (sqlite3_int64)p->n + nNeed > nNew)
+  {
+    // Too large, buffer is freed as if out of memory
+  }
+  else if (p->z == p->zSpace)
+  {
+    zNew = sqlite3_malloc((int)nNew);
+    if (zNew) memcpy(zNew, p->z, p->n);
+  }
+  else zNew = sqlite3_realloc(p->z, (int)nNew);
+  if (!zNew)
+  {
+    sqlitejsonBufReset(p);
+    p->bOom = 1;
+    return 0;
+  }
+  p->z = zNew;
+  p->nAlloc = (int)nNew;
+  return 1;
+}
+
+static void sqlitejsonBufAppend(SqlitejsonBuf *p, const char *z, int n){
+  if (n > 0 && sqlitejsonBufGrow(p, n))
+  {
+    memcpy(p->z + p->n, z, n);
+    p->n += n;
+  }
+}
+
+static void sqlitejsonBufAppendChar(SqlitejsonBuf *p, char c){
+  if (sqlitejsonBufGrow(p, 1)) p->z[p->n++] = c;
+}
+
+/* Append string from sqlite3_mprintf() and free it, NULL is out of memory */
+static void sqlitejsonBufAppendFree(SqlitejsonBuf *p, char *z){
+  if (!z)
+  {
+    p->bOom = 1;
+    return;
+  }
+  sqlitejsonBufAppend(p, z, (int)strlen(z));
+  sqlite3_free(z);
+}
+
+/* Append raw json representation of cursor value */
+static void sqlitejsonBufAppendRaw(SqlitejsonBuf *p, JsonGetCursor json_obj){
+  const char *raw;
+  int len;
+  if (jsonget_raw(json_obj, &raw, &len)) sqlitejsonBufAppend(p, raw, len);
+}
+
+/*
+** Reserve exactly nTotal bytes for buffer content, so appending up to
+** nTotal bytes never reallocates. Return 0 if out of memory
+*/
+static int sqlitejsonBufReserve(SqlitejsonBuf *p, int nTotal){
+  char *zNew;
+  if (p->bOom) return 0;
+  if (nTotal <= p->nAlloc) return 1;
+  zNew = sqlite3_malloc(nTotal);
+  if (!zNew)
+  {
+    sqlitejsonBufReset(p);
+    p->bOom = 1;
+    return 0;
+  }
+  memcpy(zNew, p->z, p->n);
+  if (p->z != p->zSpace) sqlite3_free(p->z);
+  p->z = zNew;
+  p->nAlloc = nTotal;
+  return 1;
+}
+
+/*
+** Number of bytes each input byte takes in json string: 1 for plain bytes,
+** 2 for short escapes, 6 for \u00XX escapes of other control characters
+*/
+static const unsigned char sqlitejsonEscapeLen[256] = {
+  6,6,6,6,6,6,6,6,2,2,2,6,2,2,6,6, 6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
+  1,1,2,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,2,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+};
+
+/* Length of text z of n bytes written as json string with quotes */
+static int sqlitejsonStringLength(const char *z, int n){
+  const unsigned char *zu = (const unsigned char*)z;
+  int len = n + 2, i;
+  for (i = 0; i < n; i++) len += sqlitejsonEscapeLen[zu[i]] - 1;
+  return len;
+}
+
+/*
+** Append text z of n bytes as quoted and escaped json string
+** Runs of bytes which need no escaping are copied with one memcpy
+*/
+static void sqlitejsonBufAppendString(SqlitejsonBuf *p, const char *z, int n){
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *zu = (const unsigned char*)z;
+  int i = 0;
+  if (!sqlitejsonBufGrow(p, sqlitejsonStringLength(z, n))) return;
+  p->z[p->n++] = '"';
+  while (i < n)
+  {
+    int start = i;
+    unsigned char c;
+    while (i < n && sqlitejsonEscapeLen[zu[i]] == 1) i++;
+    memcpy(p->z + p->n, z + start, i - start);
+    p->n += i - start;
+    if (i == n) break;
+    c = zu[i++];
+    p->z[p->n++] = '\\';
+    switch (c)
+    {
+      case '"': p->z[p->n++] = '"'; break;
+      case '\\': p->z[p->n++] = '\\'; break;
+      case '\b': p->z[p->n++] = 'b'; break;
+      case '\f': p->z[p->n++] = 'f'; break;
+      case '\n': p->z[p->n++] = 'n'; break;
+      case '\r': p->z[p->n++] = 'r'; break;
+      case '\t': p->z[p->n++] = 't'; break;
+      default:
+        memcpy(p->z + p->n, "u00", 3);
+        p->z[p->n + 3] = hex[c >> 4];
+        p->z[p->n + 4] = hex[c & 0x0f];
+        p->n += 5;
+        break;
+    }
+  }
+  p->z[p->n++] = '"';
+}
+
+/*
+** Encoded json is a blob made by json_encode(): minified json text with
+** navigation index, so path lookup jumps to values without parsing json.
+** All integers are 4-byte big-endian:
+**
+**   magic (4 bytes) | text length | root ref | key count | json text | 0x00 |
+**   key table | index
+**
+** Key table lists distinct object keys of document sorted by hash:
+**
+**   key hash | text offset of first occurrence of key
+**
+** Index is a sequence of nodes, one per object or array:
+**
+**   text offset | element count | elements
+**
+** Array element is a ref, object element is key id (position in key table)
+** and ref. Ref with SQLITEJSON_REF_NODE bit set is offset of child node
+** from start of index, otherwise it is text offset of scalar value.
+** Version byte follows magic, blob of other version is not encoded json.
+** Magic starts with 0x00, so encoded json is never mistaken for json text
+*/
+#define SQLITEJSON_ENCODED_MAGIC    "\000JI"
+#define SQLITEJSON_ENCODED_VERSION  2
+#define SQLITEJSON_ENCODED_HEADER   16
+#define SQLITEJSON_REF_NODE         0x80000000u
+
+/*
+** Json document taken from SQL value: plain json text or encoded json
+*/
+typedef struct SqlitejsonDoc SqlitejsonDoc;
+struct SqlitejsonDoc {
+  const char *zJson;            /* Json text, zero terminated */
+  int nJson;                    /* Length of json text in bytes */
+  const unsigned char *aIndex;  /* Navigation index of encoded json, or NULL */
+  unsigned nIndex;              /* Size of navigation index in bytes */
+  unsigned iRoot;               /* Ref of root value in index */
+  const unsigned char *aKeys;   /* Key table of encoded json */
+  unsigned nKeys;               /* Number of keys in key table */
+  int bCompressed;              /* Set if value is compressed json */
+};
+
+static unsigned sqlitejsonGet4(const unsigned char *p){
+  return ((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) | ((unsigned)p[2] << 8) | p[3];
+}
+
+static void sqlitejsonPut4(unsigned char *p, unsigned v){
+  p[0] = (unsigned char)(v >> 24);
+  p[1] = (unsigned char)(v >> 16);
+  p[2] = (unsigned char)(v >> 8);
+  p[3] = (unsigned char)v;
+}
+
+/* FNV-1a hash of n bytes */
+static unsigned sqlitejsonHashBytes(const char *z, int n){
+  unsigned h = 2166136261u;
+  while (n-- > 0)
+  {
+    h ^= (unsigned char)*z++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/*
+** Compressed json is a blob made by json_compress(): json text or encoded
+** json compressed with LZ77 block codec below:
+**
+**   magic (4 bytes) | uncompressed size | compressed data
+**
+** Compressed data is a sequence of blocks, each one is literals followed by
+** a match (copy of earlier output). Block starts with token byte: high 4
+** bits are literal length, low 4 bits are match length - 4. Value 15 means
+** that more length bytes follow, each adds 0..255, byte 255 continues.
+** Then literals, 2-byte little-endian match offset and match length bytes.
+** Last block has literals only. Codec needs no external library
+*/
+#define SQLITEJSON_COMPRESSED_MAGIC     "\000JZ\001"
+#define SQLITEJSON_COMPRESSED_HEADER    8
+#define SQLITEJSON_COMPRESS_MIN_SIZE    512    /* Smaller values are not compressed by default */
+#define SQLITEJSON_LZ_MIN_MATCH         4
+#define SQLITEJSON_LZ_HASH_BITS         12
+#define SQLITEJSON_LZ_MAX_OFFSET        65535
+
+/* Write length continuation bytes of token field value n >= 15 */
+static unsigned char *sqlitejsonLzPutLength(unsigned char *op, const unsigned char *oend, int n){
+  n -= 15;
+  while (op && n >= 255)
+  {
+    if (op >= oend) return 0;
+    *op++ = 255;
+    n -= 255;
+  }
+  if (!op || op >= oend) return 0;
+  *op++ = (unsigned char)n;
+  return op;
+}
+
+/* Write block of literals and match. Match length 0 marks last block */
+static unsigned char *sqlitejsonLzPutBlock(
+  unsigned char *op,
+  const unsigned char *oend,
+  const unsigned char *lit,
+  int nLit,
+  int offset,
+  int nMatch
+){
+  int match_code = nMatch ? nMatch - SQLITEJSON_LZ_MIN_MATCH : 0;
+  if (op >= oend) return 0;
+  *op++ = (unsigned char)(((nLit < 15 ? nLit : 15) << 4) | (match_code < 15 ? match_code : 15));
+  if (nLit >= 15) op = sqlitejsonLzPutLength(op, oend, nLit);
+  if (!op || oend - op < nLit) return 0;
+  memcpy(op, lit, nLit);
+  op += nLit;
+  if (!nMatch) return op;
+  if (oend - op < 2) return 0;
+  *op++ = (unsigned char)(offset & 0xff);
+  *op++ = (unsigned char)(offset >> 8);
+  if (match_code >= 15) op = sqlitejsonLzPutLength(op, oend, match_code);
+  return op;
+}
+
+/*
+** Compress n bytes of src into dst of nDst bytes.
+** Matches are found with hash table of 4-byte sequences.
+** Return compressed size or 0 if it doesn't fit into dst
+*/
+static int sqlitejsonLzCompress(const unsigned char *src, int n, unsigned char *dst, int nDst){
+  int aHash[1 << SQLITEJSON_LZ_HASH_BITS];
+  const unsigned char *oend = dst + nDst;
+  unsigned char *op = dst;
+  int ip = 0, anchor = 0;
+  memset(aHash, 0xff, sizeof(aHash));
+  while (ip + SQLITEJSON_LZ_MIN_MATCH <= n)
+  {
+    unsigned seq;
+    int h, ref;
+    memcpy(&seq, src + ip, 4);
+    h = (int)((seq * 2654435761u) >> (32 - SQLITEJSON_LZ_HASH_BITS));
+    ref = aHash[h];
+    aHash[h] = ip;
+    if (ref >= 0 && ip - ref <= SQLITEJSON_LZ_MAX_OFFSET && memcmp(src + ref, src + ip, 4) == 0)
+    {
+      int len = SQLITEJSON_LZ_MIN_MATCH;
+      while (ip + len < n && src[ref + len] == src[ip + len]) len++;
+      op = sqlitejsonLzPutBlock(op, oend, src + anchor, ip - anchor, ip - ref, len);
+      if (!op) return 0;
+      ip += len;
+      anchor = ip;
+    }
+    else ip++;
+  }
+  op = sqlitejsonLzPutBlock(op, oend, src + anchor, n - anchor, 0, 0);
+  return op ? (int)(op - dst) : 0;
+}
+
+/* Read length continuation bytes of token field. Return -1 on malformed input */
+static int sqlitejsonLzGetLength(const unsigned char **pip, const unsigned char *iend, int n){
+  const unsigned char *ip = *pip;
+  unsigned char b;
+  do
+  {
+    if (ip >= iend || n > 0x3fffffff) return -1;
+    b = *ip++;
+    n += b;
+  } while (b == 255);
+  *pip = ip;
+  return n;
+}
+
+/*
+** Decompress n bytes of src into dst of exactly nDst bytes.
+** Every length and offset is checked against buffers, so malformed input
+** is rejected instead of read or written out of bounds.
+** Return 1 if output has exactly nDst bytes
+*/
+static int sqlitejsonLzDecompress(const unsigned char *src, int n, unsigned char *dst, int nDst){
+  const unsigned char *ip = src, *iend = src + n;
+  unsigned char *op = dst, *oend = dst + nDst;
+  while (ip < iend)
+  {
+    int token = *ip++;
+    int nLit = token >> 4, nMatch = token & 15, offset;
+    if (nLit == 15 && (nLit = sqlitejsonLzGetLength(&ip, iend, nLit)) < 0) return 0;
+    if (iend - ip < nLit || oend - op < nLit) return 0;
+    memcpy(op, ip, nLit);
+    ip += nLit;
+    op += nLit;
+    if (ip == iend) break; // last block
+    if (iend - ip < 2) return 0;
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (nMatch == 15 && (nMatch = sqlitejsonLzGetLength(&ip, iend, nMatch)) < 0) return 0;
+    nMatch += SQLITEJSON_LZ_MIN_MATCH;
+    if (offset == 0 || offset > op - dst || oend - op < nMatch) return 0;
+    // Match may overlap output being written, so it is copied byte by byte
+    while (nMatch--)
+    {
+      *op = op[-offset];
+      op++;
+    }
+  }
+  return op == oend;
+}
+
+/*
+** Per connection state shared by all functions of extension: cache of
+** recently decompressed values. Several "->" expressions on one row read
+** the same compressed column, with cache it is decompressed only once.
+** Entries are looked up by cheap hash of compressed value and its size,
+** full value is compared only when both match.
+** Entries used by the current function call are pinned and never replaced
+** during the call. When all entries are pinned, value is decompressed into
+** spare buffer, which is freed when the call returns.
+** Entry belongs to statement which was running when it was filled and is
+** freed by the first call after that statement is reset or finalized
+*/
+#define SQLITEJSON_CACHE_SIZE 4
+
+/* Bytes of compressed value hashed from each of its ends for cache key */
+#define SQLITEJSON_CACHE_HASH_BYTES 32
+
+typedef struct SqlitejsonCacheEntry SqlitejsonCacheEntry;
+struct SqlitejsonCacheEntry {
+  unsigned char *aKey;     /* Copy of compressed value */
+  int nKey;                /* Size of compressed value */
+  unsigned hash;           /* sqlitejsonCacheHash() of compressed value */
+  char *zData;             /* Decompressed value, zero terminated */
+  int nData;               /* Size of decompressed value */
+  int bPinned;             /* Set if used by the current call */
+  sqlite3_stmt *pStmt;     /* Statement which filled entry */
+  unsigned hSql;           /* sqlitejsonStmtHash() of pStmt */
+};
+
+typedef struct SqlitejsonSpare SqlitejsonSpare;
+struct SqlitejsonSpare {
+  SqlitejsonSpare *pNext;  /* Next spare buffer of the current call */
+  /* Decompressed value follows */
+};
+
+typedef struct SqlitejsonConn SqlitejsonConn;
+struct SqlitejsonConn {
+  SqlitejsonCacheEntry aCache[SQLITEJSON_CACHE_SIZE];
+  SqlitejsonSpare *pSpare; /* Values decompressed outside of cache */
+  int nUsed;               /* Number of filled cache entries */
+  int iNext;               /* Cache entry replaced by next miss */
+  int nRef;                /* Number of functions registered with this state */
+};
+
+/*
+** User data of every function: connection state, implementation and
+** function specific argument (operator, mode, type), read with
+** sqlitejsonFuncArg()
+*/
+typedef struct SqlitejsonFunc SqlitejsonFunc;
+struct SqlitejsonFunc {
+  SqlitejsonConn *pConn;
+  void (*xFunc)(sqlite3_context*,int,sqlite3_value**);
+  void *pArg;
+};
+
+static void *sqlitejsonFuncArg(sqlite3_context *context){
+  return ((SqlitejsonFunc*)sqlite3_user_data(context))->pArg;
+}
+
+static void sqlitejsonCacheClear(SqlitejsonCacheEntry *pEntry){
+  sqlite3_free(pEntry->aKey);
+  sqlite3_free(pEntry->zData);
+  memset(pEntry, 0, sizeof(*pEntry));
+}
+
+/*
+** Hash of SQL text of statement. Statement prepared after another one was
+** finalized may get its address, hash tells them apart
+*/
+static unsigned sqlitejsonStmtHash(sqlite3_stmt *pStmt){
+  const char *zSql = pStmt ? sqlite3_sql(pStmt) : 0;
+  return zSql ? sqlitejsonHashBytes(zSql, (int)strlen(zSql)) : 0;
+}
+
+/*
+** Free cache entries of statements which are not running any more.
+** Statement pointer is compared with statements of connection before it
+** is used, so finalized statement is never touched
+*/
+static void sqlitejsonCacheExpire(SqlitejsonConn *pConn, sqlite3 *db){
+  int abLive[SQLITEJSON_CACHE_SIZE];
+  sqlite3_stmt *pStmt;
+  int i;
+  memset(abLive, 0, sizeof(abLive));
+  for (pStmt = sqlite3_next_stmt(db, 0); pStmt; pStmt = sqlite3_next_stmt(db, pStmt))
+  {
+    unsigned hSql = 0;
+    int bHashed = 0;
+    if (!sqlite3_stmt_busy(pStmt)) continue;
+    for (i = 0; i < SQLITEJSON_CACHE_SIZE; i++)
+    {
+      if (pConn->aCache[i].pStmt != pStmt) continue;
+      if (!bHashed) hSql = sqlitejsonStmtHash(pStmt), bHashed = 1;
+      if (pConn->aCache[i].hSql == hSql) abLive[i] = 1;
+    }
+  }
+  for (i = 0; i < SQLITEJSON_CACHE_SIZE; i++)
+  {
+    if (pConn->aCache[i].aKey && !abLive[i])
+    {
+      sqlitejsonCacheClear(&pConn->aCache[i]);
+      pConn->nUsed--;
+    }
+  }
+}
+
+/*
+** Implementation registered for every function: expire cache entries of
+** finished statements, call implementation from user data, then unpin
+** cache entries and free spare buffers used by the call. Results are
+** always copied, so nothing refers to them afterwards
+*/
+static void sqlitejsonCall(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonFunc *p = (SqlitejsonFunc*)sqlite3_user_data(context);
+  SqlitejsonConn *pConn = p->pConn;
+  int i;
+  if (pConn->nUsed) sqlitejsonCacheExpire(pConn, sqlite3_context_db_handle(context));
+  p->xFunc(context, argc, argv);
+  for (i = 0; i < SQLITEJSON_CACHE_SIZE; i++) pConn->aCache[i].bPinned = 0;
+  while (pConn->pSpare)
+  {
+    SqlitejsonSpare *pNext = pConn->pSpare->pNext;
+    sqlite3_free(pConn->pSpare);
+    pConn->pSpare = pNext;
+  }
+}
+
+/*
+** Cache key of compressed value: hash of its size and at most
+** SQLITEJSON_CACHE_HASH_BYTES bytes from each end. Header holds size of
+** decompressed value, so equal keys of different values are rare
+*/
+static unsigned sqlitejsonCacheHash(const unsigned char *a, int n){
+  int nPart = n < 2 * SQLITEJSON_CACHE_HASH_BYTES ? n : SQLITEJSON_CACHE_HASH_BYTES;
+  unsigned hash = sqlitejsonHashBytes((const char*)a, nPart) ^ (unsigned)n;
+  if (nPart < n) hash = hash * 31 + sqlitejsonHashBytes((const char*)a + n - nPart, nPart);
+  return hash;
+}
+
+/*
+** Running statement of connection, the most recently prepared one if there
+** are several
+*/
+static sqlite3_stmt *sqlitejsonRunningStmt(sqlite3 *db){
+  sqlite3_stmt *pStmt;
+  for (pStmt = sqlite3_next_stmt(db, 0); pStmt && !sqlite3_stmt_busy(pStmt); pStmt = sqlite3_next_stmt(db, pStmt));
+  return pStmt;
+}
+
+/*
+** Return decompressed value of compressed json blob a of n bytes from cache
+** of connection, decompress it on miss. Returned data is valid until the
+** current function call returns.
+** Return NULL if value is malformed or out of memory, *pbOom is set and
+** error is set on context if out of memory
+*/
+static const char *sqlitejsonDecompress(
+  sqlite3_context *context,
+  const unsigned char *a,
+  int n,
+  int *pnData,
+  int *pbOom
+){
+  SqlitejsonConn *pConn = ((SqlitejsonFunc*)sqlite3_user_data(context))->pConn;
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  SqlitejsonCacheEntry *pEntry;
+  unsigned size, hash = sqlitejsonCacheHash(a, n);
+  int i;
+  for (i = 0; i < SQLITEJSON_CACHE_SIZE; i++)
+  {
+    pEntry = &pConn->aCache[i];
+    if (pEntry->aKey && pEntry->hash == hash && pEntry->nKey == n && memcmp(pEntry->aKey, a, n) == 0)
+    {
+      pEntry->bPinned = 1;
+      *pnData = pEntry->nData;
+      return pEntry->zData;
+    }
+  }
+
+  size = sqlitejsonGet4(a + 4);
+  if (size >= (unsigned)sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1)) return 0;
+  for (i = 0; i < SQLITEJSON_CACHE_SIZE && pConn->aCache[pConn->iNext].bPinned; i++)
+  {
+    pConn->iNext = (pConn->iNext + 1) % SQLITEJSON_CACHE_SIZE;
+  }
+  if (i == SQLITEJSON_CACHE_SIZE)
+  {
+    // Every entry is used by this call
+    SqlitejsonSpare *pSpare = sqlite3_malloc(sizeof(SqlitejsonSpare) + (int)size + 1);
+    char *zData;
+    if (!pSpare)
+    {
+      sqlite3_result_error_nomem(context);
+      *pbOom = 1;
+      return 0;
+    }
+    zData = (char*)&pSpare[1];
+    if (!sqlitejsonLzDecompress(a + SQLITEJSON_COMPRESSED_HEADER, n - SQLITEJSON_COMPRESSED_HEADER,
+                                (unsigned char*)zData, (int)size))
+    {
+      sqlite3_free(pSpare);
+      return 0;
+    }
+    zData[size] = 0;
+    pSpare->pNext = pConn->pSpare;
+    pConn->pSpare = pSpare;
+    *pnData = (int)size;
+    return zData;
+  }
+  pEntry = &pConn->aCache[pConn->iNext];
+  if (pEntry->aKey) pConn->nUsed--;
+  sqlitejsonCacheClear(pEntry);
+  pEntry->aKey = sqlite3_malloc(n);
+  pEntry->zData = sqlite3_malloc((int)size + 1);
+  if (!pEntry->aKey || !pEntry->zData
+   || !sqlitejsonLzDecompress(a + SQLITEJSON_COMPRESSED_HEADER, n - SQLITEJSON_COMPRESSED_HEADER,
+                              (unsigned char*)pEntry->zData, (int)size))
+  {
+    if (!pEntry->aKey || !pEntry->zData)
+    {
+      sqlite3_result_error_nomem(context);
+      *pbOom = 1;
+    }
+    sqlitejsonCacheClear(pEntry);
+    return 0;
+  }
+  memcpy(pEntry->aKey, a, n);
+  pEntry->nKey = n;
+  pEntry->hash = hash;
+  pEntry->zData[size] = 0;
+  pEntry->nData = (int)size;
+  pEntry->bPinned = 1;
+  pEntry->pStmt = sqlitejsonRunningStmt(db);
+  pEntry->hSql = sqlitejsonStmtHash(pEntry->pStmt);
+  pConn->nUsed++;
+  pConn->iNext = (pConn->iNext + 1) % SQLITEJSON_CACHE_SIZE;
+  *pnData = pEntry->nData;
+  return pEntry->zData;
+}
+
+/*
+** Take encoded json from n bytes at a.
+** Return 0 if bytes are not encoded json or header is malformed
+*/
+static int sqlitejsonDocFromBytes(SqlitejsonDoc *pDoc, const unsigned char *a, unsigned n){
+  const unsigned header = SQLITEJSON_ENCODED_HEADER;
+  unsigned text_len, key_size;
+  if (n < header || memcmp(a, SQLITEJSON_ENCODED_MAGIC, 3) != 0 || a[3] != SQLITEJSON_ENCODED_VERSION) return 0;
+  text_len = sqlitejsonGet4(a + 4);
+  pDoc->nKeys = sqlitejsonGet4(a + 12);
+  key_size = pDoc->nKeys < 0x10000000u ? pDoc->nKeys * 8 : n;
+  if (text_len < n - header && key_size <= n - header - text_len - 1 && a[header + text_len] == 0)
+  {
+    pDoc->nJson = (int)text_len;
+    pDoc->zJson = (const char*)a + header;
+    pDoc->aKeys = a + header + text_len + 1;
+    pDoc->aIndex = a + header + text_len + 1 + key_size;
+    pDoc->nIndex = n - header - text_len - 1 - key_size;
+    pDoc->iRoot = sqlitejsonGet4(a + 8);
+    return 1;
+  }
+  pDoc->nKeys = 0;
+  return 0;
+}
+
+/*
+** Take encoded or compressed json from n bytes at a. Compressed json is
+** decompressed through cache of connection.
+** Return 0 if bytes are neither or header is malformed, -1 if out of
+** memory (error is set on context)
+*/
+static int sqlitejsonDocFromBlob(
+  SqlitejsonDoc *pDoc,
+  sqlite3_context *context,
+  const unsigned char *a,
+  int n
+){
+  if (n > SQLITEJSON_COMPRESSED_HEADER && memcmp(a, SQLITEJSON_COMPRESSED_MAGIC, 4) == 0)
+  {
+    int nData, bOom = 0;
+    const char *zData = sqlitejsonDecompress(context, a, n, &nData, &bOom);
+    if (!zData) return bOom ? -1 : 0;
+    pDoc->bCompressed = 1;
+    if (sqlitejsonDocFromBytes(pDoc, (const unsigned char*)zData, (unsigned)nData)) return 1;
+    pDoc->zJson = zData;
+    pDoc->nJson = nData;
+    return 1;
+  }
+  return sqlitejsonDocFromBytes(pDoc, a, (unsigned)n);
+}
+
+/*
+** Take json document from SQL value. Text of encoded json is used in place,
+** compressed json is decompressed through cache of connection, any other
+** value is converted to text. Encoded or compressed json with malformed
+** header is treated as text, so it is not valid json.
+** zJson is NULL if value is NULL.
+** Return 0 if out of memory, error is set on context and caller must return
+*/
+static int sqlitejsonDocInit(SqlitejsonDoc *pDoc, sqlite3_context *context, sqlite3_value *pVal){
+  memset(pDoc, 0, sizeof(*pDoc));
+  if (sqlite3_value_type(pVal) == SQLITE_BLOB)
+  {
+    const unsigned char *a = (const unsigned char*)sqlite3_value_blob(pVal);
+    int rc = a ? sqlitejsonDocFromBlob(pDoc, context, a, sqlite3_value_bytes(pVal)) : 0;
+    if (rc) return rc > 0;
+  }
+  pDoc->zJson = (const char*)sqlite3_value_text(pVal);
+  pDoc->nJson = sqlite3_value_bytes(pVal);
+  if (!pDoc->zJson && sqlite3_value_type(pVal) != SQLITE_NULL)
+  {
+    sqlite3_result_error_nomem(context);
+    return 0;
+  }
+  return 1;
+}
+
+/*
+** Return 1 if n bytes at z are exactly one valid json value. Stream parser
+** checks the whole syntax, not only the branch needed for a path
+*/
+static int sqlitejsonIsValid(const char *z, int n){
+  JsonGetStream stream;
+  int consumed, rc;
+  jsonget_stream_init(&stream, 0, 0, 0, 0);
+  rc = jsonget_stream_feed(&stream, z, n, &consumed);
+  if (rc == JSONGET_STREAM_MORE) rc = jsonget_stream_end(&stream);
+  if (rc != JSONGET_STREAM_MATCH) return 0;
+  // Only whitespace may follow the value
+  rc = jsonget_stream_feed(&stream, z + consumed, n - consumed, &consumed);
+  return rc == JSONGET_STREAM_MORE && jsonget_stream_end(&stream) == JSONGET_STREAM_END;
+}
+
+/*
+** Json representation of SQL value: NULL is null, numbers are json numbers,
+** text is json string, blob is raw json text (json_raw() and "->" values)
+** or encoded or compressed json. Raw json blob is checked to be exactly one
+** valid json value, so arbitrary blob is never spliced into output.
+** zNum is buffer of at least 32 bytes for numbers.
+** Return representation in *pz and *pn, *pbString is set if
+** representation is text which must be written as json string.
+** Return 0 if value is blob which is not json, -1 if out of memory (error
+** is set on context)
+*/
+static int sqlitejsonValueJson(
+  sqlite3_context *context,
+  sqlite3_value *pVal,
+  char *zNum,
+  const char **pz,
+  int *pn,
+  int *pbString
+){
+  *pbString = 0;
+  switch (sqlite3_value_type(pVal))
+  {
+    case SQLITE_INTEGER:
+      sqlite3_snprintf(32, zNum, "%lld", sqlite3_value_int64(pVal));
+      *pz = zNum;
+      break;
+    case SQLITE_FLOAT:
+    {
+      double r = sqlite3_value_double(pVal);
+      // Infinity and NaN have no json representation
+      if (r != r || r - r != 0) *pz = "null";
+      else
+      {
+        sqlite3_snprintf(32, zNum, "%!.15g", r);
+        *pz = zNum;
+      }
+      break;
+    }
+    case SQLITE_TEXT:
+      *pz = (const char*)sqlite3_value_text(pVal);
+      *pn = sqlite3_value_bytes(pVal);
+      *pbString = 1;
+      if (!*pz)
+      {
+        sqlite3_result_error_nomem(context);
+        return -1;
+      }
+      return 1;
+    case SQLITE_BLOB:
+    {
+      SqlitejsonDoc doc;
+      const unsigned char *a = (const unsigned char*)sqlite3_value_blob(pVal);
+      int n = sqlite3_value_bytes(pVal), rc;
+      // Blob is never converted to text: that may change type of value,
+      // so the next call would take it as string
+      memset(&doc, 0, sizeof(doc));
+      if (a && n > 0 && a[0] == 0)
+      {
+        rc = sqlitejsonDocFromBlob(&doc, context, a, n);
+        if (rc <= 0) return rc;
+        *pz = doc.zJson;
+        *pn = doc.nJson;
+        return 1;
+      }
+      if (!a || !sqlitejsonIsValid((const char*)a, n)) return 0;
+      *pz = (const char*)a;
+      *pn = n;
+      return 1;
+    }
+    default:
+      *pz = "null";
+      break;
+  }
+  *pn = (int)strlen(*pz);
+  return 1;
+}
+
+/* Set buffer content as text result of context and reset buffer */
+static void sqlitejsonBufResult(SqlitejsonBuf *p, sqlite3_context *context){
+  if (p->bOom) sqlite3_result_error_nomem(context);
+  else if (p->z == p->zSpace) sqlite3_result_text(context, p->z, p->n, SQLITE_TRANSIENT);
+  else
+  {
+    sqlite3_result_text(context, p->z, p->n, sqlitejsonDestructor);
+    sqlitejsonBufInit(p);
+    return;
+  }
+  sqlitejsonBufReset(p);
+}
+
 /*
 **  Select one of sqlite3_result_* function to store json_obj value
 */
@@ -90,9 +912,15 @@ static void sqlitejsonWriteJsonValToContext(
         if (jsonget_raw(json_obj, &buf, &len))
         {
           mem = sqlite3_malloc(len + 1);
+          if (!mem)
+          {
+            sqlite3_result_error_nomem(context);
+            break;
+          }
           for(i = 0; i < len; i++) mem[i] = *buf++;
           mem[i] = 0;
-          sqlite3_result_text(context, mem, len + 1, sqlitejsonDestructor);                
+          // Terminating zero is not part of text
+          sqlite3_result_text(context, mem, len, sqlitejsonDestructor);
         }
         else sqlite3_result_null(context);
         break;
@@ -104,45 +932,4189 @@ static void sqlitejsonWriteJsonValToContext(
 }
 
 /*
-** Implementation of the json_get(json, key) function
-** Parameters: 
-**   json - json-string
-**   key - path of retrieving key
-**         'kobj', 'kobj1->kobj2', 'karray->1->kobj'
+** Operators of the fused comparison functions json_eq, json_ne ...
+** Operator is passed to function through sqlite3_user_data()
 */
-static void sqlitejsonGetFunc(
-  sqlite3_context *context, 
-  int argc, 
-  sqlite3_value **argv
-){  
-  if (argc == 0)
+#define SQLITEJSON_OP_EQ 1
+#define SQLITEJSON_OP_NE 2
+#define SQLITEJSON_OP_LT 3
+#define SQLITEJSON_OP_LE 4
+#define SQLITEJSON_OP_GT 5
+#define SQLITEJSON_OP_GE 6
+
+#define SQLITEJSON_INT_TO_PTR(X)  ((void*)&((char*)0)[X])
+#define SQLITEJSON_PTR_TO_INT(X)  ((int)(((char*)X)-(char*)0))
+
+/*
+** Constant operand of comparison: SQL value or literal of filter step
+*/
+typedef struct SqlitejsonOperand SqlitejsonOperand;
+struct SqlitejsonOperand {
+  int eType;               /* SQLITE_NULL, SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_BLOB */
+  sqlite3_int64 iVal;      /* Value of SQLITE_INTEGER */
+  double rVal;             /* Value of SQLITE_INTEGER or SQLITE_FLOAT */
+  const char *z;           /* Value of SQLITE_TEXT, not NULL-terminated */
+  int n;                   /* Length of z in bytes */
+};
+
+/* Fill *pOp with value pVal */
+static void sqlitejsonOperandFromValue(sqlite3_value *pVal, SqlitejsonOperand *pOp){
+  memset(pOp, 0, sizeof(*pOp));
+  pOp->eType = sqlite3_value_type(pVal);
+  switch (pOp->eType)
   {
-    sqlite3_result_error(context, "Invalid number of arguments", -1);
+    case SQLITE_INTEGER:
+      pOp->iVal = sqlite3_value_int64(pVal);
+      pOp->rVal = (double)pOp->iVal;
+      break;
+    case SQLITE_FLOAT:
+      pOp->rVal = sqlite3_value_double(pVal);
+      break;
+    case SQLITE_TEXT:
+      pOp->z = (const char*)sqlite3_value_text(pVal);
+      pOp->n = sqlite3_value_bytes(pVal);
+      if (!pOp->z) pOp->z = "";
+      break;
   }
-  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
-  else
+}
+
+/*
+** Compare value under json_obj with operand pOp in the same way SQLite
+** compares result of json_get with the same SQL value: numeric values are
+** less than text, text is less than blob, text is compared with BINARY collation.
+** Value is not extracted: numbers are parsed straight from json, strings
+** and json objects are compared in place.
+** If any of values is NULL set *out_is_null to 1 and return 0
+*/
+static int sqlitejsonCompareValue(
+  JsonGetCursor json_obj,
+  const SqlitejsonOperand *pOp,
+  int *out_is_null
+){
+  int json_class, val_class;
+  *out_is_null = 0;
+  if (jsonget_isnull(json_obj) || pOp->eType == SQLITE_NULL)
   {
-      const char *json = (char*)sqlite3_value_text(argv[0]);
-      JsonGetCursor json_obj, json_root;
-      int i;
-      json_root = jsonget(json);
-      json_obj = json_root;
-      for (i = 1; i < argc && json_obj.type != JSONGET_INVALID; i++)
+    *out_is_null = 1;
+    return 0;
+  }
+
+  // 1 - numeric, 2 - text, 3 - blob
+  json_class = json_obj.type == JSONGET_BOOLEAN || json_obj.type == JSONGET_INTEGER ||
+               json_obj.type == JSONGET_DOUBLE ? 1 : 2;
+  val_class = pOp->eType == SQLITE_INTEGER || pOp->eType == SQLITE_FLOAT ? 1 :
+              (pOp->eType == SQLITE_TEXT ? 2 : 3);
+  if (json_class != val_class) return json_class - val_class;
+
+  if (json_class == 1)
+  {
+    if (json_obj.type != JSONGET_DOUBLE && pOp->eType == SQLITE_INTEGER)
+    {
+      int json_int = 0;
+      jsonget_int(json_obj, &json_int);
+      return json_int < pOp->iVal ? -1 : (json_int > pOp->iVal ? 1 : 0);
+    }
+    else
+    {
+      double json_double = 0;
+      if (json_obj.type == JSONGET_DOUBLE) jsonget_double(json_obj, &json_double);
+      else
       {
-        if (sqlite3_value_type(argv[i]) == SQLITE_INTEGER)
-        {
-          int index = sqlite3_value_int(argv[i]);
-          json_obj = jsonget_move_index(json_obj, index);
-        }
-        else
-        {
-          const char *key = (char*)sqlite3_value_text(argv[i]);
-          json_obj = jsonget_move_key(json_obj, key);
-        }
+        int json_int = 0;
+        jsonget_int(json_obj, &json_int);
+        json_double = json_int;
       }
-      if (i != argc) sqlite3_result_null(context);
-      else sqlitejsonWriteJsonValToContext(context, json_obj);
+      return json_double < pOp->rVal ? -1 : (json_double > pOp->rVal ? 1 : 0);
+    }
+  }
+  else return jsonget_string_ncompare(json_obj, pOp->z, pOp->n);
+}
+
+/* Apply comparison operator SQLITEJSON_OP_* to result of sqlitejsonCompareValue */
+static int sqlitejsonCompareResult(int op, int cmp){
+  switch (op)
+  {
+    case SQLITEJSON_OP_EQ: return cmp == 0;
+    case SQLITEJSON_OP_NE: return cmp != 0;
+    case SQLITEJSON_OP_LT: return cmp < 0;
+    case SQLITEJSON_OP_LE: return cmp <= 0;
+    case SQLITEJSON_OP_GT: return cmp > 0;
+    case SQLITEJSON_OP_GE: return cmp >= 0;
   }
+  return 0;
+}
+
+/*
+** Path step expressions.
+** Path element made by json_step() is not a key but a step expression, parser
+** makes it from ->* and similar path steps. Steps that can match several
+** values make json_get return json array of all matched values
+*/
+#define SQLITEJSON_STEP_WILDCARD       1   /* *: all elements of array or values of object */
+#define SQLITEJSON_STEP_FILTER         2   /* ?(@.k > 0): elements matching filter */
+#define SQLITEJSON_STEP_DESCENT_FIRST  3   /* ..k: first field k at any depth */
+#define SQLITEJSON_STEP_DESCENT_ALL    4   /* [..k]: all fields k at any depth */
+#define SQLITEJSON_STEP_SLICE          5   /* [a:b:step]: elements from a to b */
+
+typedef struct SqlitejsonStep SqlitejsonStep;
+struct SqlitejsonStep {
+  int eType;               /* One of SQLITEJSON_STEP_* */
+
+  /* SQLITEJSON_STEP_DESCENT_* */
+  const char *zKey;        /* Searched key, not NULL-terminated */
+  int nKey;                /* Length of zKey */
+
+  /* SQLITEJSON_STEP_SLICE */
+  int iStart;              /* First index, negative counts from the end */
+  int iEnd;                /* Index after last, negative counts from the end */
+  int iStep;               /* Positive step between indexes */
+  int bStart;              /* True if iStart is set */
+  int bEnd;                /* True if iEnd is set */
+
+  /* SQLITEJSON_STEP_FILTER */
+  const char *zPath;       /* Path of filtered value relative to element: .k1.k2 */
+  int nPath;               /* Length of zPath */
+  int eOp;                 /* SQLITEJSON_OP_* or 0 to check if value exists */
+  SqlitejsonOperand value; /* Value to compare with */
+};
+
+#define SQLITEJSON_IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define SQLITEJSON_SKIP_SPACES(z, zEnd) while ((z) < (zEnd) && SQLITEJSON_IS_SPACE(*(z))) (z)++
+
+/*
+** Parse filter of step expression ?(@.k1.k2 op literal) or ?(@.k1.k2)
+** z points after '?'. Literal is number, true, false, null or
+** string in single or double quotes (without escapes).
+** Return 0 if filter is invalid
+*/
+static int sqlitejsonParseFilter(const char *z, const char *zEnd, SqlitejsonStep *pStep){
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  if (z >= zEnd || *z != '(') return 0;
+  z++;
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  if (z >= zEnd || *z != '@') return 0;
+  z++;
+
+  // Relative path
+  pStep->zPath = z;
+  while (z < zEnd && *z == '.')
+  {
+    z++;
+    while (z < zEnd && *z != '.' && *z != '=' && *z != '!' && *z != '<' && 
+           *z != '>' && *z != ')' && !SQLITEJSON_IS_SPACE(*z)) z++;
+  }
+  pStep->nPath = (int)(z - pStep->zPath);
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  if (z >= zEnd) return 0;
+
+  // Operator
+  if (*z == ')') pStep->eOp = 0;
+  else if (z + 1 < zEnd && z[0] == '=' && z[1] == '=') { pStep->eOp = SQLITEJSON_OP_EQ; z += 2; }
+  else if (z + 1 < zEnd && z[0] == '!' && z[1] == '=') { pStep->eOp = SQLITEJSON_OP_NE; z += 2; }
+  else if (z + 1 < zEnd && z[0] == '<' && z[1] == '>') { pStep->eOp = SQLITEJSON_OP_NE; z += 2; }
+  else if (z + 1 < zEnd && z[0] == '<' && z[1] == '=') { pStep->eOp = SQLITEJSON_OP_LE; z += 2; }
+  else if (z + 1 < zEnd && z[0] == '>' && z[1] == '=') { pStep->eOp = SQLITEJSON_OP_GE; z += 2; }
+  else if (z[0] == '=') { pStep->eOp = SQLITEJSON_OP_EQ; z++; }
+  else if (z[0] == '<') { pStep->eOp = SQLITEJSON_OP_LT; z++; }
+  else if (z[0] == '>') { pStep->eOp = SQLITEJSON_OP_GT; z++; }
+  else return 0;
+
+  // Literal
+  if (pStep->eOp)
+  {
+    SQLITEJSON_SKIP_SPACES(z, zEnd);
+    if (z < zEnd && (*z == '\'' || *z == '"'))
+    {
+      char quote = *z++;
+      pStep->value.eType = SQLITE_TEXT;
+      pStep->value.z = z;
+      while (z < zEnd && *z != quote) z++;
+      if (z >= zEnd) return 0;
+      pStep->value.n = (int)(z - pStep->value.z);
+      z++;
+    }
+    else
+    {
+      // Number, true, false or null is parsed as json
+      char literal[64];
+      const char *raw;
+      int n = 0, raw_len;
+      JsonGetCursor cur;
+      while (z < zEnd && *z != ')' && !SQLITEJSON_IS_SPACE(*z) && n < (int)sizeof(literal) - 1) literal[n++] = *z++;
+      literal[n] = 0;
+      cur = jsonget(literal);
+      if (!jsonget_raw(cur, &raw, &raw_len) || raw_len != n) return 0;
+      switch (cur.type)
+      {
+        case JSONGET_NULL: pStep->value.eType = SQLITE_NULL; break;
+        case JSONGET_BOOLEAN:
+        case JSONGET_INTEGER:
+        {
+          int val = 0;
+          jsonget_int(cur, &val);
+          pStep->value.eType = SQLITE_INTEGER;
+          pStep->value.iVal = val;
+          pStep->value.rVal = val;
+          break;
+        }
+        case JSONGET_DOUBLE:
+          pStep->value.eType = SQLITE_FLOAT;
+          jsonget_double(cur, &pStep->value.rVal);
+          break;
+        default: return 0;
+      }
+    }
+    SQLITEJSON_SKIP_SPACES(z, zEnd);
+  }
+  if (z >= zEnd || *z != ')') return 0;
+  z++;
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  return z == zEnd;
+}
+
+/*
+** Parse optional integer of slice, move *pz to the end of integer
+** Return 1 if integer is found
+*/
+static int sqlitejsonParseSliceInt(const char **pz, const char *zEnd, int *pVal){
+  const char *z = *pz;
+  int sign = 1, val = 0;
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  if (z < zEnd && *z == '-')
+  {
+    sign = -1;
+    z++;
+  }
+  if (z >= zEnd || *z < '0' || *z > '9') return 0;
+  while (z < zEnd && *z >= '0' && *z <= '9') val = val * 10 + (*z++ - '0');
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  *pz = z;
+  *pVal = sign * val;
+  return 1;
+}
+
+/*
+** Parse slice a:b:step of step expression, each part is optional
+** Return 0 if slice is invalid
+*/
+static int sqlitejsonParseSlice(const char *z, const char *zEnd, SqlitejsonStep *pStep){
+  pStep->eType = SQLITEJSON_STEP_SLICE;
+  pStep->iStep = 1;
+  pStep->bStart = sqlitejsonParseSliceInt(&z, zEnd, &pStep->iStart);
+  if (z >= zEnd || *z != ':') return 0;
+  z++;
+  pStep->bEnd = sqlitejsonParseSliceInt(&z, zEnd, &pStep->iEnd);
+  if (z < zEnd && *z == ':')
+  {
+    z++;
+    if (sqlitejsonParseSliceInt(&z, zEnd, &pStep->iStep) && pStep->iStep <= 0) return 0;
+  }
+  return z == zEnd;
+}
+
+/*
+** Parse step expression z of n bytes into *pStep
+** Step in brackets matches several values: [*], [?(@.k > 0)], [..k], [a:b:step]
+** Step without brackets: * and ?(...) also match several values,
+** ..k matches first field k at any depth
+** Return 0 if step expression is invalid
+*/
+static int sqlitejsonParseStep(const char *z, int n, SqlitejsonStep *pStep){
+  const char *zEnd = z + n;
+  int bBracket = 0;
+  memset(pStep, 0, sizeof(*pStep));
+  SQLITEJSON_SKIP_SPACES(z, zEnd);
+  while (zEnd > z && SQLITEJSON_IS_SPACE(zEnd[-1])) zEnd--;
+  if (zEnd - z >= 2 && z[0] == '[' && zEnd[-1] == ']')
+  {
+    bBracket = 1;
+    z++;
+    zEnd--;
+    SQLITEJSON_SKIP_SPACES(z, zEnd);
+    while (zEnd > z && SQLITEJSON_IS_SPACE(zEnd[-1])) zEnd--;
+  }
+  if (z >= zEnd) return 0;
+
+  if (*z == '*')
+  {
+    pStep->eType = SQLITEJSON_STEP_WILDCARD;
+    return z + 1 == zEnd;
+  }
+  if (*z == '?')
+  {
+    pStep->eType = SQLITEJSON_STEP_FILTER;
+    return sqlitejsonParseFilter(z + 1, zEnd, pStep);
+  }
+  if (zEnd - z > 2 && z[0] == '.' && z[1] == '.')
+  {
+    pStep->eType = bBracket ? SQLITEJSON_STEP_DESCENT_ALL : SQLITEJSON_STEP_DESCENT_FIRST;
+    pStep->zKey = z + 2;
+    pStep->nKey = (int)(zEnd - z - 2);
+    return 1;
+  }
+  if (bBracket) return sqlitejsonParseSlice(z, zEnd, pStep);
+  return 0;
+}
+
+/*
+** Path element is step expression if it is blob which starts with
+** SQLITEJSON_STEP_PREFIX followed by text of step. Parser makes such blobs
+** from "->" steps, json_step() makes them from text. Other blobs are keys
+*/
+#define SQLITEJSON_STEP_PREFIX       "\000JS"
+#define SQLITEJSON_STEP_PREFIX_SIZE  3
+
+/* Return 1 if path element is step expression */
+static int sqlitejsonIsStep(sqlite3_value *pVal){
+  return sqlite3_value_type(pVal) == SQLITE_BLOB
+      && sqlite3_value_bytes(pVal) >= SQLITEJSON_STEP_PREFIX_SIZE
+      && memcmp(sqlite3_value_blob(pVal), SQLITEJSON_STEP_PREFIX, SQLITEJSON_STEP_PREFIX_SIZE) == 0;
+}
+
+/* Parse step expression of path element, which is checked by sqlitejsonIsStep() */
+static int sqlitejsonParseStepValue(sqlite3_value *pVal, SqlitejsonStep *pStep){
+  const char *z = (const char*)sqlite3_value_blob(pVal);
+  return sqlitejsonParseStep(z + SQLITEJSON_STEP_PREFIX_SIZE,
+                             sqlite3_value_bytes(pVal) - SQLITEJSON_STEP_PREFIX_SIZE, pStep);
+}
+
+/* Return 1 if step can match several values */
+static int sqlitejsonIsMultiStep(const SqlitejsonStep *pStep){
+  return pStep->eType != SQLITEJSON_STEP_DESCENT_FIRST;
+}
+
+/*
+** Check if element json_obj matches filter of step expression
+** Comparison is done in place like in json_eq function, except that
+** null literal matches json null
+*/
+static int sqlitejsonFilterMatch(const SqlitejsonStep *pStep, JsonGetCursor json_obj){
+  const char *z = pStep->zPath;
+  const char *zEnd = z + pStep->nPath;
+  int cmp, is_null;
+
+  // Move along relative path. Numeric key of array is index
+  while (z < zEnd && json_obj.type != JSONGET_INVALID)
+  {
+    const char *zKey = ++z;
+    int index = 0;
+    while (z < zEnd && *z != '.') 
+    {
+      index = *z >= '0' && *z <= '9' && index >= 0 ? index * 10 + (*z - '0') : -1;
+      z++;
+    }
+    if (json_obj.type == JSONGET_ARRAY && z > zKey && index >= 0)
+    {
+      json_obj = jsonget_move_index(json_obj, index);
+    }
+    else json_obj = jsonget_move_nkey(json_obj, zKey, (int)(z - zKey));
+  }
+
+  if (!pStep->eOp) return json_obj.type != JSONGET_INVALID;
+  if (pStep->value.eType == SQLITE_NULL)
+  {
+    if (pStep->eOp == SQLITEJSON_OP_EQ) return json_obj.type == JSONGET_NULL;
+    if (pStep->eOp == SQLITEJSON_OP_NE) return !jsonget_isnull(json_obj);
+    return 0;
+  }
+  cmp = sqlitejsonCompareValue(json_obj, &pStep->value, &is_null);
+  return !is_null && sqlitejsonCompareResult(pStep->eOp, cmp);
+}
+
+/*
+** Move cursor json_obj along path elements argv[0] .. argv[argc-1]
+** Integer path element is interpreted as array index, other as object key
+** Step expression path element (see sqlitejsonIsStep) matches single value
+** Return INVALID cursor if path doesn't exist or contains steps matching several values
+*/
+static JsonGetCursor sqlitejsonMovePath(
+  JsonGetCursor json_obj,
+  int argc,
+  sqlite3_value **argv
+){
+  int i;
+  for (i = 0; i < argc && json_obj.type != JSONGET_INVALID; i++)
+  {
+    if (sqlite3_value_type(argv[i]) == SQLITE_INTEGER)
+    {
+      int index = sqlite3_value_int(argv[i]);
+      json_obj = jsonget_move_index(json_obj, index);
+    }
+    else if (sqlitejsonIsStep(argv[i]))
+    {
+      // Steps matching several values are handled by sqlitejsonCollectPath
+      SqlitejsonStep step;
+      if (sqlitejsonParseStepValue(argv[i], &step)
+          && step.eType == SQLITEJSON_STEP_DESCENT_FIRST)
+      {
+        // Search stops at first found field
+        JsonGetSearch search = jsonget_search(json_obj);
+        json_obj = jsonget_search_next_nkey(&search, step.zKey, step.nKey);
+      }
+      else json_obj.type = JSONGET_INVALID;
+    }
+    else
+    {
+      const char *key = (char*)sqlite3_value_text(argv[i]);
+      if (key) json_obj = jsonget_move_key(json_obj, key);
+      else json_obj.type = JSONGET_INVALID;
+    }
+  }
+  return json_obj;
+}
+
+/*
+** Check step expressions of path elements argv[0] .. argv[argc-1]
+** Return 1 if path can match several values, 0 if it matches single value,
+** -1 if path contains invalid step expression
+*/
+static int sqlitejsonCheckPath(int argc, sqlite3_value **argv){
+  int i, rc = 0;
+  for (i = 0; i < argc; i++)
+  {
+    if (sqlitejsonIsStep(argv[i]))
+    {
+      SqlitejsonStep step;
+      if (!sqlitejsonParseStepValue(argv[i], &step)) return -1;
+      if (sqlitejsonIsMultiStep(&step)) rc = 1;
+    }
+  }
+  return rc;
+}
+
+/*
+** Read node of encoded json index. Return 0 if ref is not a node or node
+** doesn't fit into index
+*/
+static int sqlitejsonDocNode(
+  const SqlitejsonDoc *pDoc,
+  unsigned ref,
+  unsigned *pTextOffset,
+  unsigned *pCount,
+  const unsigned char **paElem
+){
+  unsigned node = ref & ~SQLITEJSON_REF_NODE;
+  unsigned elem_size;
+  if (!(ref & SQLITEJSON_REF_NODE) || node > pDoc->nIndex || pDoc->nIndex - node < 8) return 0;
+  *pTextOffset = sqlitejsonGet4(pDoc->aIndex + node);
+  *pCount = sqlitejsonGet4(pDoc->aIndex + node + 4);
+  if (*pTextOffset >= (unsigned)pDoc->nJson) return 0;
+  elem_size = pDoc->zJson[*pTextOffset] == '{' ? 8 : 4;
+  if (*pCount > (pDoc->nIndex - node - 8) / elem_size) return 0;
+  *paElem = pDoc->aIndex + node + 8;
+  return 1;
+}
+
+/* Cursor of value given by ref of encoded json */
+static JsonGetCursor sqlitejsonDocCursor(const SqlitejsonDoc *pDoc, unsigned ref){
+  unsigned text_offset = ref, count;
+  const unsigned char *aElem;
+  JsonGetCursor ret;
+  if (ref & SQLITEJSON_REF_NODE)
+  {
+    if (!sqlitejsonDocNode(pDoc, ref, &text_offset, &count, &aElem)) text_offset = (unsigned)pDoc->nJson;
+  }
+  if (text_offset < (unsigned)pDoc->nJson) return jsonget(pDoc->zJson + text_offset);
+  ret.type = JSONGET_INVALID;
+  ret.pstr = 0;
+  return ret;
+}
+
+/*
+** Find id of key with given hash in key table of encoded json. Key table is
+** sorted by hash, so only keys with equal hash are compared as strings.
+** Return 0 if document has no such key
+*/
+static int sqlitejsonDocKeyId(
+  const SqlitejsonDoc *pDoc,
+  const char *key,
+  int key_len,
+  unsigned hash,
+  unsigned *pKeyId
+){
+  unsigned lo = 0, hi = pDoc->nKeys;
+  while (lo < hi)
+  {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (sqlitejsonGet4(pDoc->aKeys + 8 * mid) < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  for (; lo < pDoc->nKeys && sqlitejsonGet4(pDoc->aKeys + 8 * lo) == hash; lo++)
+  {
+    JsonGetCursor key_obj;
+    unsigned key_offset = sqlitejsonGet4(pDoc->aKeys + 8 * lo + 4);
+    if (key_offset >= (unsigned)pDoc->nJson) return 0;
+    key_obj.pstr = pDoc->zJson + key_offset;
+    key_obj.type = JSONGET_STRING;
+    if (jsonget_string_ncompare(key_obj, key, key_len) == 0)
+    {
+      *pKeyId = lo;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+** Hash of key path element argv[iArg] of function. Hash is kept as auxdata
+** of the argument, so constant key is hashed once per statement
+*/
+static unsigned sqlitejsonKeyHash(
+  sqlite3_context *context,
+  int iArg,
+  const char *key,
+  int key_len
+){
+  unsigned *pHash = (unsigned*)sqlite3_get_auxdata(context, iArg);
+  if (!pHash)
+  {
+    unsigned hash = sqlitejsonHashBytes(key, key_len);
+    pHash = (unsigned*)sqlite3_malloc(sizeof(unsigned));
+    if (!pHash) return hash;
+    *pHash = hash;
+    sqlite3_set_auxdata(context, iArg, pHash, sqlitejsonDestructor);
+  }
+  return *pHash;
+}
+
+/*
+** Same as sqlitejsonMovePath starting from document root.
+** Array indexes and object keys of encoded json are looked up in index:
+** array element is taken by position, object key is found in key table and
+** compared with keys of object as integer id, values are never skipped.
+** The rest of path (step expressions, index of object pair) continues on
+** json text from there. argv[0] is argument iArg of function context.
+** Key ids are local to document, so they are found for every document,
+** hash of path key is computed once per statement
+*/
+static JsonGetCursor sqlitejsonDocMovePath(
+  const SqlitejsonDoc *pDoc,
+  sqlite3_context *context,
+  int iArg,
+  int argc,
+  sqlite3_value **argv
+){
+  unsigned ref = pDoc->iRoot, text_offset, count;
+  const unsigned char *aElem;
+  JsonGetCursor json_obj;
+  int i;
+  json_obj.type = JSONGET_INVALID;
+  json_obj.pstr = 0;
+  if (!pDoc->aIndex) return sqlitejsonMovePath(jsonget(pDoc->zJson), argc, argv);
+
+  for (i = 0; i < argc && sqlitejsonDocNode(pDoc, ref, &text_offset, &count, &aElem); i++)
+  {
+    if (pDoc->zJson[text_offset] == '[' && sqlite3_value_type(argv[i]) == SQLITE_INTEGER)
+    {
+      sqlite3_int64 index = sqlite3_value_int64(argv[i]);
+      if (index < 0) index += count;
+      if (index < 0 || index >= count) return json_obj;
+      ref = sqlitejsonGet4(aElem + 4 * index);
+    }
+    else if (pDoc->zJson[text_offset] == '{' && sqlite3_value_type(argv[i]) == SQLITE_TEXT)
+    {
+      const char *key = (const char*)sqlite3_value_text(argv[i]);
+      int key_len = sqlite3_value_bytes(argv[i]);
+      unsigned j, key_id;
+      // Key is compared with key table once, object keys are compared as ids
+      if (!sqlitejsonDocKeyId(pDoc, key, key_len, sqlitejsonKeyHash(context, iArg + i, key, key_len), &key_id))
+        return json_obj;
+      for (j = 0; j < count && sqlitejsonGet4(aElem + 8 * j) != key_id; j++);
+      if (j == count) return json_obj;
+      ref = sqlitejsonGet4(aElem + 8 * j + 4);
+    }
+    else break; // other path elements continue on json text
+  }
+  json_obj = sqlitejsonDocCursor(pDoc, ref);
+  return sqlitejsonMovePath(json_obj, argc - i, argv + i);
+}
+
+/*
+** Append to pBuf all values matched by path argv[0] .. argv[argc-1]
+** starting from json_obj. Values are separated by comma, *pnMatch counts them.
+** Each array or object is walked with jsonget_move_next once, so the cost
+** is linear in size of walked json.
+** Return 0 if path contains invalid step expression
+*/
+static int sqlitejsonCollectPath(
+  SqlitejsonBuf *pBuf,
+  JsonGetCursor json_obj,
+  int argc,
+  sqlite3_value **argv,
+  int *pnMatch
+){
+  SqlitejsonStep step;
+  int i;
+
+  // Walk path elements up to first step matching several values
+  for (i = 0; i < argc; i++)
+  {
+    if (!sqlitejsonIsStep(argv[i])) continue;
+    if (!sqlitejsonParseStepValue(argv[i], &step)) return 0;
+    if (sqlitejsonIsMultiStep(&step)) break;
+  }
+  json_obj = sqlitejsonMovePath(json_obj, i, argv);
+  if (json_obj.type == JSONGET_INVALID) return 1;
+  if (i == argc)
+  {
+    if (*pnMatch) sqlitejsonBufAppendChar(pBuf, ',');
+    sqlitejsonBufAppendRaw(pBuf, json_obj);
+    (*pnMatch)++;
+    return 1;
+  }
+
+  argc -= i + 1;
+  argv += i + 1;
+  switch (step.eType)
+  {
+    case SQLITEJSON_STEP_WILDCARD:
+    case SQLITEJSON_STEP_FILTER:
+    {
+      // Elements not matching filter are skipped without decoding
+      JsonGetCursor cur = jsonget_move_index(json_obj, 0);
+      while (cur.type != JSONGET_INVALID)
+      {
+        JsonGetCursor val = cur.type == JSONGET_PAIR ? jsonget_move_pair_value(cur) : cur;
+        if (step.eType == SQLITEJSON_STEP_WILDCARD || sqlitejsonFilterMatch(&step, val))
+        {
+          if (!sqlitejsonCollectPath(pBuf, val, argc, argv, pnMatch)) return 0;
+        }
+        cur = jsonget_move_next(cur);
+      }
+      break;
+    }
+    case SQLITEJSON_STEP_SLICE:
+    {
+      // Selected range is streamed in one forward scan, which stops at the end of range
+      int start = step.bStart ? step.iStart : 0;
+      int end = step.iEnd, i;
+      JsonGetCursor cur;
+      if (start < 0 || (step.bEnd && end < 0))
+      {
+        int count = jsonget_array_count(json_obj);
+        if (start < 0) start = start + count < 0 ? 0 : start + count;
+        if (step.bEnd && end < 0) end = end + count < 0 ? 0 : end + count;
+      }
+      cur = jsonget_move_index(json_obj, start);
+      for (i = start; cur.type != JSONGET_INVALID && (!step.bEnd || i < end); i++)
+      {
+        if ((i - start) % step.iStep == 0)
+        {
+          JsonGetCursor val = cur.type == JSONGET_PAIR ? jsonget_move_pair_value(cur) : cur;
+          if (!sqlitejsonCollectPath(pBuf, val, argc, argv, pnMatch)) return 0;
+        }
+        cur = jsonget_move_next(cur);
+      }
+      break;
+    }
+    case SQLITEJSON_STEP_DESCENT_ALL:
+    {
+      // One forward scan over json_obj, found values are not walked again
+      JsonGetSearch search = jsonget_search(json_obj);
+      JsonGetCursor cur = jsonget_search_next_nkey(&search, step.zKey, step.nKey);
+      while (cur.type != JSONGET_INVALID)
+      {
+        if (!sqlitejsonCollectPath(pBuf, cur, argc, argv, pnMatch)) return 0;
+        cur = jsonget_search_next_nkey(&search, step.zKey, step.nKey);
+      }
+      break;
+    }
+  }
+  return 1;
+}
+
+/* Return end of value under cursor or NULL if it is invalid */
+static const char *sqlitejsonRawEnd(JsonGetCursor json_obj){
+  const char *raw;
+  int len;
+  if (json_obj.type == JSONGET_PAIR) json_obj = jsonget_move_pair_value(json_obj);
+  return jsonget_raw(json_obj, &raw, &len) ? raw + len : 0;
+}
+
+/*
+** Set result of json_get or json_raw (bRaw) to value under path elements
+** argv[0] .. argv[argc-1] of document, argv[0] is argument iArg of
+** function. path_kind is result of sqlitejsonCheckPath(), 1 if path can
+** match several values
+*/
+static void sqlitejsonGetResult(
+  sqlite3_context *context,
+  SqlitejsonDoc *pDoc,
+  int iArg,
+  int argc,
+  sqlite3_value **argv,
+  int path_kind,
+  int bRaw
+){
+  JsonGetCursor json_obj;
+  if (path_kind > 0)
+  {
+    // Path can match several values, return json array of them
+    SqlitejsonBuf buf;
+    int nMatch = 0;
+    sqlitejsonBufInit(&buf);
+    sqlitejsonBufAppendChar(&buf, '[');
+    sqlitejsonCollectPath(&buf, jsonget(pDoc->zJson), argc, argv, &nMatch);
+    sqlitejsonBufAppendChar(&buf, ']');
+    if (bRaw && !buf.bOom)
+    {
+      sqlite3_result_blob(context, buf.z, buf.n, SQLITE_TRANSIENT);
+      sqlitejsonBufReset(&buf);
+    }
+    else sqlitejsonBufResult(&buf, context);
+    return;
+  }
+  json_obj = sqlitejsonDocMovePath(pDoc, context, iArg, argc, argv);
+  if (bRaw)
+  {
+    const char *raw;
+    int len;
+    if (jsonget_raw(json_obj, &raw, &len)) sqlite3_result_blob(context, raw, len, SQLITE_TRANSIENT);
+    else sqlite3_result_null(context);
+  }
+  else sqlitejsonWriteJsonValToContext(context, json_obj);
+}
+
+/*
+** Implementation of the json_get(json, key) function
+** Parameters: 
+**   json - json-string
+**   key - path of retrieving key
+**         'kobj', 'kobj1->kobj2', 'karray->1->kobj'
+** The same implementation serves json_raw(json, key), selected by user data:
+** it returns raw json text of value as BLOB, so json constructors and
+** modification functions splice it without re-encoding
+*/
+static void sqlitejsonGetFunc(
+  sqlite3_context *context, 
+  int argc, 
+  sqlite3_value **argv
+){  
+  if (argc == 0)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+      SqlitejsonDoc doc;
+      int path_kind = sqlitejsonCheckPath(argc - 1, argv + 1);
+      if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+      if (path_kind < 0)
+      {
+        sqlite3_result_error(context, "Invalid path step", -1);
+        return;
+      }
+      sqlitejsonGetResult(context, &doc, 1, argc - 1, argv + 1, path_kind, sqlitejsonFuncArg(context) != 0);
+  }
+}
+
+/*
+** Implementation of json_step(text)
+** Return step expression path element for json_get and other functions:
+** json_get(doc, 'items', json_step('*'), 'price'). Parser makes the same
+** value from doc->items->*->price
+*/
+static void sqlitejsonStepFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonStep step;
+  const char *z = (const char*)sqlite3_value_text(argv[0]);
+  int n = sqlite3_value_bytes(argv[0]);
+  char *zOut;
+  assert(argc == 1);
+  if (!z)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  if (!sqlitejsonParseStep(z, n, &step))
+  {
+    sqlite3_result_error(context, "Invalid path step", -1);
+    return;
+  }
+  zOut = sqlite3_malloc(n + SQLITEJSON_STEP_PREFIX_SIZE);
+  if (!zOut)
+  {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  memcpy(zOut, SQLITEJSON_STEP_PREFIX, SQLITEJSON_STEP_PREFIX_SIZE);
+  memcpy(zOut + SQLITEJSON_STEP_PREFIX_SIZE, z, n);
+  sqlite3_result_blob(context, zOut, n + SQLITEJSON_STEP_PREFIX_SIZE, sqlitejsonDestructor);
+}
+
+/*
+** Size of the first prefix read by json_get_rowid()
+*/
+#define SQLITEJSON_LAZY_FIRST_READ 1024
+
+/*
+** Set result of json_get_rowid() when column of row can't be opened with
+** blob I/O: row is missing, value is neither text nor blob, or table or
+** column doesn't exist. Value is read with a query, so missing row is
+** told from other errors by result code
+*/
+static void sqlitejsonGetRowidQuery(
+  sqlite3_context *context,
+  const char *zTable,
+  const char *zColumn,
+  int argc,
+  sqlite3_value **argv,
+  int path_kind
+){
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  sqlite3_stmt *pStmt = 0;
+  // Qualified column name, unknown column is an error rather than a string
+  char *zSql = sqlite3_mprintf("SELECT t.\"%w\" FROM main.\"%w\" AS t WHERE t.rowid = ?", zColumn, zTable);
+  int rc;
+  if (!zSql)
+  {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if (rc == SQLITE_OK)
+  {
+    sqlite3_bind_value(pStmt, 1, argv[2]);
+    rc = sqlite3_step(pStmt);
+  }
+  if (rc == SQLITE_ROW && sqlite3_column_type(pStmt, 0) != SQLITE_NULL)
+  {
+    SqlitejsonDoc doc;
+    if (sqlitejsonDocInit(&doc, context, sqlite3_column_value(pStmt, 0)))
+      sqlitejsonGetResult(context, &doc, 3, argc - 3, argv + 3, path_kind, 0);
+  }
+  else if (rc == SQLITE_ROW || rc == SQLITE_DONE) sqlite3_result_null(context);
+  else sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+  sqlite3_finalize(pStmt);
+}
+
+/*
+** Implementation of json_get_rowid(table, column, rowid, path_element1, ...)
+** Same as json_get(column of row, path_element1, ...), but column is read
+** through incremental blob I/O: prefix of value is read and doubled until
+** value under path ends inside it. Key near the start of large document is
+** found without reading overflow pages with the rest of it.
+** Whole value is read for encoded and compressed json, negative indexes
+** and steps matching several values. Table is looked up in "main" schema.
+** Return NULL if row doesn't exist or column is NULL
+*/
+static void sqlitejsonGetRowidFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  sqlite3_blob *pBlob = 0;
+  const char *zTable, *zColumn;
+  char *zBuf = 0;
+  int nTotal, nRead = 0, nWant, path_kind, rc, i;
+
+  if (argc < 3)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+    return;
+  }
+  zTable = (const char*)sqlite3_value_text(argv[0]);
+  zColumn = (const char*)sqlite3_value_text(argv[1]);
+  if (!zTable || !zColumn || sqlite3_value_type(argv[2]) == SQLITE_NULL)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  path_kind = sqlitejsonCheckPath(argc - 3, argv + 3);
+  if (path_kind < 0)
+  {
+    sqlite3_result_error(context, "Invalid path step", -1);
+    return;
+  }
+  if (sqlite3_blob_open(db, "main", zTable, zColumn, sqlite3_value_int64(argv[2]), 0, &pBlob) != SQLITE_OK)
+  {
+    sqlitejsonGetRowidQuery(context, zTable, zColumn, argc, argv, path_kind);
+    return;
+  }
+
+  nTotal = sqlite3_blob_bytes(pBlob);
+  nWant = nTotal;
+  if (path_kind == 0 && nTotal > 2 * SQLITEJSON_LAZY_FIRST_READ) nWant = SQLITEJSON_LAZY_FIRST_READ;
+  for (i = 3; i < argc; i++)
+  {
+    // Negative index counts elements of the whole array
+    if (sqlite3_value_type(argv[i]) == SQLITE_INTEGER && sqlite3_value_int64(argv[i]) < 0) nWant = nTotal;
+  }
+  for (;;)
+  {
+    SqlitejsonDoc doc;
+    char *zNew = sqlite3_realloc(zBuf, nWant + 1);
+    if (!zNew)
+    {
+      sqlite3_result_error_nomem(context);
+      break;
+    }
+    zBuf = zNew;
+    rc = sqlite3_blob_read(pBlob, zBuf + nRead, nWant - nRead, nRead);
+    if (rc != SQLITE_OK)
+    {
+      sqlite3_result_error_code(context, rc);
+      break;
+    }
+    nRead = nWant;
+    zBuf[nRead] = 0;
+    if (nRead == nTotal)
+    {
+      memset(&doc, 0, sizeof(doc));
+      rc = sqlitejsonDocFromBlob(&doc, context, (const unsigned char*)zBuf, nRead);
+      if (rc < 0) break;
+      if (rc == 0)
+      {
+        doc.zJson = zBuf;
+        doc.nJson = nRead;
+      }
+      sqlitejsonGetResult(context, &doc, 3, argc - 3, argv + 3, path_kind, 0);
+      break;
+    }
+    if (zBuf[0] != 0)
+    {
+      // Value found in prefix is the same as in whole document, if it is
+      // followed by at least one byte of prefix (number may continue)
+      JsonGetCursor json_obj = sqlitejsonMovePath(jsonget(zBuf), argc - 3, argv + 3);
+      const char *zEnd = json_obj.type != JSONGET_INVALID ? sqlitejsonRawEnd(json_obj) : 0;
+      if (zEnd && zEnd < zBuf + nRead)
+      {
+        sqlitejsonWriteJsonValToContext(context, json_obj);
+        break;
+      }
+      nWant = nTotal - nRead > nRead ? 2 * nRead : nTotal;
+    }
+    else nWant = nTotal; // encoded or compressed json
+  }
+  sqlite3_free(zBuf);
+  sqlite3_blob_close(pBlob);
+}
+
+/*
+** Implementation of the json_has(json, path_element1, path_element2 ...) function
+** Return 1 if value under path exists (even if it is json null), otherwise 0
+** Search stops at found key, value is never decoded or copied
+*/
+static void sqlitejsonHasFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if (argc == 0)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+    SqlitejsonDoc doc;
+    JsonGetCursor json_obj;
+    if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+    json_obj = sqlitejsonDocMovePath(&doc, context, 1, argc - 1, argv + 1);
+    sqlite3_result_int(context, json_obj.type != JSONGET_INVALID);
+  }
+}
+
+/*
+** Implementation of the fused comparison functions
+**   json_eq(json, path_element1, ..., value)
+**   json_ne, json_lt, json_le, json_gt, json_ge
+** json_eq(doc, 'status', 'active') is the same as json_get(doc, 'status') = 'active'
+** but value under path is compared in place without extracting it.
+** Parser rewrites comparisons of -> expression with literal or bound
+** parameter to these functions
+*/
+static void sqlitejsonCompareFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if (argc < 2)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+    SqlitejsonDoc doc;
+    JsonGetCursor json_obj;
+    SqlitejsonOperand operand;
+    int cmp, is_null;
+    if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+    json_obj = sqlitejsonDocMovePath(&doc, context, 1, argc - 2, argv + 1);
+    sqlitejsonOperandFromValue(argv[argc - 1], &operand);
+    cmp = sqlitejsonCompareValue(json_obj, &operand, &is_null);
+    if (is_null) sqlite3_result_null(context);
+    else
+    {
+      int op = SQLITEJSON_PTR_TO_INT(sqlitejsonFuncArg(context));
+      sqlite3_result_int(context, sqlitejsonCompareResult(op, cmp));
+    }
+  }
+}
+
+/*
+** Names of JsonGetCursor types returned by json_type function
+*/
+static const char *const sqlitejsonTypeNames[] = {
+  0,          /* JSONGET_INVALID */
+  "null",     /* JSONGET_NULL */
+  "boolean",  /* JSONGET_BOOLEAN */
+  "integer",  /* JSONGET_INTEGER */
+  "double",   /* JSONGET_DOUBLE */
+  "string",   /* JSONGET_STRING */
+  "object",   /* JSONGET_OBJECT */
+  "array",    /* JSONGET_ARRAY */
+  "pair",     /* JSONGET_PAIR */
+};
+
+/*
+** Implementation of the json_type(json, path_element1, path_element2 ...) function
+** Return type name of value under path or NULL if value doesn't exist.
+** Type is taken from cursor, value is not extracted
+*/
+static void sqlitejsonTypeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if (argc == 0)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+    SqlitejsonDoc doc;
+    JsonGetCursor json_obj;
+    if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+    json_obj = sqlitejsonDocMovePath(&doc, context, 1, argc - 1, argv + 1);
+    if (json_obj.type > JSONGET_INVALID && json_obj.type <= JSONGET_PAIR)
+    {
+      sqlite3_result_text(context, sqlitejsonTypeNames[json_obj.type], -1, SQLITE_STATIC);
+    }
+    else sqlite3_result_null(context);
+  }
+}
+
+/*
+** Implementation of the json_is_array(json, path_element1 ...) and
+** json_is_object(json, path_element1 ...) functions
+** Return 1 if value under path has type passed through sqlite3_user_data(),
+** otherwise 0
+*/
+static void sqlitejsonIsTypeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  if (argc == 0)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+    SqlitejsonDoc doc;
+    JsonGetCursor json_obj;
+    if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+    json_obj = sqlitejsonDocMovePath(&doc, context, 1, argc - 1, argv + 1);
+    sqlite3_result_int(context, 
+      json_obj.type == SQLITEJSON_PTR_TO_INT(sqlitejsonFuncArg(context)));
+  }
+}
+
+/*
+** Hash set of IN-list values used by json_in function.
+** Set is built once per statement and stored as auxiliary data. Values
+** it was built from are kept in argument order, so that set is rebuilt
+** when a value that is not constant changes
+*/
+#define SQLITEJSON_INSET_EMPTY   0
+#define SQLITEJSON_INSET_NUMERIC 1
+#define SQLITEJSON_INSET_TEXT    2
+#define SQLITEJSON_INSET_NULL    3
+#define SQLITEJSON_INSET_BLOB    4
+
+typedef struct SqlitejsonInEntry SqlitejsonInEntry;
+struct SqlitejsonInEntry {
+  int eType;              /* One of SQLITEJSON_INSET_* */
+  unsigned hash;          /* Hash of the value */
+  const char *z;          /* Text value (not NULL-terminated) */
+  int n;                  /* Length of text value in bytes */
+  double r;               /* Numeric value */
+};
+
+typedef struct SqlitejsonInSet SqlitejsonInSet;
+struct SqlitejsonInSet {
+  int nSlot;                   /* Number of hash slots, power of two */
+  int hasNull;                 /* True if list contains NULL */
+  SqlitejsonInEntry *aSlot;    /* Hash slots */
+  int nValue;                  /* Number of values */
+  SqlitejsonInEntry *aValue;   /* Values in argument order */
+};
+
+/* Hash of numeric value. Equal integer and real values have equal hash */
+static unsigned sqlitejsonHashNumber(double r){
+  if (r == 0) r = 0; // -0.0 and 0.0 are equal
+  return sqlitejsonHashBytes((const char*)&r, sizeof(r));
+}
+
+/*
+** Build hash set from values argv[0] .. argv[argc-1]
+** Return NULL if out of memory
+*/
+static SqlitejsonInSet *sqlitejsonInSetNew(int argc, sqlite3_value **argv){
+  SqlitejsonInSet *pSet;
+  char *zText;
+  int nText = 0, nSlot = 4, i;
+  for (i = 0; i < argc; i++)
+  {
+    if (sqlite3_value_type(argv[i]) == SQLITE_TEXT) nText += sqlite3_value_bytes(argv[i]);
+  }
+  while (nSlot < argc * 2) nSlot *= 2;
+
+  pSet = sqlite3_malloc(sizeof(*pSet) + (nSlot + argc) * sizeof(SqlitejsonInEntry) + nText);
+  if (!pSet) return 0;
+  memset(pSet, 0, sizeof(*pSet) + (nSlot + argc) * sizeof(SqlitejsonInEntry));
+  pSet->nSlot = nSlot;
+  pSet->aSlot = (SqlitejsonInEntry*)&pSet[1];
+  pSet->nValue = argc;
+  pSet->aValue = &pSet->aSlot[nSlot];
+  zText = (char*)&pSet->aValue[argc];
+
+  for (i = 0; i < argc; i++)
+  {
+    SqlitejsonInEntry entry;
+    unsigned h;
+    memset(&entry, 0, sizeof(entry));
+    switch (sqlite3_value_type(argv[i]))
+    {
+      case SQLITE_NULL:
+        entry.eType = SQLITEJSON_INSET_NULL;
+        pSet->hasNull = 1;
+        break;
+      case SQLITE_INTEGER:
+      case SQLITE_FLOAT:
+        entry.eType = SQLITEJSON_INSET_NUMERIC;
+        entry.r = sqlite3_value_double(argv[i]);
+        entry.hash = sqlitejsonHashNumber(entry.r);
+        break;
+      case SQLITE_TEXT:
+        entry.eType = SQLITEJSON_INSET_TEXT;
+        entry.n = sqlite3_value_bytes(argv[i]);
+        memcpy(zText, sqlite3_value_text(argv[i]), entry.n);
+        entry.z = zText;
+        zText += entry.n;
+        entry.hash = sqlitejsonHashBytes(entry.z, entry.n);
+        break;
+      default:
+        // Blob never equals to json value
+        entry.eType = SQLITEJSON_INSET_BLOB;
+        break;
+    }
+    pSet->aValue[i] = entry;
+    if (entry.eType != SQLITEJSON_INSET_NUMERIC && entry.eType != SQLITEJSON_INSET_TEXT) continue;
+    h = entry.hash & (nSlot - 1);
+    while (pSet->aSlot[h].eType != SQLITEJSON_INSET_EMPTY) h = (h + 1) & (nSlot - 1);
+    pSet->aSlot[h] = entry;
+  }
+  return pSet;
+}
+
+/*
+** Check if hash set was built from values argv[0] .. argv[argc-1].
+** Argument iFirst of the function is argv[0]. SQLite keeps auxiliary data
+** of argument below 32 only while argument is constant, so value with
+** auxiliary data set by sqlitejsonInFunc is not compared.
+** Return 1 if set has the same values, otherwise 0
+*/
+static int sqlitejsonInSetSame(
+  SqlitejsonInSet *pSet,
+  sqlite3_context *context,
+  int iFirst,
+  int argc,
+  sqlite3_value **argv
+){
+  int i;
+  if (pSet->nValue != argc) return 0;
+  for (i = 0; i < argc; i++)
+  {
+    SqlitejsonInEntry *p = &pSet->aValue[i];
+    if (iFirst + i < 32 && sqlite3_get_auxdata(context, iFirst + i)) continue;
+    switch (sqlite3_value_type(argv[i]))
+    {
+      case SQLITE_NULL:
+        if (p->eType != SQLITEJSON_INSET_NULL) return 0;
+        break;
+      case SQLITE_INTEGER:
+      case SQLITE_FLOAT:
+        if (p->eType != SQLITEJSON_INSET_NUMERIC || p->r != sqlite3_value_double(argv[i])) return 0;
+        break;
+      case SQLITE_TEXT:
+        if (p->eType != SQLITEJSON_INSET_TEXT) return 0;
+        if (p->n != sqlite3_value_bytes(argv[i])) return 0;
+        if (memcmp(p->z, sqlite3_value_text(argv[i]), p->n) != 0) return 0;
+        break;
+      default:
+        if (p->eType != SQLITEJSON_INSET_BLOB) return 0;
+        break;
+    }
+  }
+  return 1;
+}
+
+/*
+** Check if value under json_obj is in hash set.
+** JSON string without escapes is hashed in place, escaped strings are
+** unescaped first. Return 1 if found, otherwise 0
+*/
+static int sqlitejsonInSetContains(SqlitejsonInSet *pSet, JsonGetCursor json_obj){
+  SqlitejsonInEntry probe;
+  unsigned h;
+  memset(&probe, 0, sizeof(probe));
+  switch (json_obj.type)
+  {
+    case JSONGET_BOOLEAN:
+    case JSONGET_INTEGER:
+    {
+      int val = 0;
+      jsonget_int(json_obj, &val);
+      probe.eType = SQLITEJSON_INSET_NUMERIC;
+      probe.r = val;
+      break;
+    }
+    case JSONGET_DOUBLE:
+      probe.eType = SQLITEJSON_INSET_NUMERIC;
+      jsonget_double(json_obj, &probe.r);
+      break;
+    case JSONGET_STRING:
+    case JSONGET_ARRAY:
+    case JSONGET_OBJECT:
+    {
+      int i;
+      if (!jsonget_raw(json_obj, &probe.z, &probe.n)) return 0;
+      if (json_obj.type == JSONGET_STRING)
+      {
+        // Strip quotes
+        probe.z++;
+        probe.n -= 2;
+        for (i = 0; i < probe.n && probe.z[i] != '\\'; i++);
+        if (i < probe.n)
+        {
+          // String has escape sequences, hash unescaped value
+          char static_buffer[SQLITEJSON_STATIC_STRING_BUFFER_SIZE];
+          char *buf = static_buffer;
+          int real_len;
+          jsonget_string(json_obj, buf, sizeof(static_buffer), &real_len);
+          if (real_len >= (int)sizeof(static_buffer))
+          {
+            buf = sqlite3_malloc(real_len + 1);
+            if (!buf) return 0;
+            jsonget_string(json_obj, buf, real_len + 1, &real_len);
+          }
+          probe.hash = sqlitejsonHashBytes(buf, real_len);
+          if (buf != static_buffer) sqlite3_free(buf);
+          probe.z = 0;
+        }
+      }
+      if (probe.z) probe.hash = sqlitejsonHashBytes(probe.z, probe.n);
+      probe.eType = SQLITEJSON_INSET_TEXT;
+      break;
+    }
+    default:
+      return 0;
+  }
+  if (probe.eType == SQLITEJSON_INSET_NUMERIC) probe.hash = sqlitejsonHashNumber(probe.r);
+
+  h = probe.hash & (pSet->nSlot - 1);
+  while (pSet->aSlot[h].eType != SQLITEJSON_INSET_EMPTY)
+  {
+    SqlitejsonInEntry *p = &pSet->aSlot[h];
+    if (p->eType == probe.eType && p->hash == probe.hash)
+    {
+      if (p->eType == SQLITEJSON_INSET_NUMERIC) 
+      {
+        if (p->r == probe.r) return 1;
+      }
+      else if (jsonget_string_ncompare(json_obj, p->z, p->n) == 0) return 1;
+    }
+    h = (h + 1) & (pSet->nSlot - 1);
+  }
+  return 0;
+}
+
+/*
+** Implementation of the json_in(json, path_count, path_element1, ..., value1, value2, ...) function
+** json_in(doc, 1, 'country', 'DE', 'FR') is the same as json_get(doc, 'country') IN ('DE', 'FR')
+** Hash set of values is built once per statement and kept as auxiliary data
+** of path_count argument: SQLite keeps auxiliary data between rows only for
+** constant arguments below 32, and value arguments follow the path, which
+** may be long. Each value argument below 32 is marked with auxiliary data
+** too, so values that are not constant are compared with the set on every
+** row, and set is rebuilt when they changed
+** Parser rewrites "->" expression on the left of IN-list of literals to this function
+*/
+static void sqlitejsonInFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  int path_count = argc >= 2 ? sqlite3_value_int(argv[1]) : -1;
+  if (path_count < 0 || argc < path_count + 3)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+    SqlitejsonDoc doc;
+    int first_value = path_count + 2;
+    SqlitejsonInSet *pSet;
+    JsonGetCursor json_obj;
+
+    if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+    json_obj = sqlitejsonDocMovePath(&doc, context, 2, path_count, argv + 2);
+    if (jsonget_isnull(json_obj))
+    {
+      sqlite3_result_null(context);
+      return;
+    }
+
+    pSet = (SqlitejsonInSet*)sqlite3_get_auxdata(context, 1);
+    if (!pSet || !sqlitejsonInSetSame(pSet, context, first_value, argc - first_value, argv + first_value))
+    {
+      int i;
+      pSet = sqlitejsonInSetNew(argc - first_value, argv + first_value);
+      if (!pSet)
+      {
+        sqlite3_result_error_nomem(context);
+        return;
+      }
+      sqlite3_set_auxdata(context, 1, pSet, sqlitejsonDestructor);
+      pSet = (SqlitejsonInSet*)sqlite3_get_auxdata(context, 1);
+      if (!pSet)
+      {
+        sqlite3_result_error_nomem(context);
+        return;
+      }
+      // Mark value arguments, mark of argument that is not constant is dropped after call
+      for (i = first_value; i < argc && i < 32; i++) sqlite3_set_auxdata(context, i, pSet, 0);
+    }
+
+    if (sqlitejsonInSetContains(pSet, json_obj)) sqlite3_result_int(context, 1);
+    else if (pSet->hasNull) sqlite3_result_null(context);
+    else sqlite3_result_int(context, 0);
+  }
+}
+
+/*
+** Location of path target inside json text, used by modification functions.
+** All pointers point into original json text
+*/
+typedef struct SqlitejsonTarget SqlitejsonTarget;
+struct SqlitejsonTarget {
+  JsonGetCursor parent;    /* Object or array containing target */
+  JsonGetCursor elem;      /* Array element or object pair of target, INVALID if missing */
+  const char *zStart;      /* Start of target value */
+  const char *zEnd;        /* End of target value */
+  const char *zElemEnd;    /* End of target element or pair */
+  const char *zPrevEnd;    /* End of previous element, NULL if target is first */
+  const char *zNext;       /* Start of next element, NULL if target is last */
+  const char *zClose;      /* Closing } or ] of parent */
+  int bEmpty;              /* True if parent has no elements */
+  int bAppend;             /* True if missing target can be added to the end of parent */
+};
+
+/*
+** Find target of path element pLast inside parent object or array
+** Elements of parent are walked once with jsonget_move_next.
+** Return 0 if parent is not object or array or path element doesn't fit it
+*/
+static int sqlitejsonFindTarget(
+  JsonGetCursor parent,
+  sqlite3_value *pLast,
+  SqlitejsonTarget *pTarget
+){
+  JsonGetCursor cur, prev;
+  const char *key = 0;
+  int index = 0, i;
+  memset(pTarget, 0, sizeof(*pTarget));
+  pTarget->parent = parent;
+  if (sqlite3_value_type(pLast) == SQLITE_INTEGER)
+  {
+    if (parent.type != JSONGET_ARRAY) return 0;
+    index = sqlite3_value_int(pLast);
+    if (index < 0)
+    {
+      // Resolve negative index to element from the start
+      index += jsonget_array_count(parent);
+      if (index < 0) return 0;
+    }
+  }
+  else if (sqlite3_value_type(pLast) == SQLITE_TEXT)
+  {
+    if (parent.type != JSONGET_OBJECT) return 0;
+    key = (const char*)sqlite3_value_text(pLast);
+  }
+  else return 0;
+
+  prev.type = JSONGET_INVALID;
+  cur = jsonget_move_index(parent, 0);
+  if (cur.type == JSONGET_PAIR && !sqlitejsonRawEnd(cur)) cur.type = JSONGET_INVALID; // empty object
+  for (i = 0; cur.type != JSONGET_INVALID; i++)
+  {
+    if (key ? jsonget_string_ncompare(cur, key, sqlite3_value_bytes(pLast)) == 0 : i == index)
+    {
+      JsonGetCursor val = cur.type == JSONGET_PAIR ? jsonget_move_pair_value(cur) : cur;
+      JsonGetCursor next = jsonget_move_next(cur);
+      pTarget->elem = cur;
+      pTarget->zStart = val.pstr;
+      pTarget->zEnd = pTarget->zElemEnd = sqlitejsonRawEnd(val);
+      if (prev.type != JSONGET_INVALID) pTarget->zPrevEnd = sqlitejsonRawEnd(prev);
+      if (next.type != JSONGET_INVALID && (next.type != JSONGET_PAIR || sqlitejsonRawEnd(next)))
+      {
+        pTarget->zNext = next.pstr;
+      }
+      return pTarget->zEnd != 0;
+    }
+    prev = cur;
+    cur = jsonget_move_next(cur);
+  }
+
+  // Target is missing, it can be added before closing } or ]
+  pTarget->bEmpty = i == 0;
+  pTarget->bAppend = key != 0 || i == index;
+  pTarget->zClose = sqlitejsonRawEnd(parent);
+  if (!pTarget->zClose) return 0;
+  pTarget->zClose--;
+  return 1;
+}
+
+/*
+** Modes of modification function, passed through sqlite3_user_data()
+*/
+#define SQLITEJSON_MODIFY_SET      1   /* Replace existing or insert missing value */
+#define SQLITEJSON_MODIFY_REPLACE  2   /* Replace existing value */
+#define SQLITEJSON_MODIFY_INSERT   3   /* Insert missing value */
+#define SQLITEJSON_MODIFY_REMOVE   4   /* Remove existing value */
+
+/*
+** Implementation of the modification functions
+**   json_set(json, path_element1, ..., value)
+**   json_replace(json, path_element1, ..., value)
+**   json_insert(json, path_element1, ..., value)
+**   json_remove(json, path_element1, ...)
+** Target is found with jsonget cursors, result is built in one pass into
+** exactly sized buffer: prefix of json, new value, suffix of json.
+** Missing key is added to the end of object, missing index equal to
+** array length is added to the end of array.
+** If parent of target doesn't exist, json is returned unchanged
+*/
+static void sqlitejsonModifyFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  int mode = SQLITEJSON_PTR_TO_INT(sqlitejsonFuncArg(context));
+  int path_count = mode == SQLITEJSON_MODIFY_REMOVE ? argc - 1 : argc - 2;
+  if (path_count < 0)
+  {
+    sqlite3_result_error(context, "Invalid number of arguments", -1);
+  }
+  else if (sqlite3_value_type(argv[0]) == SQLITE_NULL) sqlite3_result_null(context);
+  else
+  {
+    SqlitejsonDoc doc;
+    const char *json;
+    int json_len;
+    JsonGetCursor root;
+    SqlitejsonTarget target;
+    SqlitejsonBuf buf;
+    char zNum[32];
+    const char *zVal = 0, *zCut, *zResume;
+    int nVal = 0, bString = 0, nKey = 0, bKey = 0, bComma = 0, nOut, rc;
+
+    if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+    json = doc.zJson;
+    json_len = doc.nJson;
+    root = jsonget(json);
+    if (root.type == JSONGET_INVALID)
+    {
+      sqlite3_result_value(context, argv[0]);
+      return;
+    }
+    if (mode != SQLITEJSON_MODIFY_REMOVE
+        && (rc = sqlitejsonValueJson(context, argv[argc - 1], zNum, &zVal, &nVal, &bString)) <= 0)
+    {
+      if (rc == 0) sqlite3_result_error(context, "Blob value is not valid json", -1);
+      return;
+    }
+
+    if (path_count == 0)
+    {
+      // Root itself is target
+      const char *zRootEnd = sqlitejsonRawEnd(root);
+      memset(&target, 0, sizeof(target));
+      target.zStart = root.pstr;
+      target.zEnd = target.zElemEnd = zRootEnd ? zRootEnd : json + json_len;
+      target.elem = root;
+      if (mode == SQLITEJSON_MODIFY_REMOVE)
+      {
+        sqlite3_result_null(context);
+        return;
+      }
+    }
+    else
+    {
+      JsonGetCursor parent = sqlitejsonDocMovePath(&doc, context, 1, path_count - 1, argv + 1);
+      if (!sqlitejsonFindTarget(parent, argv[path_count], &target))
+      {
+        sqlite3_result_value(context, argv[0]);
+        return;
+      }
+    }
+
+    // Which part of json is replaced and with what
+    if (target.elem.type != JSONGET_INVALID)
+    {
+      if (mode == SQLITEJSON_MODIFY_INSERT)
+      {
+        sqlite3_result_value(context, argv[0]);
+        return;
+      }
+      if (mode == SQLITEJSON_MODIFY_REMOVE)
+      {
+        // Remove element with one of commas around it
+        zVal = 0;
+        nVal = 0;
+        if (target.zNext)
+        {
+          zCut = target.elem.pstr;
+          zResume = target.zNext;
+        }
+        else if (target.zPrevEnd)
+        {
+          zCut = target.zPrevEnd;
+          zResume = target.zElemEnd;
+        }
+        else
+        {
+          zCut = target.elem.pstr;
+          zResume = target.zElemEnd;
+        }
+      }
+      else
+      {
+        zCut = target.zStart;
+        zResume = target.zEnd;
+      }
+    }
+    else
+    {
+      if (mode == SQLITEJSON_MODIFY_REPLACE || mode == SQLITEJSON_MODIFY_REMOVE || !target.bAppend)
+      {
+        sqlite3_result_value(context, argv[0]);
+        return;
+      }
+      zCut = zResume = target.zClose;
+      bComma = !target.bEmpty;
+      if (target.parent.type == JSONGET_OBJECT)
+      {
+        bKey = 1;
+        nKey = sqlitejsonStringLength((const char*)sqlite3_value_text(argv[path_count]),
+                                      sqlite3_value_bytes(argv[path_count])) + 1;
+      }
+    }
+
+    // Output size is known before writing
+    nOut = (int)(zCut - json) + bComma + nKey 
+         + (bString ? sqlitejsonStringLength(zVal, nVal) : nVal)
+         + (int)(json + json_len - zResume);
+    sqlitejsonBufInit(&buf);
+    if (!sqlitejsonBufReserve(&buf, nOut))
+    {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    sqlitejsonBufAppend(&buf, json, (int)(zCut - json));
+    if (bComma) sqlitejsonBufAppendChar(&buf, ',');
+    if (bKey)
+    {
+      sqlitejsonBufAppendString(&buf, (const char*)sqlite3_value_text(argv[path_count]),
+                                sqlite3_value_bytes(argv[path_count]));
+      sqlitejsonBufAppendChar(&buf, ':');
+    }
+    if (bString) sqlitejsonBufAppendString(&buf, zVal, nVal);
+    else sqlitejsonBufAppend(&buf, zVal, nVal);
+    sqlitejsonBufAppend(&buf, zResume, (int)(json + json_len - zResume));
+    assert(buf.bOom || buf.n == nOut);
+    sqlitejsonBufResult(&buf, context);
+  }
+}
+
+/*
+** Append n bytes of z to buffer p and return n. If p is NULL, only the
+** length is returned, so the same walk can be used to size the output
+*/
+static int sqlitejsonOut(SqlitejsonBuf *p, const char *z, int n){
+  if (p) sqlitejsonBufAppend(p, z, n);
+  return n;
+}
+
+/* Return raw key of object pair including quotes, 0 if pair is invalid */
+static int sqlitejsonPairRawKey(JsonGetCursor pair, const char **pz, int *pn){
+  return pair.type == JSONGET_PAIR && *pair.pstr == '"' && jsonget_raw(pair, pz, pn);
+}
+
+/*
+** Decoded key of object pair. Key without escapes is returned in place,
+** otherwise it is decoded into zSpace of nSpace bytes or into heap memory
+** returned in *pzFree. Return NULL if pair is invalid or out of memory
+*/
+static const char *sqlitejsonPairKey(
+  JsonGetCursor pair,
+  char *zSpace,
+  int nSpace,
+  int *pn,
+  char **pzFree
+){
+  const char *raw;
+  int len;
+  *pzFree = 0;
+  if (!sqlitejsonPairRawKey(pair, &raw, &len) || len < 2) return 0;
+  if (!memchr(raw, '\\', len))
+  {
+    *pn = len - 2;
+    return raw + 1;
+  }
+  jsonget_string(pair, zSpace, nSpace, pn);
+  if (*pn < nSpace) return zSpace;
+  *pzFree = sqlite3_malloc(*pn + 1);
+  if (!*pzFree) return 0;
+  jsonget_string(pair, *pzFree, *pn + 1, pn);
+  return *pzFree;
+}
+
+/* Move to value of object key given by pair of other object */
+static JsonGetCursor sqlitejsonMoveSameKey(JsonGetCursor obj, JsonGetCursor pair, int *pbOom){
+  char zSpace[128];
+  char *zFree;
+  int n = 0;
+  const char *zKey = sqlitejsonPairKey(pair, zSpace, sizeof(zSpace), &n, &zFree);
+  JsonGetCursor ret;
+  ret.type = JSONGET_INVALID;
+  ret.pstr = 0;
+  if (zKey) ret = jsonget_move_nkey(obj, zKey, n);
+  else *pbOom = 1;
+  sqlite3_free(zFree);
+  return ret;
+}
+
+/*
+** Move to value of object obj under key of pair of other object. *pNext is
+** pair of obj expected to hold the key: objects with keys in the same order
+** are matched in lockstep by raw key, *pNext is moved past the match. Other
+** keys are looked up from the start of obj
+*/
+static JsonGetCursor sqlitejsonMatchKey(
+  JsonGetCursor obj,
+  JsonGetCursor *pNext,
+  JsonGetCursor pair,
+  int *pbOom
+){
+  const char *raw, *next_raw;
+  int len, next_len;
+  if (sqlitejsonPairRawKey(pair, &raw, &len) && sqlitejsonPairRawKey(*pNext, &next_raw, &next_len)
+   && len == next_len && memcmp(raw, next_raw, len) == 0)
+  {
+    JsonGetCursor value = jsonget_move_pair_value(*pNext);
+    *pNext = jsonget_move_next(*pNext);
+    return value;
+  }
+  return sqlitejsonMoveSameKey(obj, pair, pbOom);
+}
+
+/*
+** Write RFC 7386 merge of patch into target to buffer p, or only count
+** output length if p is NULL. Return length of output.
+** Pairs of target which are not in patch are copied as raw byte ranges,
+** objects are merged recursively, other patch values replace target.
+** Keys in the same order are matched in lockstep, other keys are looked
+** up, so cost grows with product of object sizes only for unordered keys.
+** Output has no whitespace between merged pairs
+*/
+static int sqlitejsonMergePatch(
+  SqlitejsonBuf *p,
+  JsonGetCursor target,
+  JsonGetCursor patch,
+  int *pbOom
+){
+  JsonGetCursor pair, next, value, missing;
+  const char *raw;
+  int len, n = 0, bFirst = 1;
+
+  if (patch.type != JSONGET_OBJECT)
+  {
+    if (!jsonget_raw(patch, &raw, &len)) return 0;
+    return sqlitejsonOut(p, raw, len);
+  }
+
+  n += sqlitejsonOut(p, "{", 1);
+  if (target.type == JSONGET_OBJECT)
+  {
+    next = jsonget_move_index(patch, 0);
+    for (pair = jsonget_move_index(target, 0); sqlitejsonPairRawKey(pair, &raw, &len); pair = jsonget_move_next(pair))
+    {
+      JsonGetCursor patch_value = sqlitejsonMatchKey(patch, &next, pair, pbOom);
+      if (patch_value.type == JSONGET_INVALID)
+      {
+        // Untouched pair is copied as is
+        const char *end = sqlitejsonRawEnd(pair);
+        if (!end) break;
+        if (!bFirst) n += sqlitejsonOut(p, ",", 1);
+        n += sqlitejsonOut(p, pair.pstr, (int)(end - pair.pstr));
+      }
+      else if (!jsonget_isnull(patch_value))
+      {
+        if (!bFirst) n += sqlitejsonOut(p, ",", 1);
+        n += sqlitejsonOut(p, raw, len);
+        n += sqlitejsonOut(p, ":", 1);
+        n += sqlitejsonMergePatch(p, jsonget_move_pair_value(pair), patch_value, pbOom);
+      }
+      else continue; // null removes key
+      bFirst = 0;
+    }
+  }
+
+  // Keys of patch missing in target are added, nested nulls are dropped
+  missing = target;
+  missing.type = JSONGET_INVALID;
+  if (target.type == JSONGET_OBJECT) next = jsonget_move_index(target, 0);
+  for (pair = jsonget_move_index(patch, 0); sqlitejsonPairRawKey(pair, &raw, &len); pair = jsonget_move_next(pair))
+  {
+    value = jsonget_move_pair_value(pair);
+    if (value.type == JSONGET_INVALID) break;
+    if (target.type == JSONGET_OBJECT && sqlitejsonMatchKey(target, &next, pair, pbOom).type != JSONGET_INVALID) continue;
+    if (jsonget_isnull(value)) continue;
+    if (!bFirst) n += sqlitejsonOut(p, ",", 1);
+    n += sqlitejsonOut(p, raw, len);
+    n += sqlitejsonOut(p, ":", 1);
+    n += sqlitejsonMergePatch(p, missing, value, pbOom);
+    bFirst = 0;
+  }
+  n += sqlitejsonOut(p, "}", 1);
+  return n;
+}
+
+/*
+** Implementation of json_patch(target, patch)
+** Apply RFC 7386 merge patch to target json. Both documents are walked with
+** cursors twice: first walk counts output length, second walk writes merged
+** json into exactly sized buffer. No intermediate tree is built.
+** Return NULL if any argument is NULL or is not valid json
+*/
+static void sqlitejsonPatchFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonDoc doc0, doc1;
+  JsonGetCursor target, patch;
+  SqlitejsonBuf buf;
+  int n, bOom = 0;
+  assert(argc == 2);
+  if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  if (!sqlitejsonDocInit(&doc0, context, argv[0]) || !sqlitejsonDocInit(&doc1, context, argv[1])) return;
+  target = jsonget(doc0.zJson);
+  patch = jsonget(doc1.zJson);
+  if (target.type == JSONGET_INVALID || patch.type == JSONGET_INVALID)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  n = sqlitejsonMergePatch(0, target, patch, &bOom);
+  sqlitejsonBufInit(&buf);
+  if (bOom || !sqlitejsonBufReserve(&buf, n))
+  {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  sqlitejsonMergePatch(&buf, target, patch, &bOom);
+  if (bOom)
+  {
+    sqlitejsonBufReset(&buf);
+    buf.bOom = 1;
+  }
+  assert(bOom || buf.n == n);
+  sqlitejsonBufResult(&buf, context);
+}
+
+/* Return 1 if raw json text of both cursors is byte to byte equal */
+static int sqlitejsonRawEqual(JsonGetCursor a, JsonGetCursor b){
+  const char *za, *zb;
+  int na, nb;
+  if (!jsonget_raw(a, &za, &na) || !jsonget_raw(b, &zb, &nb)) return 0;
+  return na == nb && memcmp(za, zb, na) == 0;
+}
+
+/*
+** Write merge patch which turns object old_obj into object new_obj to
+** buffer p. Number of patch members is returned in *pnMember.
+** Members with byte to byte equal raw values are skipped without descending.
+** Nested objects are diffed once into buffer of their own, which is copied
+** to p only if nested patch is not empty. Any other changed value is copied
+*/
+static void sqlitejsonDiffObject(
+  SqlitejsonBuf *p,
+  JsonGetCursor old_obj,
+  JsonGetCursor new_obj,
+  int *pnMember,
+  int *pbOom
+){
+  JsonGetCursor pair, next, old_value, new_value;
+  const char *raw;
+  int len;
+  *pnMember = 0;
+  sqlitejsonBufAppendChar(p, '{');
+
+  // Removed and changed members of old object
+  next = jsonget_move_index(new_obj, 0);
+  for (pair = jsonget_move_index(old_obj, 0); sqlitejsonPairRawKey(pair, &raw, &len); pair = jsonget_move_next(pair))
+  {
+    old_value = jsonget_move_pair_value(pair);
+    new_value = sqlitejsonMatchKey(new_obj, &next, pair, pbOom);
+    if (old_value.type == JSONGET_INVALID) break;
+    if (sqlitejsonRawEqual(old_value, new_value)) continue;
+    if (new_value.type == JSONGET_OBJECT && old_value.type == JSONGET_OBJECT)
+    {
+      // Values differ only in formatting if nested patch is empty
+      SqlitejsonBuf child;
+      int nMember;
+      sqlitejsonBufInit(&child);
+      sqlitejsonDiffObject(&child, old_value, new_value, &nMember, pbOom);
+      if (child.bOom) *pbOom = 1;
+      if (nMember)
+      {
+        if ((*pnMember)++) sqlitejsonBufAppendChar(p, ',');
+        sqlitejsonBufAppend(p, raw, len);
+        sqlitejsonBufAppendChar(p, ':');
+        sqlitejsonBufAppend(p, child.z, child.n);
+      }
+      sqlitejsonBufReset(&child);
+      continue;
+    }
+    if ((*pnMember)++) sqlitejsonBufAppendChar(p, ',');
+    sqlitejsonBufAppend(p, raw, len);
+    sqlitejsonBufAppendChar(p, ':');
+    if (new_value.type == JSONGET_INVALID) sqlitejsonBufAppend(p, "null", 4);
+    else if (jsonget_raw(new_value, &raw, &len)) sqlitejsonBufAppend(p, raw, len);
+  }
+
+  // Added members of new object
+  next = jsonget_move_index(old_obj, 0);
+  for (pair = jsonget_move_index(new_obj, 0); sqlitejsonPairRawKey(pair, &raw, &len); pair = jsonget_move_next(pair))
+  {
+    const char *end = sqlitejsonRawEnd(pair);
+    if (!end) break;
+    if (sqlitejsonMatchKey(old_obj, &next, pair, pbOom).type != JSONGET_INVALID) continue;
+    if ((*pnMember)++) sqlitejsonBufAppendChar(p, ',');
+    sqlitejsonBufAppend(p, pair.pstr, (int)(end - pair.pstr));
+  }
+  sqlitejsonBufAppendChar(p, '}');
+}
+
+/*
+** Implementation of json_diff(old, new)
+** Return RFC 7386 merge patch which turns old json into new one when applied
+** with json_patch. Members of objects with keys in the same order are
+** matched in lockstep, other keys are looked up. Unchanged members are found
+** by comparing raw bytes of values, so patch size depends on size of change,
+** not on size of documents. If old or new json is not an object, new json
+** itself is the patch.
+** Return NULL if any argument is NULL or is not valid json
+*/
+static void sqlitejsonDiffFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonDoc doc0, doc1;
+  JsonGetCursor old_obj, new_obj;
+  SqlitejsonBuf buf;
+  int nMember, bOom = 0;
+  assert(argc == 2);
+  if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  if (!sqlitejsonDocInit(&doc0, context, argv[0]) || !sqlitejsonDocInit(&doc1, context, argv[1])) return;
+  old_obj = jsonget(doc0.zJson);
+  new_obj = jsonget(doc1.zJson);
+  if (old_obj.type == JSONGET_INVALID || new_obj.type == JSONGET_INVALID)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  if (old_obj.type != JSONGET_OBJECT || new_obj.type != JSONGET_OBJECT)
+  {
+    const char *raw;
+    int len;
+    if (jsonget_raw(new_obj, &raw, &len)) sqlite3_result_text(context, raw, len, SQLITE_TRANSIENT);
+    else sqlite3_result_null(context);
+    return;
+  }
+  sqlitejsonBufInit(&buf);
+  sqlitejsonDiffObject(&buf, old_obj, new_obj, &nMember, &bOom);
+  if (bOom)
+  {
+    sqlitejsonBufReset(&buf);
+    buf.bOom = 1;
+  }
+  sqlitejsonBufResult(&buf, context);
+}
+
+/* Json representation of one json_object() or json_array() argument */
+typedef struct SqlitejsonBuildArg SqlitejsonBuildArg;
+struct SqlitejsonBuildArg {
+  const char *z;
+  int n;
+  int bString;
+  char zNum[32];
+};
+
+/*
+** Implementation of the json_object(key1, value1, ...) and
+** json_array(value1, ...) functions, json_object is selected by user data.
+** The first pass over arguments computes exact output length, the second
+** writes into buffer of that size which is handed off to the result.
+** Values are converted as in json_set: blobs (json_raw() and "->" values
+** inside constructor calls) are spliced as raw json, blob which is not
+** json is an error. Every argument is converted once, in the first pass,
+** so the second pass writes exactly what was measured
+*/
+static void sqlitejsonBuildFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  int bObject = sqlitejsonFuncArg(context) != 0;
+  SqlitejsonBuf buf;
+  SqlitejsonBuildArg aStatic[8];
+  SqlitejsonBuildArg *aArg = aStatic;
+  int i, rc, nOut = 2;
+
+  if (bObject && (argc & 1))
+  {
+    sqlite3_result_error(context, "json_object() requires an even number of arguments", -1);
+    return;
+  }
+  if (argc > (int)(sizeof(aStatic) / sizeof(aStatic[0])))
+  {
+    aArg = sqlite3_malloc(argc * (int)sizeof(SqlitejsonBuildArg));
+    if (!aArg)
+    {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+  }
+  sqlitejsonBufInit(&buf);
+  for (i = 0; i < argc; i++)
+  {
+    SqlitejsonBuildArg *pArg = &aArg[i];
+    if (bObject && !(i & 1) && sqlite3_value_type(argv[i]) != SQLITE_TEXT)
+    {
+      sqlite3_result_error(context, "json_object() keys must be text", -1);
+      goto build_end;
+    }
+    rc = sqlitejsonValueJson(context, argv[i], pArg->zNum, &pArg->z, &pArg->n, &pArg->bString);
+    if (rc <= 0)
+    {
+      if (rc == 0) sqlite3_result_error(context, "Blob value is not valid json", -1);
+      goto build_end;
+    }
+    nOut += (pArg->bString ? sqlitejsonStringLength(pArg->z, pArg->n) : pArg->n) + 1; // value and , or :
+  }
+  if (argc) nOut--; // no separator after the last value
+
+  if (!sqlitejsonBufReserve(&buf, nOut))
+  {
+    sqlite3_result_error_nomem(context);
+    goto build_end;
+  }
+  sqlitejsonBufAppendChar(&buf, bObject ? '{' : '[');
+  for (i = 0; i < argc; i++)
+  {
+    if (i) sqlitejsonBufAppendChar(&buf, bObject && (i & 1) ? ':' : ',');
+    if (aArg[i].bString) sqlitejsonBufAppendString(&buf, aArg[i].z, aArg[i].n);
+    else sqlitejsonBufAppend(&buf, aArg[i].z, aArg[i].n);
+  }
+  sqlitejsonBufAppendChar(&buf, bObject ? '}' : ']');
+  assert(buf.bOom || buf.n == nOut);
+  sqlitejsonBufResult(&buf, context);
+
+build_end:
+  sqlitejsonBufReset(&buf);
+  if (aArg != aStatic) sqlite3_free(aArg);
+}
+
+/*
+** Implementation of json_minify(json)
+** Return json without whitespace outside of strings. Already minified json
+** is returned as is without copying, invalid json is returned unchanged
+*/
+static void sqlitejsonMinifyFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonDoc doc;
+  int json_len, n = 0;
+  JsonGetCursor root;
+  SqlitejsonBuf buf;
+  assert(argc == 1);
+  if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+  {
+    sqlite3_result_null(context);
+    return;
+  }
+  if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+  json_len = doc.nJson;
+  root = jsonget(doc.zJson);
+  sqlitejsonBufInit(&buf);
+  if (root.type == JSONGET_INVALID || !sqlitejsonBufReserve(&buf, json_len + 1))
+  {
+    if (buf.bOom) sqlite3_result_error_nomem(context);
+    else sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  if (!jsonget_minify(root, buf.z, json_len + 1, &n)
+   || (n == json_len && sqlite3_value_type(argv[0]) == SQLITE_TEXT))
+  {
+    sqlitejsonBufReset(&buf);
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  buf.n = n;
+  sqlitejsonBufResult(&buf, context);
+}
+
+/*
+** Key of encoded object element collected while index is built
+*/
+typedef struct SqlitejsonKeyRef SqlitejsonKeyRef;
+struct SqlitejsonKeyRef {
+  unsigned hash;           /* Hash of decoded key */
+  unsigned key_offset;     /* Text offset of key */
+  unsigned elem_offset;    /* Index offset of element where key id is written */
+};
+
+/*
+** Append index node of json_obj and nodes of its children to pIdx.
+** Keys of object elements are appended to pKeys as SqlitejsonKeyRef,
+** key ids are written to elements when all keys are known.
+** Return ref of json_obj in *pRef, 0 if json is malformed or out of memory.
+** Node elements are filled by offset, because pIdx may be reallocated
+** while children are appended
+*/
+static int sqlitejsonEncodeNode(
+  SqlitejsonBuf *pIdx,
+  SqlitejsonBuf *pKeys,
+  const char *zJson,
+  JsonGetCursor json_obj,
+  unsigned *pRef
+){
+  JsonGetCursor child;
+  int is_object = json_obj.type == JSONGET_OBJECT;
+  int elem_size = is_object ? 8 : 4;
+  int count, node, i;
+
+  if (json_obj.type == JSONGET_INVALID) return 0;
+  if (!is_object && json_obj.type != JSONGET_ARRAY)
+  {
+    *pRef = (unsigned)(json_obj.pstr - zJson);
+    return 1;
+  }
+  count = jsonget_array_count(json_obj);
+  node = pIdx->n;
+  if (!sqlitejsonBufGrow(pIdx, 8 + count * elem_size)) return 0;
+  pIdx->n += 8 + count * elem_size;
+  sqlitejsonPut4((unsigned char*)pIdx->z + node, (unsigned)(json_obj.pstr - zJson));
+  sqlitejsonPut4((unsigned char*)pIdx->z + node + 4, (unsigned)count);
+
+  child = jsonget_move_index(json_obj, 0);
+  for (i = 0; i < count; i++)
+  {
+    JsonGetCursor value = is_object ? jsonget_move_pair_value(child) : child;
+    unsigned ref;
+    if (is_object)
+    {
+      SqlitejsonKeyRef key_ref;
+      char zSpace[128];
+      char *zFree;
+      int n = 0;
+      const char *zKey = sqlitejsonPairKey(child, zSpace, sizeof(zSpace), &n, &zFree);
+      if (!zKey) return 0;
+      key_ref.hash = sqlitejsonHashBytes(zKey, n);
+      key_ref.key_offset = (unsigned)(child.pstr - zJson);
+      key_ref.elem_offset = (unsigned)(node + 8 + i * 8);
+      sqlite3_free(zFree);
+      sqlitejsonBufAppend(pKeys, (const char*)&key_ref, sizeof(key_ref));
+      if (pKeys->bOom) return 0;
+    }
+    if (!sqlitejsonEncodeNode(pIdx, pKeys, zJson, value, &ref)) return 0;
+    sqlitejsonPut4((unsigned char*)pIdx->z + node + 8 + i * elem_size + elem_size - 4, ref);
+    child = jsonget_move_next(child);
+  }
+  *pRef = (unsigned)node | SQLITEJSON_REF_NODE;
+  return 1;
+}
+
+/* Order of key refs: by hash, then by position in text */
+static int sqlitejsonKeyRefLess(const SqlitejsonKeyRef *a, const SqlitejsonKeyRef *b){
+  return a->hash < b->hash || (a->hash == b->hash && a->key_offset < b->key_offset);
+}
+
+/* Sort n key refs with bottom-up merge sort, aTmp has room for n refs */
+static void sqlitejsonSortKeyRefs(SqlitejsonKeyRef *a, SqlitejsonKeyRef *aTmp, int n){
+  int width, i;
+  for (width = 1; width < n; width *= 2)
+  {
+    for (i = 0; i < n; i += 2 * width)
+    {
+      int l = i, mid = i + width < n ? i + width : n, r = mid;
+      int end = i + 2 * width < n ? i + 2 * width : n, k = i;
+      while (l < mid && r < end) aTmp[k++] = sqlitejsonKeyRefLess(&a[r], &a[l]) ? a[r++] : a[l++];
+      while (l < mid) aTmp[k++] = a[l++];
+      while (r < end) aTmp[k++] = a[r++];
+    }
+    memcpy(a, aTmp, n * sizeof(*a));
+  }
+}
+
+/*
+** Build key table of encoded json into pTable from nRef sorted key refs and
+** write key id into each object element of index aIdx.
+** Equal keys have equal hash, so they are found among preceding keys with
+** the same hash. Return number of distinct keys, -1 if out of memory
+*/
+static int sqlitejsonBuildKeyTable(
+  SqlitejsonBuf *pTable,
+  const char *zJson,
+  SqlitejsonKeyRef *aRef,
+  int nRef,
+  unsigned char *aIdx
+){
+  int nKeys = 0, hash_start = 0, i;
+  for (i = 0; i < nRef; i++)
+  {
+    unsigned char entry[8];
+    int id;
+    if (i == 0 || aRef[i].hash != aRef[i - 1].hash) hash_start = nKeys;
+    for (id = hash_start; id < nKeys; id++)
+    {
+      // Compare key of aRef[i] with key of table entry id
+      JsonGetCursor pair, key_obj;
+      char zSpace[128];
+      char *zFree;
+      int n = 0, eq;
+      const char *zKey;
+      pair.pstr = zJson + aRef[i].key_offset;
+      pair.type = JSONGET_PAIR;
+      key_obj.pstr = zJson + sqlitejsonGet4((unsigned char*)pTable->z + 8 * id + 4);
+      key_obj.type = JSONGET_STRING;
+      zKey = sqlitejsonPairKey(pair, zSpace, sizeof(zSpace), &n, &zFree);
+      if (!zKey) return -1;
+      eq = jsonget_string_ncompare(key_obj, zKey, n) == 0;
+      sqlite3_free(zFree);
+      if (eq) break;
+    }
+    if (id == nKeys)
+    {
+      sqlitejsonPut4(entry, aRef[i].hash);
+      sqlitejsonPut4(entry + 4, aRef[i].key_offset);
+      sqlitejsonBufAppend(pTable, (const char*)entry, 8);
+      if (pTable->bOom) return -1;
+      nKeys++;
+    }
+    sqlitejsonPut4(aIdx + aRef[i].elem_offset, (unsigned)id);
+  }
+  return nKeys;
+}
+
+/*
+** Encode json text of nJson bytes: validate it with stream parser, text
+** after the value is an error, and build encoded json blob, which is
+** returned in *paOut (free with sqlite3_free) and *pnOut.
+** Return SQLITE_OK, SQLITE_NOMEM, or SQLITE_ERROR if json is not valid
+*/
+static int sqlitejsonEncode(const char *zJson, int nJson, unsigned char **paOut, int *pnOut){
+  SqlitejsonBuf text, idx, keys, table;
+  SqlitejsonKeyRef *aRef = 0;
+  unsigned root_ref = 0;
+  unsigned char *aOut = 0;
+  int n = 0, nOut = 0, nRef, nKeys = -1, rc = SQLITE_OK;
+  // jsonget reads only the first value and checks only what it reads
+  if (!sqlitejsonIsValid(zJson, nJson)) return SQLITE_ERROR;
+  sqlitejsonBufInit(&text);
+  sqlitejsonBufInit(&idx);
+  sqlitejsonBufInit(&keys);
+  sqlitejsonBufInit(&table);
+  if (!sqlitejsonBufReserve(&text, nJson + 1)) return SQLITE_NOMEM;
+  if (jsonget_minify(jsonget(zJson), text.z, nJson + 1, &n)) text.n = n;
+  if (!text.n || !sqlitejsonEncodeNode(&idx, &keys, text.z, jsonget(text.z), &root_ref))
+  {
+    rc = idx.bOom || keys.bOom ? SQLITE_NOMEM : SQLITE_ERROR;
+    goto encode_end;
+  }
+
+  // Key refs are copied out of byte buffer to sort them
+  nRef = keys.n / (int)sizeof(SqlitejsonKeyRef);
+  aRef = sqlite3_malloc(2 * nRef * (int)sizeof(SqlitejsonKeyRef) + 1);
+  if (aRef)
+  {
+    memcpy(aRef, keys.z, nRef * sizeof(SqlitejsonKeyRef));
+    sqlitejsonSortKeyRefs(aRef, aRef + nRef, nRef);
+    nKeys = sqlitejsonBuildKeyTable(&table, text.z, aRef, nRef, (unsigned char*)idx.z);
+  }
+  nOut = SQLITEJSON_ENCODED_HEADER + text.n + 1 + table.n + idx.n;
+  if (nKeys >= 0) aOut = sqlite3_malloc(nOut);
+  if (!aOut) rc = SQLITE_NOMEM;
+  else
+  {
+    unsigned char *p = aOut;
+    memcpy(p, SQLITEJSON_ENCODED_MAGIC, 3);
+    p[3] = SQLITEJSON_ENCODED_VERSION;
+    sqlitejsonPut4(p + 4, (unsigned)text.n);
+    sqlitejsonPut4(p + 8, root_ref);
+    sqlitejsonPut4(p + 12, (unsigned)nKeys);
+    p += SQLITEJSON_ENCODED_HEADER;
+    memcpy(p, text.z, text.n);
+    p[text.n] = 0;
+    p += text.n + 1;
+    memcpy(p, table.z, table.n);
+    memcpy(p + table.n, idx.z, idx.n);
+    *paOut = aOut;
+    *pnOut = nOut;
+  }
+
+encode_end:
+  sqlite3_free(aRef);
+  sqlitejsonBufReset(&text);
+  sqlitejsonBufReset(&idx);
+  sqlitejsonBufReset(&keys);
+  sqlitejsonBufReset(&table);
+  return rc;
+}
+
+/*
+** Implementation of json_encode(json)
+** Validate json with stream parser, text after the value is an error, and
+** return it as encoded json blob: minified text followed by key table and
+** navigation index. Path functions look up keys and indexes of encoded json
+** in index without parsing, other functions use its text in place.
+** Encoded json is returned as is, NULL is returned for NULL
+*/
+static void sqlitejsonEncodeFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonDoc doc;
+  unsigned char *aOut = 0;
+  int nOut = 0, rc;
+  assert(argc == 1);
+  if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+  if (!doc.zJson || doc.aIndex)
+  {
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  rc = sqlitejsonEncode(doc.zJson, doc.nJson, &aOut, &nOut);
+  if (rc == SQLITE_OK) sqlite3_result_blob(context, aOut, nOut, sqlitejsonDestructor);
+  else if (rc == SQLITE_NOMEM) sqlite3_result_error_nomem(context);
+  else sqlite3_result_error(context, "json_encode() argument is not valid json", -1);
+}
+
+/*
+** Implementation of json_text(json)
+** Return text of encoded or compressed json, other values are returned as
+** is. Text is stored in encoded json, so nothing is rendered
+*/
+static void sqlitejsonTextFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonDoc doc;
+  assert(argc == 1);
+  if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+  if (doc.aIndex || doc.bCompressed) sqlite3_result_text(context, doc.zJson, doc.nJson, SQLITE_TRANSIENT);
+  else sqlite3_result_value(context, argv[0]);
+}
+
+/*
+** Implementation of json_compress(json [, min_size])
+** Return json text or encoded json compressed with LZ77 codec. Values
+** shorter than min_size (SQLITEJSON_COMPRESS_MIN_SIZE by default) and values
+** which don't get smaller are returned as is, so function can be applied
+** to every value of column. Compressed json is returned as is
+*/
+static void sqlitejsonCompressFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonDoc doc;
+  const unsigned char *a;
+  unsigned char *aOut;
+  int n, nOut, min_size = SQLITEJSON_COMPRESS_MIN_SIZE;
+  assert(argc == 1 || argc == 2);
+  if (argc == 2) min_size = sqlite3_value_int(argv[1]);
+  if (!sqlitejsonDocInit(&doc, context, argv[0])) return;
+  if (!doc.zJson || doc.bCompressed)
+  {
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  if (jsonget(doc.zJson).type == JSONGET_INVALID)
+  {
+    sqlite3_result_error(context, "json_compress() argument is not valid json", -1);
+    return;
+  }
+  // Encoded json is compressed with its index, so it is encoded after decompression
+  a = doc.aIndex ? (const unsigned char*)sqlite3_value_blob(argv[0]) : (const unsigned char*)doc.zJson;
+  n = doc.aIndex ? sqlite3_value_bytes(argv[0]) : doc.nJson;
+  if (n < min_size || n <= SQLITEJSON_COMPRESSED_HEADER)
+  {
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  aOut = sqlite3_malloc(n);
+  if (!aOut)
+  {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  nOut = sqlitejsonLzCompress(a, n, aOut + SQLITEJSON_COMPRESSED_HEADER, n - SQLITEJSON_COMPRESSED_HEADER);
+  if (!nOut)
+  {
+    sqlite3_free(aOut);
+    sqlite3_result_value(context, argv[0]);
+    return;
+  }
+  memcpy(aOut, SQLITEJSON_COMPRESSED_MAGIC, 4);
+  sqlitejsonPut4(aOut + 4, (unsigned)n);
+  sqlite3_result_blob(context, aOut, SQLITEJSON_COMPRESSED_HEADER + nOut, sqlitejsonDestructor);
+}
+
+/*
+** Virtual table json_file: lines of NDJSON file, one json value per line
+**
+**   CREATE VIRTUAL TABLE temp.dump USING json_file('/data/dump.ndjson', a, user_id user.id);
+**   INSERT INTO t SELECT a, user_id FROM dump;
+**
+** The first argument is file name. Column "line" is text of line, rowid is
+** line number. Other arguments declare path columns: name optionally
+** followed by path of keys and indexes separated by '.', name itself is
+** the key if path is omitted. Path columns are extracted from line while
+** it is scanned, only for columns which are read by query.
+** File is opened through default VFS. If VFS can map it into memory, lines
+** are returned in place without copying, otherwise file is read in blocks.
+*/
+#define SQLITEJSON_FILE_BLOCK_SIZE  (1024*1024)  /* Size of read block */
+
+typedef struct SqlitejsonFileColumn SqlitejsonFileColumn;
+struct SqlitejsonFileColumn {
+  JsonGetStreamStep aStep[JSONGET_STREAM_MAX_PATH];  /* Path of value */
+  int nStep;                                         /* Number of path steps */
+};
+
+typedef struct SqlitejsonFileVtab SqlitejsonFileVtab;
+struct SqlitejsonFileVtab {
+  sqlite3_vtab base;
+  char *zPath;                  /* Full path name of file */
+  int nCol;                     /* Number of path columns */
+  SqlitejsonFileColumn *aCol;   /* Path columns */
+  char *zKeys;                  /* Storage of path keys */
+};
+
+typedef struct SqlitejsonFileCursor SqlitejsonFileCursor;
+struct SqlitejsonFileCursor {
+  sqlite3_vtab_cursor base;
+  sqlite3_file *pFile;          /* Open file */
+  sqlite3_int64 nFile;          /* Size of file */
+  const char *aMap;             /* Whole file mapped into memory, or NULL */
+  char *aBuf;                   /* Block of file if it is not mapped */
+  int nBufAlloc;                /* Allocated size of aBuf */
+  int nBuf;                     /* Number of valid bytes in aBuf */
+  sqlite3_int64 iBufOff;        /* File offset of aBuf[0] */
+  sqlite3_int64 iNext;          /* File offset of next line */
+  sqlite3_int64 iRowid;         /* Line number of current line */
+  const char *zLine;            /* Current line */
+  int nLine;                    /* Length of current line */
+  int bEof;                     /* True after the last line */
+};
+
+/*
+** Remove quotes around file name or column name, doubled quote inside is
+** unescaped. Name in brackets [...] has no escapes
+*/
+static void sqlitejsonFileDequote(char *z){
+  char q = z[0] == '[' ? ']' : z[0];
+  int i, j;
+  if (q != '\'' && q != '"' && q != '`' && q != ']') return;
+  for (i = 1, j = 0; z[i]; i++)
+  {
+    if (z[i] == q)
+    {
+      if (q == ']' || z[i + 1] != q) break;
+      i++;
+    }
+    z[j++] = z[i];
+  }
+  z[j] = 0;
+}
+
+/*
+** Parse path column declaration "name key1.key2" into pCol, keys are copied
+** to zKeys. Name may be quoted: "[first name] name.first". Return length of
+** column name or 0 if declaration is invalid
+*/
+static int sqlitejsonFileParseColumn(const char *z, SqlitejsonFileColumn *pCol, char *zKeys){
+  int nName = 0, i;
+  const char *zPath;
+  if (z[0] == '[' || z[0] == '"' || z[0] == '`')
+  {
+    char q = z[0] == '[' ? ']' : z[0];
+    for (nName = 1; z[nName]; nName++)
+    {
+      if (z[nName] != q) continue;
+      if (q == ']' || z[nName + 1] != q) break;
+      nName++; // doubled quote
+    }
+    if (!z[nName]) return 0;
+    nName++;
+  }
+  else while (z[nName] && !SQLITEJSON_IS_SPACE(z[nName])) nName++;
+  zPath = z + nName;
+  while (SQLITEJSON_IS_SPACE(*zPath)) zPath++;
+  if (!*zPath) zPath = z;
+  for (i = 0; zPath[i] && (zPath != z || i < nName); i++) zKeys[i] = zPath[i];
+  zKeys[i] = 0;
+  // Unquoted name is the key if path is omitted
+  if (zPath == z) sqlitejsonFileDequote(zKeys);
+
+  pCol->nStep = 0;
+  if (!nName) return 0;
+  for (;;)
+  {
+    JsonGetStreamStep *pStep = &pCol->aStep[pCol->nStep];
+    int n = 0, bIndex = 1, index = 0;
+    if (pCol->nStep == JSONGET_STREAM_MAX_PATH) return 0;
+    while (zKeys[n] && zKeys[n] != '.')
+    {
+      if (zKeys[n] < '0' || zKeys[n] > '9' || index > 100000000) bIndex = 0;
+      else index = index * 10 + zKeys[n] - '0';
+      n++;
+    }
+    if (n == 0) return 0;
+    pStep->key = bIndex ? 0 : zKeys;
+    pStep->key_length = n;
+    pStep->index = index;
+    pCol->nStep++;
+    if (!zKeys[n]) break;
+    zKeys += n + 1;
+  }
+  return nName;
+}
+
+/*
+** xCreate and xConnect of json_file, table has no storage of its own
+*/
+static int sqlitejsonFileConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc,
+  const char *const *argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  sqlite3_vfs *pVfs = sqlite3_vfs_find(0);
+  SqlitejsonFileVtab *pTab;
+  SqlitejsonBuf schema;
+  char *zName, *zCol;
+  int i, n, nKeys = 0, rc;
+
+  (void)pAux;
+  if (argc < 4)
+  {
+    *pzErr = sqlite3_mprintf("json_file: file name is missing");
+    return SQLITE_ERROR;
+  }
+  for (i = 4; i < argc; i++) nKeys += (int)strlen(argv[i]) + 1;
+  pTab = sqlite3_malloc(sizeof(*pTab));
+  if (!pTab) return SQLITE_NOMEM;
+  memset(pTab, 0, sizeof(*pTab));
+  pTab->nCol = argc - 4;
+  pTab->aCol = sqlite3_malloc(pTab->nCol * (int)sizeof(SqlitejsonFileColumn) + 1);
+  pTab->zKeys = sqlite3_malloc(nKeys + 1);
+  pTab->zPath = sqlite3_malloc(pVfs->mxPathname + 1);
+  zName = sqlite3_mprintf("%s", argv[3]);
+  if (!pTab->aCol || !pTab->zKeys || !pTab->zPath || !zName)
+  {
+    rc = SQLITE_NOMEM;
+    goto connect_error;
+  }
+  sqlitejsonFileDequote(zName);
+  rc = pVfs->xFullPathname(pVfs, zName, pVfs->mxPathname + 1, pTab->zPath);
+  if (rc != SQLITE_OK) goto connect_error;
+
+  sqlitejsonBufInit(&schema);
+  sqlitejsonBufAppend(&schema, "CREATE TABLE x(line", 19);
+  for (i = 0, nKeys = 0; i < pTab->nCol; i++)
+  {
+    n = sqlitejsonFileParseColumn(argv[4 + i], &pTab->aCol[i], pTab->zKeys + nKeys);
+    if (!n)
+    {
+      *pzErr = sqlite3_mprintf("json_file: invalid column %s", argv[4 + i]);
+      sqlitejsonBufReset(&schema);
+      rc = SQLITE_ERROR;
+      goto connect_error;
+    }
+    nKeys += (int)strlen(argv[4 + i]) + 1;
+    // Column name is quoted again, so it may be any text
+    zCol = sqlite3_mprintf("%.*s", n, argv[4 + i]);
+    if (zCol) sqlitejsonFileDequote(zCol);
+    sqlitejsonBufAppendFree(&schema, zCol ? sqlite3_mprintf(", \"%w\"", zCol) : 0);
+    sqlite3_free(zCol);
+  }
+  sqlitejsonBufAppend(&schema, ")", 2); // with terminating zero
+  rc = schema.bOom ? SQLITE_NOMEM : sqlite3_declare_vtab(db, schema.z);
+  sqlitejsonBufReset(&schema);
+  if (rc != SQLITE_OK) goto connect_error;
+  sqlite3_free(zName);
+  *ppVtab = &pTab->base;
+  return SQLITE_OK;
+
+connect_error:
+  sqlite3_free(zName);
+  sqlite3_free(pTab->aCol);
+  sqlite3_free(pTab->zKeys);
+  sqlite3_free(pTab->zPath);
+  sqlite3_free(pTab);
+  return rc;
+}
+
+static int sqlitejsonFileDisconnect(sqlite3_vtab *pVtab){
+  SqlitejsonFileVtab *pTab = (SqlitejsonFileVtab*)pVtab;
+  sqlite3_free(pTab->aCol);
+  sqlite3_free(pTab->zKeys);
+  sqlite3_free(pTab->zPath);
+  sqlite3_free(pTab);
+  return SQLITE_OK;
+}
+
+/*
+** Lines are only scanned in order, so every plan is a full scan
+*/
+static int sqlitejsonFileBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo){
+  (void)pVtab;
+  pInfo->estimatedCost = 1000000;
+  return SQLITE_OK;
+}
+
+static int sqlitejsonFileOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  SqlitejsonFileVtab *pTab = (SqlitejsonFileVtab*)pVtab;
+  sqlite3_vfs *pVfs = sqlite3_vfs_find(0);
+  SqlitejsonFileCursor *pCur;
+  int flags, rc;
+
+  pCur = sqlite3_malloc(sizeof(*pCur) + pVfs->szOsFile);
+  if (!pCur) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur) + pVfs->szOsFile);
+  pCur->pFile = (sqlite3_file*)&pCur[1];
+  // Not opened as main database, so VFS takes no locks and doesn't share
+  // file descriptor with connections that have the same file open
+  rc = pVfs->xOpen(pVfs, pTab->zPath, pCur->pFile, SQLITE_OPEN_READONLY | SQLITE_OPEN_TRANSIENT_DB, &flags);
+  if (rc != SQLITE_OK)
+  {
+    sqlite3_free(pVtab->zErrMsg);
+    pVtab->zErrMsg = sqlite3_mprintf("json_file: cannot open %s", pTab->zPath);
+    sqlite3_free(pCur);
+    return rc;
+  }
+  rc = pCur->pFile->pMethods->xFileSize(pCur->pFile, &pCur->nFile);
+  if (rc == SQLITE_OK && pCur->pFile->pMethods->iVersion >= 3 && pCur->nFile > 0 && pCur->nFile < 0x7fffffff)
+  {
+    // Map the whole file if VFS supports memory-mapped I/O of this size.
+    // xFetch takes int size, larger files are read in blocks
+    sqlite3_int64 mmap_size = pCur->nFile;
+    void *p = 0;
+    pCur->pFile->pMethods->xFileControl(pCur->pFile, SQLITE_FCNTL_MMAP_SIZE, &mmap_size);
+    if (pCur->pFile->pMethods->xFetch(pCur->pFile, 0, (int)pCur->nFile, &p) == SQLITE_OK) pCur->aMap = p;
+  }
+  if (rc != SQLITE_OK)
+  {
+    pCur->pFile->pMethods->xClose(pCur->pFile);
+    sqlite3_free(pCur);
+    return rc;
+  }
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static int sqlitejsonFileClose(sqlite3_vtab_cursor *pCursor){
+  SqlitejsonFileCursor *pCur = (SqlitejsonFileCursor*)pCursor;
+  if (pCur->aMap) pCur->pFile->pMethods->xUnfetch(pCur->pFile, 0, (void*)pCur->aMap);
+  pCur->pFile->pMethods->xClose(pCur->pFile);
+  sqlite3_free(pCur->aBuf);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+/*
+** Move the rest of block starting at the next line to the start of buffer
+** and read file after it. Buffer grows if line doesn't fit into it
+*/
+static int sqlitejsonFileRead(SqlitejsonFileCursor *pCur){
+  int iStart = (int)(pCur->iNext - pCur->iBufOff);
+  int nRead;
+  if (pCur->nBuf > iStart) memmove(pCur->aBuf, pCur->aBuf + iStart, pCur->nBuf - iStart);
+  pCur->nBuf -= iStart;
+  pCur->iBufOff = pCur->iNext;
+  if (pCur->nBuf == pCur->nBufAlloc)
+  {
+    int nNew = pCur->nBufAlloc ? 2 * pCur->nBufAlloc : SQLITEJSON_FILE_BLOCK_SIZE;
+    char *aNew = nNew > 0 ? sqlite3_realloc(pCur->aBuf, nNew) : 0;
+    if (!aNew) return SQLITE_NOMEM;
+    pCur->aBuf = aNew;
+    pCur->nBufAlloc = nNew;
+  }
+  nRead = pCur->nBufAlloc - pCur->nBuf;
+  if (nRead > pCur->nFile - pCur->iBufOff - pCur->nBuf) nRead = (int)(pCur->nFile - pCur->iBufOff - pCur->nBuf);
+  if (nRead <= 0) return SQLITE_OK;
+  pCur->nBuf += nRead;
+  return pCur->pFile->pMethods->xRead(pCur->pFile, pCur->aBuf + pCur->nBuf - nRead, nRead,
+                                      pCur->iBufOff + pCur->nBuf - nRead);
+}
+
+/*
+** Move to the next non-blank line. Newline is found with memchr(), which is
+** vectorized by C library
+*/
+static int sqlitejsonFileNext(sqlite3_vtab_cursor *pCursor){
+  SqlitejsonFileCursor *pCur = (SqlitejsonFileCursor*)pCursor;
+  for (;;)
+  {
+    const char *z, *zNl;
+    int n, i;
+    if (pCur->iNext >= pCur->nFile)
+    {
+      pCur->bEof = 1;
+      return SQLITE_OK;
+    }
+    if (pCur->aMap)
+    {
+      z = pCur->aMap + pCur->iNext;
+      n = (int)(pCur->nFile - pCur->iNext < 0x7fffffff ? pCur->nFile - pCur->iNext : 0x7fffffff);
+    }
+    else
+    {
+      z = pCur->aBuf + (pCur->iNext - pCur->iBufOff);
+      n = pCur->nBuf - (int)(pCur->iNext - pCur->iBufOff);
+    }
+    zNl = n ? memchr(z, '\n', n) : 0;
+    if (!zNl && !pCur->aMap && pCur->iBufOff + pCur->nBuf < pCur->nFile)
+    {
+      // Line continues after the end of block
+      int rc = sqlitejsonFileRead(pCur);
+      if (rc != SQLITE_OK) return rc;
+      continue;
+    }
+    if (zNl) n = (int)(zNl - z);
+    pCur->iNext += n + (zNl != 0);
+    pCur->iRowid++;
+    if (n && z[n - 1] == '\r') n--;
+    for (i = 0; i < n && SQLITEJSON_IS_SPACE(z[i]); i++) {}
+    if (i < n)
+    {
+      pCur->zLine = z;
+      pCur->nLine = n;
+      return SQLITE_OK;
+    }
+  }
+}
+
+static int sqlitejsonFileFilter(
+  sqlite3_vtab_cursor *pCursor,
+  int idxNum,
+  const char *idxStr,
+  int argc,
+  sqlite3_value **argv
+){
+  SqlitejsonFileCursor *pCur = (SqlitejsonFileCursor*)pCursor;
+  (void)idxNum;
+  (void)idxStr;
+  (void)argc;
+  (void)argv;
+  pCur->iNext = 0;
+  pCur->iRowid = 0;
+  pCur->iBufOff = 0;
+  pCur->nBuf = 0;
+  pCur->bEof = 0;
+  return sqlitejsonFileNext(pCursor);
+}
+
+static int sqlitejsonFileEof(sqlite3_vtab_cursor *pCursor){
+  return ((SqlitejsonFileCursor*)pCursor)->bEof;
+}
+
+/*
+** Set result to value under path of line. Line is parsed by stream parser,
+** so it needs no terminating zero
+*/
+static void sqlitejsonFileColumnValue(
+  sqlite3_context *context,
+  const SqlitejsonFileColumn *pCol,
+  const char *z,
+  int n
+){
+  char zSpace[SQLITEJSON_STATIC_STRING_BUFFER_SIZE];
+  char *zVal = zSpace;
+  int nVal = sizeof(zSpace);
+  for (;;)
+  {
+    JsonGetStream stream;
+    int consumed, rc;
+    jsonget_stream_init(&stream, pCol->aStep, pCol->nStep, zVal, nVal);
+    rc = jsonget_stream_feed(&stream, z, n, &consumed);
+    if (rc == JSONGET_STREAM_MORE) rc = jsonget_stream_end(&stream);
+    if (rc != JSONGET_STREAM_MATCH) sqlite3_result_null(context);
+    else if (stream.value_length < nVal) sqlitejsonWriteJsonValToContext(context, jsonget(zVal));
+    else if (zVal == zSpace)
+    {
+      // Value doesn't fit into stack buffer, parse line again with buffer of its size
+      nVal = stream.value_length + 1;
+      zVal = sqlite3_malloc(nVal);
+      if (zVal) continue;
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    break;
+  }
+  if (zVal != zSpace) sqlite3_free(zVal);
+}
+
+static int sqlitejsonFileColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int i){
+  SqlitejsonFileCursor *pCur = (SqlitejsonFileCursor*)pCursor;
+  SqlitejsonFileVtab *pTab = (SqlitejsonFileVtab*)pCursor->pVtab;
+  if (i == 0)
+  {
+    // Copied even from mapped file: value may outlive the cursor, e.g. in min()
+    sqlite3_result_text(context, pCur->zLine, pCur->nLine, SQLITE_TRANSIENT);
+  }
+  else sqlitejsonFileColumnValue(context, &pTab->aCol[i - 1], pCur->zLine, pCur->nLine);
+  return SQLITE_OK;
+}
+
+static int sqlitejsonFileRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid){
+  *pRowid = ((SqlitejsonFileCursor*)pCursor)->iRowid;
+  return SQLITE_OK;
+}
+
+static sqlite3_module sqlitejsonFileModule = {
+  0,                              /* iVersion */
+  sqlitejsonFileConnect,          /* xCreate */
+  sqlitejsonFileConnect,          /* xConnect */
+  sqlitejsonFileBestIndex,        /* xBestIndex */
+  sqlitejsonFileDisconnect,       /* xDisconnect */
+  sqlitejsonFileDisconnect,       /* xDestroy */
+  sqlitejsonFileOpen,             /* xOpen */
+  sqlitejsonFileClose,            /* xClose */
+  sqlitejsonFileFilter,           /* xFilter */
+  sqlitejsonFileNext,             /* xNext */
+  sqlitejsonFileEof,              /* xEof */
+  sqlitejsonFileColumn,           /* xColumn */
+  sqlitejsonFileRowid,            /* xRowid */
+  0,                              /* xUpdate */
+  0,                              /* xBegin */
+  0,                              /* xSync */
+  0,                              /* xCommit */
+  0,                              /* xRollback */
+  0,                              /* xFindFunction */
+  0,                              /* xRename */
+  0,                              /* xSavepoint */
+  0,                              /* xRelease */
+  0,                              /* xRollbackTo */
+};
+
+/*
+** Work run by worker thread. Work is run by calling thread if threads are
+** not available or thread can't be started
+*/
+typedef struct SqlitejsonTask SqlitejsonTask;
+struct SqlitejsonTask {
+  void (*xWork)(void*);    /* Work function */
+  void *pArg;              /* Argument of xWork */
+  int bStarted;            /* True if thread is started and must be joined */
+#if SQLITEJSON_THREADS
+#ifdef _WIN32
+  HANDLE thread;
+#else
+  pthread_t thread;
+#endif
+#endif
+};
+
+#if SQLITEJSON_THREADS
+#ifdef _WIN32
+static DWORD WINAPI sqlitejsonTaskMain(LPVOID p){
+  ((SqlitejsonTask*)p)->xWork(((SqlitejsonTask*)p)->pArg);
+  return 0;
+}
+#else
+static void *sqlitejsonTaskMain(void *p){
+  ((SqlitejsonTask*)p)->xWork(((SqlitejsonTask*)p)->pArg);
+  return 0;
+}
+#endif
+#endif /* SQLITEJSON_THREADS */
+
+/*
+** Run xWork(pArg) in new thread if bThread is true and threads are available,
+** otherwise run it now. Task must not move until sqlitejsonTaskJoin()
+*/
+static void sqlitejsonTaskStart(SqlitejsonTask *p, void (*xWork)(void*), void *pArg, int bThread){
+  p->xWork = xWork;
+  p->pArg = pArg;
+  p->bStarted = 0;
+#if SQLITEJSON_THREADS
+  if (bThread && sqlite3_threadsafe())
+  {
+#ifdef _WIN32
+    p->thread = CreateThread(0, 0, sqlitejsonTaskMain, p, 0, 0);
+    p->bStarted = p->thread != 0;
+#else
+    p->bStarted = pthread_create(&p->thread, 0, sqlitejsonTaskMain, p) == 0;
+#endif
+  }
+#endif
+  if (!p->bStarted) xWork(pArg);
+}
+
+/* Wait until work of task is done */
+static void sqlitejsonTaskJoin(SqlitejsonTask *p){
+#if SQLITEJSON_THREADS
+  if (!p->bStarted) return;
+#ifdef _WIN32
+  WaitForSingleObject(p->thread, INFINITE);
+  CloseHandle(p->thread);
+#else
+  pthread_join(p->thread, 0);
+#endif
+  p->bStarted = 0;
+#endif
+}
+
+/*
+** Bulk load of json documents, see sqlite3_json_bulk_load().
+** Documents are read by writer thread in rounds. Documents of a round are
+** split into batches, one per worker thread. Workers validate documents,
+** minify or encode them and extract path values, while writer inserts
+** results of the previous round. Only writer uses database connection.
+*/
+#define SQLITEJSON_BULK_BATCH        512    /* Documents of one worker in one round */
+#define SQLITEJSON_BULK_MAX_THREADS  64     /* Limit of worker threads */
+
+/* Value under path, converted by worker */
+typedef struct SqlitejsonBulkValue SqlitejsonBulkValue;
+struct SqlitejsonBulkValue {
+  int eType;               /* SQLITE_NULL, SQLITE_INTEGER, SQLITE_FLOAT or SQLITE_TEXT */
+  int n;                   /* Length of text */
+  sqlite3_int64 i;         /* Value of SQLITE_INTEGER */
+  double r;                /* Value of SQLITE_FLOAT */
+  const char *z;           /* Text, points into document or zFree */
+  char *zFree;             /* Text allocated by worker */
+};
+
+typedef struct SqlitejsonBulkDoc SqlitejsonBulkDoc;
+struct SqlitejsonBulkDoc {
+  int iOff;                /* Offset of document in text of batch */
+  int n;                   /* Length of document */
+  unsigned char *aOut;     /* Minified or encoded document, NULL for text format */
+  int nOut;                /* Size of aOut */
+  int bValid;              /* True if document is valid json */
+};
+
+typedef struct SqlitejsonBulkBatch SqlitejsonBulkBatch;
+struct SqlitejsonBulkBatch {
+  SqlitejsonFileColumn *aPath;            /* Paths of values */
+  int nPath;                              /* Number of paths */
+  int eFormat;                            /* SQLITE_JSON_BULK_TEXT, MINIFY or ENCODE */
+  SqlitejsonBuf text;                     /* Documents, each zero terminated */
+  SqlitejsonBulkDoc aDoc[SQLITEJSON_BULK_BATCH];
+  int nDoc;                               /* Number of documents */
+  SqlitejsonBulkValue *aValue;            /* nPath values of each document */
+  int rc;                                 /* SQLITE_NOMEM if worker ran out of memory */
+};
+
+/* Convert value under cursor to bulk value, like json_get() result */
+static int sqlitejsonBulkValue(SqlitejsonBulkValue *pVal, JsonGetCursor json_obj){
+  const char *raw;
+  int len, val = 0;
+  memset(pVal, 0, sizeof(*pVal));
+  switch (json_obj.type)
+  {
+    case JSONGET_BOOLEAN:
+    case JSONGET_INTEGER:
+      jsonget_int(json_obj, &val);
+      pVal->eType = SQLITE_INTEGER;
+      pVal->i = val;
+      break;
+    case JSONGET_DOUBLE:
+      jsonget_double(json_obj, &pVal->r);
+      pVal->eType = SQLITE_FLOAT;
+      break;
+    case JSONGET_STRING:
+      if (!jsonget_raw(json_obj, &raw, &len) || len < 2) break;
+      pVal->eType = SQLITE_TEXT;
+      if (!memchr(raw, '\\', len))
+      {
+        // String without escapes is taken in place
+        pVal->z = raw + 1;
+        pVal->n = len - 2;
+        break;
+      }
+      pVal->zFree = sqlite3_malloc(len);
+      if (!pVal->zFree) return 0;
+      jsonget_string(json_obj, pVal->zFree, len, &pVal->n);
+      pVal->z = pVal->zFree;
+      break;
+    case JSONGET_ARRAY:
+    case JSONGET_OBJECT:
+      if (!jsonget_raw(json_obj, &raw, &len)) break;
+      pVal->eType = SQLITE_TEXT;
+      pVal->z = raw;
+      pVal->n = len;
+      break;
+    default:
+      pVal->eType = SQLITE_NULL;
+  }
+  return 1;
+}
+
+/* Work of one worker: process documents of batch */
+static void sqlitejsonBulkWork(void *pArg){
+  SqlitejsonBulkBatch *p = (SqlitejsonBulkBatch*)pArg;
+  int i, k;
+  for (i = 0; i < p->nDoc && p->rc == SQLITE_OK; i++)
+  {
+    SqlitejsonBulkDoc *pDoc = &p->aDoc[i];
+    const char *z = p->text.z + pDoc->iOff;
+    pDoc->bValid = sqlitejsonIsValid(z, pDoc->n);
+    if (!pDoc->bValid) continue;
+    if (p->eFormat == SQLITE_JSON_BULK_ENCODE)
+    {
+      if (sqlitejsonEncode(z, pDoc->n, &pDoc->aOut, &pDoc->nOut) != SQLITE_OK) p->rc = SQLITE_NOMEM;
+    }
+    else if (p->eFormat == SQLITE_JSON_BULK_MINIFY)
+    {
+      pDoc->aOut = sqlite3_malloc(pDoc->n + 1);
+      if (!pDoc->aOut) p->rc = SQLITE_NOMEM;
+      else jsonget_minify(jsonget(z), (char*)pDoc->aOut, pDoc->n + 1, &pDoc->nOut);
+    }
+    for (k = 0; k < p->nPath && p->rc == SQLITE_OK; k++)
+    {
+      const SqlitejsonFileColumn *pPath = &p->aPath[k];
+      JsonGetCursor json_obj = jsonget(z);
+      int s;
+      for (s = 0; s < pPath->nStep; s++)
+      {
+        const JsonGetStreamStep *pStep = &pPath->aStep[s];
+        json_obj = pStep->key ? jsonget_move_nkey(json_obj, pStep->key, pStep->key_length)
+                              : jsonget_move_index(json_obj, pStep->index);
+      }
+      if (!sqlitejsonBulkValue(&p->aValue[i * p->nPath + k], json_obj)) p->rc = SQLITE_NOMEM;
+    }
+  }
+}
+
+/* Free results of batch and make it empty */
+static void sqlitejsonBulkClear(SqlitejsonBulkBatch *p){
+  int i;
+  for (i = 0; i < p->nDoc; i++) sqlite3_free(p->aDoc[i].aOut);
+  for (i = 0; i < p->nDoc * p->nPath; i++) sqlite3_free(p->aValue[i].zFree);
+  memset(p->aDoc, 0, sizeof(p->aDoc));
+  memset(p->aValue, 0, p->nDoc * p->nPath * sizeof(SqlitejsonBulkValue));
+  p->nDoc = 0;
+  p->text.n = 0;
+  p->rc = SQLITE_OK;
+}
+
+/*
+** Insert processed documents of batch with prepared statement.
+** *piDoc is number of documents inserted before, used in error message
+*/
+static int sqlitejsonBulkInsert(
+  sqlite3_stmt *pStmt,
+  SqlitejsonBulkBatch *p,
+  sqlite3_int64 *piDoc,
+  char **pzErrMsg
+){
+  int i, k, rc = p->rc;
+  for (i = 0; i < p->nDoc && rc == SQLITE_OK; i++)
+  {
+    const SqlitejsonBulkDoc *pDoc = &p->aDoc[i];
+    if (!pDoc->bValid)
+    {
+      if (pzErrMsg) *pzErrMsg = sqlite3_mprintf("json_bulk_load: document %lld is not valid json", *piDoc + 1);
+      return SQLITE_ERROR;
+    }
+    if (p->eFormat == SQLITE_JSON_BULK_ENCODE) sqlite3_bind_blob(pStmt, 1, pDoc->aOut, pDoc->nOut, SQLITE_STATIC);
+    else if (pDoc->aOut) sqlite3_bind_text(pStmt, 1, (const char*)pDoc->aOut, pDoc->nOut, SQLITE_STATIC);
+    else sqlite3_bind_text(pStmt, 1, p->text.z + pDoc->iOff, pDoc->n, SQLITE_STATIC);
+    for (k = 0; k < p->nPath; k++)
+    {
+      const SqlitejsonBulkValue *pVal = &p->aValue[i * p->nPath + k];
+      switch (pVal->eType)
+      {
+        case SQLITE_INTEGER: sqlite3_bind_int64(pStmt, k + 2, pVal->i); break;
+        case SQLITE_FLOAT: sqlite3_bind_double(pStmt, k + 2, pVal->r); break;
+        case SQLITE_TEXT: sqlite3_bind_text(pStmt, k + 2, pVal->z, pVal->n, SQLITE_STATIC); break;
+        default: sqlite3_bind_null(pStmt, k + 2);
+      }
+    }
+    sqlite3_step(pStmt);
+    rc = sqlite3_reset(pStmt);
+    (*piDoc)++;
+  }
+  return rc;
+}
+
+/*
+** Load json documents returned by xNext into database with INSERT statement
+** zSql: ?1 is bound to document, ?2, ?3 ... to values under paths azPath.
+** See sqlitejson.h
+*/
+int sqlite3_json_bulk_load(
+  sqlite3 *db,
+  const char *zSql,
+  const char *const *azPath,
+  int nPath,
+  int eFormat,
+  int nThread,
+  int (*xNext)(void *pArg, const char **pzDoc, int *pnDoc),
+  void *pArg,
+  char **pzErrMsg
+){
+  SqlitejsonBulkBatch *aBatch = 0;   /* Two sets of nBatch batches */
+  SqlitejsonFileColumn *aPath = 0;
+  sqlite3_stmt *pStmt = 0;
+  char *zKeys = 0;
+  sqlite3_int64 iDoc = 0;
+  int nBatch, nKeys = 0, i, rc, iSet = 0, bEof = 0, bTrans = 0;
+
+  if (pzErrMsg) *pzErrMsg = 0;
+  if (nThread > SQLITEJSON_BULK_MAX_THREADS) nThread = SQLITEJSON_BULK_MAX_THREADS;
+  nBatch = nThread > 1 ? nThread : 1;
+
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  if (rc != SQLITE_OK) goto bulk_end;
+  if (sqlite3_bind_parameter_count(pStmt) < nPath + 1)
+  {
+    if (pzErrMsg) *pzErrMsg = sqlite3_mprintf("json_bulk_load: statement has less than %d parameters", nPath + 1);
+    rc = SQLITE_RANGE;
+    goto bulk_end;
+  }
+
+  for (i = 0; i < nPath; i++) nKeys += (int)strlen(azPath[i]) + 1;
+  aPath = sqlite3_malloc(nPath * (int)sizeof(SqlitejsonFileColumn) + 1);
+  zKeys = sqlite3_malloc(nKeys + 1);
+  aBatch = sqlite3_malloc(2 * nBatch * (int)sizeof(SqlitejsonBulkBatch));
+  if (!aPath || !zKeys || !aBatch)
+  {
+    rc = SQLITE_NOMEM;
+    goto bulk_end;
+  }
+  for (i = 0, nKeys = 0; i < nPath; i++)
+  {
+    // Path is parsed as path column declaration without name
+    if (!sqlitejsonFileParseColumn(azPath[i], &aPath[i], zKeys + nKeys))
+    {
+      if (pzErrMsg) *pzErrMsg = sqlite3_mprintf("json_bulk_load: invalid path %s", azPath[i]);
+      rc = SQLITE_ERROR;
+      goto bulk_end;
+    }
+    nKeys += (int)strlen(azPath[i]) + 1;
+  }
+  memset(aBatch, 0, 2 * nBatch * sizeof(SqlitejsonBulkBatch));
+  for (i = 0; i < 2 * nBatch; i++)
+  {
+    aBatch[i].aPath = aPath;
+    aBatch[i].nPath = nPath;
+    aBatch[i].eFormat = eFormat;
+    sqlitejsonBufInit(&aBatch[i].text);
+    aBatch[i].aValue = sqlite3_malloc(SQLITEJSON_BULK_BATCH * nPath * (int)sizeof(SqlitejsonBulkValue) + 1);
+    if (!aBatch[i].aValue) rc = SQLITE_NOMEM;
+  }
+  if (rc != SQLITE_OK) goto bulk_end;
+
+  // Load is one transaction, unless caller has opened one
+  if (sqlite3_get_autocommit(db))
+  {
+    rc = sqlite3_exec(db, "BEGIN", 0, 0, pzErrMsg);
+    if (rc != SQLITE_OK) goto bulk_end;
+    bTrans = 1;
+  }
+
+  while (rc == SQLITE_OK && !bEof)
+  {
+    SqlitejsonBulkBatch *aCur = &aBatch[iSet * nBatch];
+    SqlitejsonBulkBatch *aPrev = &aBatch[(1 - iSet) * nBatch];
+    SqlitejsonTask aTask[SQLITEJSON_BULK_MAX_THREADS];
+    int b;
+
+    // Read documents of this round
+    for (b = 0; b < nBatch && !bEof && rc == SQLITE_OK; b++)
+    {
+      SqlitejsonBulkBatch *p = &aCur[b];
+      while (p->nDoc < SQLITEJSON_BULK_BATCH)
+      {
+        const char *z = 0;
+        int n = 0;
+        rc = xNext(pArg, &z, &n);
+        if (rc == SQLITE_DONE) bEof = 1;
+        if (rc != SQLITE_ROW) break;
+        rc = SQLITE_OK;
+        if (n < 0) n = z ? (int)strlen(z) : 0;
+        p->aDoc[p->nDoc].iOff = p->text.n;
+        p->aDoc[p->nDoc].n = n;
+        sqlitejsonBufAppend(&p->text, z, n);
+        sqlitejsonBufAppendChar(&p->text, 0);
+        p->nDoc++;
+        if (p->text.bOom)
+        {
+          rc = SQLITE_NOMEM;
+          break;
+        }
+      }
+    }
+    if (rc == SQLITE_DONE) rc = SQLITE_OK;
+
+    // Workers process this round while writer inserts the previous one
+    for (b = 0; b < nBatch; b++)
+    {
+      aTask[b].bStarted = 0;
+      if (rc == SQLITE_OK) sqlitejsonTaskStart(&aTask[b], sqlitejsonBulkWork, &aCur[b], nThread > 1 && aCur[b].nDoc);
+    }
+    for (b = 0; b < nBatch; b++)
+    {
+      if (rc == SQLITE_OK) rc = sqlitejsonBulkInsert(pStmt, &aPrev[b], &iDoc, pzErrMsg);
+      sqlitejsonBulkClear(&aPrev[b]);
+    }
+    for (b = 0; b < nBatch; b++) sqlitejsonTaskJoin(&aTask[b]);
+    iSet = 1 - iSet;
+  }
+
+  // Insert the last round
+  for (i = 0; i < nBatch; i++)
+  {
+    if (rc == SQLITE_OK) rc = sqlitejsonBulkInsert(pStmt, &aBatch[(1 - iSet) * nBatch + i], &iDoc, pzErrMsg);
+  }
+  if (rc != SQLITE_OK && pzErrMsg && !*pzErrMsg) *pzErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  if (bTrans) sqlite3_exec(db, rc == SQLITE_OK ? "COMMIT" : "ROLLBACK", 0, 0, 0);
+
+bulk_end:
+  if (rc != SQLITE_OK && pzErrMsg && !*pzErrMsg) *pzErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  if (aBatch)
+  {
+    for (i = 0; i < 2 * nBatch; i++)
+    {
+      if (aBatch[i].aValue) sqlitejsonBulkClear(&aBatch[i]);
+      sqlite3_free(aBatch[i].aValue);
+      sqlitejsonBufReset(&aBatch[i].text);
+    }
+  }
+  sqlite3_free(aBatch);
+  sqlite3_free(aPath);
+  sqlite3_free(zKeys);
+  sqlite3_finalize(pStmt);
+  return rc;
+}
+
+/*
+** Parallel aggregate scan, see sqlite3_json_parallel_aggregate().
+** Rowid range of table is split into parts. Every part is aggregated by its
+** own read connection in its own thread, partial results are merged by a
+** query over them on the caller's connection.
+*/
+#define SQLITEJSON_SCAN_MAX_THREADS  64     /* Limit of worker threads */
+
+/* Aggregates which can be merged from partial results */
+static const struct SqlitejsonAggregate {
+  const char *zName;       /* Aggregate function */
+  const char *zPartial;    /* Partial result, %s is argument */
+  int nPartial;             /* Number of partial result columns */
+  const char *zMerge;      /* Merge of partial results, %d is column */
+} sqlitejsonAggregates[] = {
+  {"count", "count(%s)",            1, "sum(c%d)"},
+  {"sum",   "sum(%s)",              1, "sum(c%d)"},
+  {"total", "total(%s)",            1, "total(c%d)"},
+  {"min",   "min(%s)",              1, "min(c%d)"},
+  {"max",   "max(%s)",              1, "max(c%d)"},
+  {"avg",   "total(%s), count(%s)", 2, "total(c%d)/sum(c%d)"},
+};
+
+typedef struct SqlitejsonScanPart SqlitejsonScanPart;
+struct SqlitejsonScanPart {
+  const char *zFile;       /* Database file, NULL to use db as is */
+  const char *zSql;        /* Partial aggregate query, ?1 and ?2 are rowid bounds */
+  sqlite3 *db;             /* Connection of part */
+  sqlite3_stmt *pStmt;     /* Query stopped at its single row */
+  sqlite3_int64 iFirst;    /* First rowid of part */
+  sqlite3_int64 iLast;     /* Last rowid of part */
+  int bNull;               /* True if table is empty and bounds are NULL */
+  int rc;                  /* Result of work */
+  char *zErr;              /* Error message of work */
+};
+
+/*
+** Split rowid range of table into parts. Range is read by db, parts are
+** left empty if table is empty
+*/
+static int sqlitejsonScanSplit(sqlite3 *db, const char *zTable, SqlitejsonScanPart *aPart, int nPart){
+  sqlite3_stmt *pStmt = 0;
+  char *zSql = sqlite3_mprintf("SELECT min(rowid), max(rowid) FROM main.\"%w\"", zTable);
+  int i, rc;
+  if (!zSql) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) return rc;
+  if (sqlite3_step(pStmt) == SQLITE_ROW)
+  {
+    sqlite3_int64 iMin = sqlite3_column_int64(pStmt, 0);
+    sqlite3_int64 iMax = sqlite3_column_int64(pStmt, 1);
+    // Rowid span may not fit in signed integer
+    sqlite3_uint64 nStep = ((sqlite3_uint64)iMax - (sqlite3_uint64)iMin) / nPart + 1;
+    for (i = 0; i < nPart; i++)
+    {
+      aPart[i].bNull = sqlite3_column_type(pStmt, 0) == SQLITE_NULL;
+      aPart[i].iFirst = (sqlite3_int64)((sqlite3_uint64)iMin + nStep * i);
+      aPart[i].iLast = i == nPart - 1 ? iMax : (sqlite3_int64)((sqlite3_uint64)iMin + nStep * (i + 1) - 1);
+    }
+  }
+  return sqlite3_finalize(pStmt);
+}
+
+/* Open connection of part and prepare its query bound to rowid range */
+static int sqlitejsonScanOpen(SqlitejsonScanPart *p){
+  if (p->zFile)
+  {
+    p->rc = sqlite3_open_v2(p->zFile, &p->db, SQLITE_OPEN_READONLY, 0);
+#if !SQLITE_CORE
+    // Functions of loadable extension are not registered with new connections
+    if (p->rc == SQLITE_OK) p->rc = sqlite3JsonInit(p->db);
+#endif
+  }
+  if (p->rc == SQLITE_OK) p->rc = sqlite3_prepare_v2(p->db, p->zSql, -1, &p->pStmt, 0);
+  if (p->rc == SQLITE_OK && !p->bNull)
+  {
+    sqlite3_bind_int64(p->pStmt, 1, p->iFirst);
+    sqlite3_bind_int64(p->pStmt, 2, p->iLast);
+  }
+  if (p->rc != SQLITE_OK && p->db) p->zErr = sqlite3_mprintf("%s", sqlite3_errmsg(p->db));
+  return p->rc;
+}
+
+/* Close connection of part, if part has its own */
+static void sqlitejsonScanClose(SqlitejsonScanPart *p){
+  sqlite3_finalize(p->pStmt);
+  p->pStmt = 0;
+  if (p->zFile) sqlite3_close(p->db);
+  p->db = 0;
+}
+
+/* Work of one aggregate part: run partial query */
+static void sqlitejsonScanWork(void *pArg){
+  SqlitejsonScanPart *p = (SqlitejsonScanPart*)pArg;
+  if (sqlitejsonScanOpen(p) != SQLITE_OK) return;
+  p->rc = sqlite3_step(p->pStmt);
+  if (p->rc == SQLITE_ROW) p->rc = SQLITE_OK;
+  else
+  {
+    if (p->rc == SQLITE_DONE) p->rc = SQLITE_ERROR;
+    p->zErr = sqlite3_mprintf("%s", sqlite3_errmsg(p->db));
+  }
+}
+
+/*
+** Check that zArg..zEnd is a single parenthesized argument list "(...)":
+** the first '(' is closed by the last ')', quoted strings and names are
+** skipped. Expressions like "max(x) - min(x)" and DISTINCT aggregates
+** can't be merged from partial results and are rejected
+*/
+static int sqlitejsonIsAggregateArg(const char *zArg, const char *zEnd){
+  const char *z;
+  int nDepth = 0;
+  if (zEnd - zArg < 3 || zArg[0] != '(' || zEnd[-1] != ')') return 0;
+  for (z = zArg; z < zEnd; z++)
+  {
+    if (*z == '\'' || *z == '"' || *z == '`' || *z == '[')
+    {
+      char cEnd = *z == '[' ? ']' : *z;
+      for (z++; z < zEnd && *z != cEnd; z++);
+      if (z == zEnd) return 0;
+    }
+    else if (*z == '(') nDepth++;
+    else if (*z == ')' && --nDepth == 0 && z != zEnd - 1) return 0;
+  }
+  if (nDepth != 0) return 0;
+  for (z = zArg + 1; SQLITEJSON_IS_SPACE(*z); z++);
+  return sqlite3_strnicmp(z, "distinct", 8) != 0
+      || (z[8] != '(' && !SQLITEJSON_IS_SPACE(z[8]));
+}
+
+/*
+** Return 1 if main database of db is in WAL mode. Readers don't block
+** writers in WAL mode, so connections of parts could see different commits
+*/
+static int sqlitejsonIsWal(sqlite3 *db){
+  sqlite3_stmt *pStmt;
+  int bWal = 0;
+  if (sqlite3_prepare_v2(db, "PRAGMA main.journal_mode", -1, &pStmt, 0) != SQLITE_OK) return 0;
+  if (sqlite3_step(pStmt) == SQLITE_ROW)
+  {
+    const char *zMode = (const char*)sqlite3_column_text(pStmt, 0);
+    bWal = zMode && sqlite3_stricmp(zMode, "wal") == 0;
+  }
+  sqlite3_finalize(pStmt);
+  return bWal;
+}
+
+/*
+** Compute aggregates azAgg over rows of table zTable in main database,
+** scanning it with nThread threads. See sqlitejson.h
+*/
+int sqlite3_json_parallel_aggregate(
+  sqlite3 *db,
+  const char *zTable,
+  const char *zWhere,
+  const char *const *azAgg,
+  int nAgg,
+  int nThread,
+  int (*xCallback)(void*, int, char**, char**),
+  void *pArg,
+  char **pzErrMsg
+){
+  SqlitejsonScanPart *aPart = 0;
+  SqlitejsonTask *aTask = 0;
+  SqlitejsonBuf partial, merge;
+  sqlite3_stmt *pStmt = 0;
+  const char *zFile = sqlite3_db_filename(db, "main");
+  char **azVal = 0;
+  int nCol = 0, nPart = 1, i, k, rc = SQLITE_OK, bTrans = 0;
+
+  if (pzErrMsg) *pzErrMsg = 0;
+  sqlitejsonBufInit(&partial);
+  sqlitejsonBufInit(&merge);
+
+  // Rewrite aggregates into partial and merge columns
+  for (i = 0; i < nAgg; i++)
+  {
+    const char *z = azAgg[i], *zArg, *zEnd;
+    char *zCol;
+    int nName, j;
+    while (SQLITEJSON_IS_SPACE(*z)) z++;
+    for (nName = 0; z[nName] && z[nName] != '(' && !SQLITEJSON_IS_SPACE(z[nName]); nName++);
+    zArg = z + nName;
+    while (SQLITEJSON_IS_SPACE(*zArg)) zArg++;
+    zEnd = z + strlen(z);
+    while (zEnd > zArg && SQLITEJSON_IS_SPACE(zEnd[-1])) zEnd--;
+    for (j = 0; j < (int)(sizeof(sqlitejsonAggregates)/sizeof(sqlitejsonAggregates[0])); j++)
+    {
+      if ((int)strlen(sqlitejsonAggregates[j].zName) == nName
+       && sqlite3_strnicmp(z, sqlitejsonAggregates[j].zName, nName) == 0) break;
+    }
+    if (j == (int)(sizeof(sqlitejsonAggregates)/sizeof(sqlitejsonAggregates[0]))
+     || !sqlitejsonIsAggregateArg(zArg, zEnd))
+    {
+      if (pzErrMsg) *pzErrMsg = sqlite3_mprintf("json_parallel_aggregate: unsupported aggregate %s", azAgg[i]);
+      rc = SQLITE_ERROR;
+      goto scan_end;
+    }
+    zCol = sqlite3_mprintf("%.*s", (int)(zEnd - zArg - 2), zArg + 1);
+    if (!zCol)
+    {
+      rc = SQLITE_NOMEM;
+      goto scan_end;
+    }
+    if (i > 0)
+    {
+      sqlitejsonBufAppend(&partial, ", ", 2);
+      sqlitejsonBufAppend(&merge, ", ", 2);
+    }
+    sqlitejsonBufAppendFree(&partial, sqlite3_mprintf(sqlitejsonAggregates[j].zPartial, zCol, zCol));
+    sqlitejsonBufAppendFree(&merge, sqlite3_mprintf(sqlitejsonAggregates[j].zMerge, nCol, nCol + 1));
+    nCol += sqlitejsonAggregates[j].nPartial;
+    sqlite3_free(zCol);
+  }
+  if (nAgg <= 0 || partial.bOom || merge.bOom)
+  {
+    rc = nAgg <= 0 ? SQLITE_MISUSE : SQLITE_NOMEM;
+    goto scan_end;
+  }
+
+  // Parts are scanned by own connections only if they see the same data as db
+  if (nThread > SQLITEJSON_SCAN_MAX_THREADS) nThread = SQLITEJSON_SCAN_MAX_THREADS;
+  while (nThread > 1 && nThread * nCol > 999) nThread--;
+  if (nThread > 1 && zFile && zFile[0] && sqlite3_get_autocommit(db) && sqlite3_threadsafe()
+   && !sqlitejsonIsWal(db))
+  {
+    nPart = nThread;
+  }
+  aPart = sqlite3_malloc(nPart * (int)sizeof(SqlitejsonScanPart));
+  aTask = sqlite3_malloc(nPart * (int)sizeof(SqlitejsonTask));
+  if (!aPart || !aTask)
+  {
+    rc = SQLITE_NOMEM;
+    goto scan_end;
+  }
+  memset(aPart, 0, nPart * sizeof(SqlitejsonScanPart));
+  memset(aTask, 0, nPart * sizeof(SqlitejsonTask));
+
+  // Read transaction keeps writers from committing until every part has started
+  if (nPart > 1)
+  {
+    rc = sqlite3_exec(db, "BEGIN", 0, 0, 0);
+    if (rc != SQLITE_OK) goto scan_end;
+    bTrans = 1;
+  }
+  rc = sqlitejsonScanSplit(db, zTable, aPart, nPart);
+  if (rc != SQLITE_OK) goto scan_end;
+
+  {
+    char *zSql = sqlite3_mprintf("SELECT %.*s FROM main.\"%w\" WHERE rowid BETWEEN ?1 AND ?2%s%s%s",
+      partial.n, partial.z, zTable, zWhere ? " AND (" : "", zWhere ? zWhere : "", zWhere ? ")" : "");
+    if (!zSql)
+    {
+      rc = SQLITE_NOMEM;
+      goto scan_end;
+    }
+    for (i = 0; i < nPart; i++)
+    {
+      aPart[i].zSql = zSql;
+      aPart[i].zFile = nPart > 1 ? zFile : 0;
+      aPart[i].db = nPart > 1 ? 0 : db;
+    }
+    // The first part is scanned by calling thread
+    for (i = nPart - 1; i >= 0; i--) sqlitejsonTaskStart(&aTask[i], sqlitejsonScanWork, &aPart[i], i > 0);
+    for (i = 0; i < nPart; i++) sqlitejsonTaskJoin(&aTask[i]);
+    sqlite3_free(zSql);
+  }
+  for (i = 0; i < nPart && rc == SQLITE_OK; i++)
+  {
+    if (aPart[i].rc == SQLITE_OK) continue;
+    rc = aPart[i].rc;
+    if (pzErrMsg) *pzErrMsg = aPart[i].zErr, aPart[i].zErr = 0;
+  }
+  if (rc != SQLITE_OK) goto scan_end;
+
+  // Merge query reads partial results as bound parameters
+  sqlitejsonBufAppend(&merge, " FROM (", 7);
+  for (i = 0; i < nPart; i++)
+  {
+    sqlitejsonBufAppend(&merge, i ? " UNION ALL SELECT " : "SELECT ", i ? 18 : 7);
+    for (k = 0; k < nCol; k++)
+    {
+      if (k) sqlitejsonBufAppend(&merge, ", ", 2);
+      if (i) sqlitejsonBufAppendChar(&merge, '?');
+      else sqlitejsonBufAppendFree(&merge, sqlite3_mprintf("? AS c%d", k));
+    }
+  }
+  sqlitejsonBufAppendChar(&merge, ')');
+  if (merge.bOom)
+  {
+    rc = SQLITE_NOMEM;
+    goto scan_end;
+  }
+  {
+    char *zSql = sqlite3_mprintf("SELECT %.*s", merge.n, merge.z);
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  if (rc != SQLITE_OK) goto scan_end;
+  for (i = 0; i < nPart; i++)
+  {
+    for (k = 0; k < nCol; k++)
+    {
+      sqlite3_bind_value(pStmt, i * nCol + k + 1, sqlite3_column_value(aPart[i].pStmt, k));
+    }
+  }
+  if (sqlite3_step(pStmt) == SQLITE_ROW && xCallback)
+  {
+    azVal = sqlite3_malloc(nAgg * (int)sizeof(char*));
+    if (!azVal)
+    {
+      rc = SQLITE_NOMEM;
+      goto scan_end;
+    }
+    for (i = 0; i < nAgg; i++) azVal[i] = (char*)sqlite3_column_text(pStmt, i);
+    if (xCallback(pArg, nAgg, azVal, (char**)azAgg)) rc = SQLITE_ABORT;
+  }
+  if (rc == SQLITE_OK) rc = sqlite3_reset(pStmt);
+
+scan_end:
+  if (rc != SQLITE_OK && pzErrMsg && !*pzErrMsg) *pzErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  sqlite3_free(azVal);
+  sqlite3_finalize(pStmt);
+  for (i = 0; aPart && i < nPart; i++)
+  {
+    sqlitejsonScanClose(&aPart[i]);
+    sqlite3_free(aPart[i].zErr);
+  }
+  if (bTrans) sqlite3_exec(db, "COMMIT", 0, 0, 0);
+  sqlite3_free(aPart);
+  sqlite3_free(aTask);
+  sqlitejsonBufReset(&partial);
+  sqlitejsonBufReset(&merge);
+  return rc;
+}
+
+/*
+** Json path index, see sqlite3_json_create_index(). Keys are extracted by
+** parallel scan parts, every part sorts its (key, rowid) pairs in chunks of
+** limited size. Full chunks are written to temporary file of part as sorted
+** runs, the last chunk stays in memory. Writer merges all runs into index
+** table in key order.
+*/
+#define SQLITEJSON_INDEX_CHUNK_SIZE  (64*1024*1024)  /* Memory of keys sorted at once */
+#define SQLITEJSON_INDEX_BLOCK_SIZE  (64*1024)       /* Write and read block of runs in file */
+#define SQLITEJSON_INDEX_HEADER_SIZE 17              /* Key in file: type, rowid, value or length */
+
+typedef struct SqlitejsonIndexKey SqlitejsonIndexKey;
+struct SqlitejsonIndexKey {
+  int eType;               /* SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_BLOB */
+  int n;                   /* Length of text or blob */
+  sqlite3_int64 i;         /* Value of SQLITE_INTEGER */
+  double r;                /* Value of SQLITE_FLOAT */
+  const char *z;           /* Text or blob, set when chunk is complete */
+  int iOff;                /* Offset of text or blob in chunk */
+  sqlite3_int64 iRowid;    /* Row of key */
+};
+
+/* Sorted run written to temporary file */
+typedef struct SqlitejsonIndexSpill SqlitejsonIndexSpill;
+struct SqlitejsonIndexSpill {
+  sqlite3_int64 iOff;      /* Offset of run in file */
+  sqlite3_int64 nByte;     /* Size of run */
+};
+
+typedef struct SqlitejsonIndexRun SqlitejsonIndexRun;
+struct SqlitejsonIndexRun {
+  SqlitejsonScanPart scan; /* Scan of rowid range */
+  SqlitejsonIndexKey *aKey;/* Keys of chunk, sorted by sqlitejsonIndexCompare() */
+  int nKey;                /* Number of keys */
+  int nAlloc;              /* Allocated size of aKey */
+  SqlitejsonBuf text;      /* Text and blobs of keys */
+  sqlite3_file *pFile;     /* Temporary file of spilled runs, or NULL */
+  sqlite3_int64 nFile;     /* Size of pFile */
+  SqlitejsonIndexSpill *aSpill;  /* Runs in pFile */
+  int nSpill;              /* Number of runs in pFile */
+};
+
+/* Merge cursor over sorted keys of memory chunk or of run in file */
+typedef struct SqlitejsonIndexCursor SqlitejsonIndexCursor;
+struct SqlitejsonIndexCursor {
+  SqlitejsonIndexKey key;  /* Current key */
+  const SqlitejsonIndexKey *aKey;  /* Keys of memory chunk */
+  int iKey, nKey;          /* Next key and number of keys of memory chunk */
+  sqlite3_file *pFile;     /* File of run, NULL for memory chunk */
+  sqlite3_int64 iOff;      /* Offset of next read */
+  sqlite3_int64 iEnd;      /* End of run in file */
+  char *aBuf;              /* Block read from file */
+  int iBuf, nBuf, nBufAlloc;  /* Next key, valid bytes and size of aBuf */
+};
+
+/* Compare keys in index order: numbers, text, blobs, then rowid */
+static int sqlitejsonIndexCompare(const void *pA, const void *pB){
+  const SqlitejsonIndexKey *a = (const SqlitejsonIndexKey*)pA;
+  const SqlitejsonIndexKey *b = (const SqlitejsonIndexKey*)pB;
+  int ca = a->eType == SQLITE_TEXT ? 2 : a->eType == SQLITE_BLOB ? 3 : 1;
+  int cb = b->eType == SQLITE_TEXT ? 2 : b->eType == SQLITE_BLOB ? 3 : 1;
+  if (ca != cb) return ca < cb ? -1 : 1;
+  if (ca == 1)
+  {
+    if (a->eType == SQLITE_INTEGER && b->eType == SQLITE_INTEGER)
+    {
+      if (a->i != b->i) return a->i < b->i ? -1 : 1;
+    }
+    else
+    {
+      double ra = a->eType == SQLITE_INTEGER ? (double)a->i : a->r;
+      double rb = b->eType == SQLITE_INTEGER ? (double)b->i : b->r;
+      if (ra != rb) return ra < rb ? -1 : 1;
+    }
+  }
+  else
+  {
+    int n = a->n < b->n ? a->n : b->n;
+    int c = n ? memcmp(a->z, b->z, n) : 0;
+    if (c) return c;
+    if (a->n != b->n) return a->n < b->n ? -1 : 1;
+  }
+  return a->iRowid < b->iRowid ? -1 : a->iRowid > b->iRowid;
+}
+
+/* Sort keys of chunk once its text is complete */
+static void sqlitejsonIndexSort(SqlitejsonIndexRun *p){
+  int i;
+  if (p->nKey == 0) return; // key array may be NULL
+  for (i = 0; i < p->nKey; i++) p->aKey[i].z = p->text.z + p->aKey[i].iOff;
+  qsort(p->aKey, p->nKey, sizeof(SqlitejsonIndexKey), sqlitejsonIndexCompare);
+}
+
+/*
+** Sort chunk and append it to temporary file of part as a run, chunk is
+** emptied. File is opened through default VFS and deleted when closed
+*/
+static int sqlitejsonIndexSpill(SqlitejsonIndexRun *p){
+  SqlitejsonIndexSpill *aNew;
+  SqlitejsonBuf block;
+  sqlite3_int64 iStart = p->nFile;
+  int i, rc = SQLITE_OK;
+
+  if (!p->pFile)
+  {
+    sqlite3_vfs *pVfs = sqlite3_vfs_find(0);
+    p->pFile = sqlite3_malloc(pVfs->szOsFile);
+    if (!p->pFile) return SQLITE_NOMEM;
+    memset(p->pFile, 0, pVfs->szOsFile);
+    rc = pVfs->xOpen(pVfs, 0, p->pFile, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_EXCLUSIVE
+                     | SQLITE_OPEN_DELETEONCLOSE | SQLITE_OPEN_TEMP_JOURNAL, 0);
+    if (rc != SQLITE_OK) return rc;
+  }
+  aNew = sqlite3_realloc(p->aSpill, (p->nSpill + 1) * (int)sizeof(SqlitejsonIndexSpill));
+  if (!aNew) return SQLITE_NOMEM;
+  p->aSpill = aNew;
+
+  sqlitejsonIndexSort(p);
+  sqlitejsonBufInit(&block);
+  for (i = 0; i < p->nKey && rc == SQLITE_OK; i++)
+  {
+    const SqlitejsonIndexKey *pKey = &p->aKey[i];
+    unsigned char aHdr[SQLITEJSON_INDEX_HEADER_SIZE];
+    sqlite3_int64 iVal = pKey->eType == SQLITE_INTEGER ? pKey->i : pKey->n;
+    aHdr[0] = (unsigned char)pKey->eType;
+    memcpy(&aHdr[1], &pKey->iRowid, 8);
+    if (pKey->eType == SQLITE_FLOAT) memcpy(&aHdr[9], &pKey->r, 8);
+    else memcpy(&aHdr[9], &iVal, 8);
+    sqlitejsonBufAppend(&block, (const char*)aHdr, SQLITEJSON_INDEX_HEADER_SIZE);
+    if (pKey->eType == SQLITE_TEXT || pKey->eType == SQLITE_BLOB) sqlitejsonBufAppend(&block, pKey->z, pKey->n);
+    if (block.bOom) rc = SQLITE_NOMEM;
+    else if (block.n >= SQLITEJSON_INDEX_BLOCK_SIZE || i == p->nKey - 1)
+    {
+      rc = p->pFile->pMethods->xWrite(p->pFile, block.z, block.n, p->nFile);
+      p->nFile += block.n;
+      block.n = 0;
+    }
+  }
+  sqlitejsonBufReset(&block);
+  if (rc != SQLITE_OK) return rc;
+  p->aSpill[p->nSpill].iOff = iStart;
+  p->aSpill[p->nSpill].nByte = p->nFile - iStart;
+  p->nSpill++;
+  p->nKey = 0;
+  p->text.n = 0;
+  return SQLITE_OK;
+}
+
+/* Work of one index part: extract keys of rowid range and sort them */
+static void sqlitejsonIndexWork(void *pArg){
+  SqlitejsonIndexRun *p = (SqlitejsonIndexRun*)pArg;
+  int rc = SQLITE_OK;
+  if (sqlitejsonScanOpen(&p->scan) != SQLITE_OK) return;
+  while (rc == SQLITE_OK && sqlite3_step(p->scan.pStmt) == SQLITE_ROW)
+  {
+    sqlite3_value *pVal = sqlite3_column_value(p->scan.pStmt, 0);
+    SqlitejsonIndexKey *pKey;
+    int eType = sqlite3_value_type(pVal);
+    if (eType == SQLITE_NULL) continue;
+    if (p->nKey == p->nAlloc)
+    {
+      // Size is checked in 64 bits, so it never wraps to size which frees array
+      sqlite3_int64 nNew = p->nAlloc ? (sqlite3_int64)p->nAlloc * 2 : 1024;
+      SqlitejsonIndexKey *aNew = 0;
+      if (nNew * sizeof(SqlitejsonIndexKey) <= SQLITEJSON_MAX_ALLOC)
+      {
+        aNew = sqlite3_realloc(p->aKey, (int)(nNew * sizeof(SqlitejsonIndexKey)));
+      }
+      if (!aNew)
+      {
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      p->aKey = aNew;
+      p->nAlloc = (int)nNew;
+    }
+    pKey = &p->aKey[p->nKey++];
+    memset(pKey, 0, sizeof(*pKey));
+    pKey->eType = eType;
+    pKey->iRowid = sqlite3_column_int64(p->scan.pStmt, 1);
+    if (eType == SQLITE_INTEGER) pKey->i = sqlite3_value_int64(pVal);
+    else if (eType == SQLITE_FLOAT) pKey->r = sqlite3_value_double(pVal);
+    else
+    {
+      const char *z = eType == SQLITE_TEXT ? (const char*)sqlite3_value_text(pVal) : sqlite3_value_blob(pVal);
+      pKey->n = sqlite3_value_bytes(pVal);
+      pKey->iOff = p->text.n;
+      sqlitejsonBufAppend(&p->text, z, pKey->n);
+      if (p->text.bOom) rc = SQLITE_NOMEM;
+    }
+    if (rc == SQLITE_OK && (sqlite3_int64)p->nKey * sizeof(SqlitejsonIndexKey) + p->text.n >= SQLITEJSON_INDEX_CHUNK_SIZE)
+    {
+      rc = sqlitejsonIndexSpill(p);
+    }
+  }
+  p->scan.rc = sqlite3_reset(p->scan.pStmt);
+  if (p->scan.rc != SQLITE_OK) p->scan.zErr = sqlite3_mprintf("%s", sqlite3_errmsg(p->scan.db));
+  else if (rc != SQLITE_OK)
+  {
+    p->scan.rc = rc;
+    p->scan.zErr = sqlite3_mprintf("%s", sqlite3_errstr(rc));
+  }
+  // Writer needs no shared lock of part to commit
+  sqlitejsonScanClose(&p->scan);
+  if (p->scan.rc == SQLITE_OK) sqlitejsonIndexSort(p);
+}
+
+/*
+** Move merge cursor to the next key. Return SQLITE_DONE at the end of run.
+** Key of run in file points into read block and is valid until the next call
+*/
+static int sqlitejsonIndexNext(SqlitejsonIndexCursor *pCur){
+  sqlite3_int64 iVal;
+  const unsigned char *aHdr;
+  int nNeed = SQLITEJSON_INDEX_HEADER_SIZE, bHeader = 1;
+
+  if (!pCur->pFile)
+  {
+    if (pCur->iKey == pCur->nKey) return SQLITE_DONE;
+    pCur->key = pCur->aKey[pCur->iKey++];
+    return SQLITE_OK;
+  }
+  if (pCur->iBuf == pCur->nBuf && pCur->iOff == pCur->iEnd) return SQLITE_DONE;
+  for (;;)
+  {
+    // Key is read whole into block: header, then text or blob after it
+    while (pCur->nBuf - pCur->iBuf < nNeed)
+    {
+      int nRead, rc;
+      if (pCur->iOff == pCur->iEnd) return SQLITE_CORRUPT;
+      if (pCur->iBuf > 0)
+      {
+        memmove(pCur->aBuf, pCur->aBuf + pCur->iBuf, pCur->nBuf - pCur->iBuf);
+        pCur->nBuf -= pCur->iBuf;
+        pCur->iBuf = 0;
+      }
+      if (nNeed > pCur->nBufAlloc || pCur->nBuf == pCur->nBufAlloc)
+      {
+        int nNew = nNeed > SQLITEJSON_INDEX_BLOCK_SIZE ? nNeed : SQLITEJSON_INDEX_BLOCK_SIZE;
+        char *aNew = sqlite3_realloc(pCur->aBuf, nNew);
+        if (!aNew) return SQLITE_NOMEM;
+        pCur->aBuf = aNew;
+        pCur->nBufAlloc = nNew;
+      }
+      nRead = pCur->nBufAlloc - pCur->nBuf;
+      if (nRead > pCur->iEnd - pCur->iOff) nRead = (int)(pCur->iEnd - pCur->iOff);
+      rc = pCur->pFile->pMethods->xRead(pCur->pFile, pCur->aBuf + pCur->nBuf, nRead, pCur->iOff);
+      if (rc != SQLITE_OK) return rc;
+      pCur->nBuf += nRead;
+      pCur->iOff += nRead;
+    }
+    aHdr = (const unsigned char*)pCur->aBuf + pCur->iBuf;
+    memcpy(&iVal, &aHdr[9], 8);
+    if (!bHeader || (aHdr[0] != SQLITE_TEXT && aHdr[0] != SQLITE_BLOB)) break;
+    if (iVal < 0 || iVal > SQLITEJSON_MAX_ALLOC - SQLITEJSON_INDEX_HEADER_SIZE) return SQLITE_CORRUPT;
+    nNeed += (int)iVal;
+    bHeader = 0;
+  }
+  memset(&pCur->key, 0, sizeof(pCur->key));
+  pCur->key.eType = aHdr[0];
+  memcpy(&pCur->key.iRowid, &aHdr[1], 8);
+  if (aHdr[0] == SQLITE_INTEGER) pCur->key.i = iVal;
+  else if (aHdr[0] == SQLITE_FLOAT) memcpy(&pCur->key.r, &aHdr[9], 8);
+  else
+  {
+    pCur->key.n = (int)iVal;
+    pCur->key.z = (const char*)aHdr + SQLITEJSON_INDEX_HEADER_SIZE;
+  }
+  pCur->iBuf += nNeed;
+  return SQLITE_OK;
+}
+
+/* Restore heap order of merge cursors below position i */
+static void sqlitejsonIndexHeapDown(SqlitejsonIndexCursor **aHeap, int nHeap, int i){
+  for (;;)
+  {
+    int iMin = i, iChild = 2 * i + 1;
+    SqlitejsonIndexCursor *pTmp;
+    if (iChild < nHeap && sqlitejsonIndexCompare(&aHeap[iChild]->key, &aHeap[iMin]->key) < 0) iMin = iChild;
+    if (iChild + 1 < nHeap && sqlitejsonIndexCompare(&aHeap[iChild + 1]->key, &aHeap[iMin]->key) < 0) iMin = iChild + 1;
+    if (iMin == i) return;
+    pTmp = aHeap[i];
+    aHeap[i] = aHeap[iMin];
+    aHeap[iMin] = pTmp;
+    i = iMin;
+  }
+}
+
+/*
+** Create index table zIndex of values under zPath in column zColumn of table
+** zTable, keys are extracted with nThread threads. See sqlitejson.h
+*/
+int sqlite3_json_create_index(
+  sqlite3 *db,
+  const char *zIndex,
+  const char *zTable,
+  const char *zColumn,
+  const char *zPath,
+  int nThread,
+  char **pzErrMsg
+){
+  SqlitejsonIndexRun *aRun = 0;
+  SqlitejsonIndexCursor *aCur = 0, **aHeap = 0;
+  SqlitejsonTask *aTask = 0;
+  SqlitejsonFileColumn path;
+  SqlitejsonBuf args;
+  sqlite3_stmt *pStmt = 0;
+  const char *zFile = sqlite3_db_filename(db, "main");
+  char *zKeys = 0, *zSql = 0;
+  int nRun = 1, nCur = 0, nHeap = 0, i, j, rc = SQLITE_OK, bTrans = 0;
+
+  if (pzErrMsg) *pzErrMsg = 0;
+  sqlitejsonBufInit(&args);
+
+  // Path is written as arguments of json_get(): , 'user', 'id'
+  zKeys = sqlite3_malloc((int)strlen(zPath) + 1);
+  if (!zKeys)
+  {
+    rc = SQLITE_NOMEM;
+    goto index_end;
+  }
+  if (!sqlitejsonFileParseColumn(zPath, &path, zKeys))
+  {
+    if (pzErrMsg) *pzErrMsg = sqlite3_mprintf("json_create_index: invalid path %s", zPath);
+    rc = SQLITE_ERROR;
+    goto index_end;
+  }
+  for (i = 0; i < path.nStep; i++)
+  {
+    const JsonGetStreamStep *pStep = &path.aStep[i];
+    if (pStep->key)
+    {
+      char *zKey = sqlite3_mprintf("%.*s", pStep->key_length, pStep->key);
+      sqlitejsonBufAppendFree(&args, zKey ? sqlite3_mprintf(", %Q", zKey) : 0);
+      sqlite3_free(zKey);
+    }
+    else sqlitejsonBufAppendFree(&args, sqlite3_mprintf(", %d", pStep->index));
+  }
+  if (args.bOom)
+  {
+    rc = SQLITE_NOMEM;
+    goto index_end;
+  }
+
+  // Runs are extracted by own connections only if they see the same data as db
+  if (nThread > SQLITEJSON_SCAN_MAX_THREADS) nThread = SQLITEJSON_SCAN_MAX_THREADS;
+  if (nThread > 1 && zFile && zFile[0] && sqlite3_get_autocommit(db) && sqlite3_threadsafe()
+   && !sqlitejsonIsWal(db))
+  {
+    nRun = nThread;
+  }
+  aRun = sqlite3_malloc(nRun * (int)sizeof(SqlitejsonIndexRun));
+  aTask = sqlite3_malloc(nRun * (int)sizeof(SqlitejsonTask));
+  if (!aRun || !aTask)
+  {
+    rc = SQLITE_NOMEM;
+    goto index_end;
+  }
+  memset(aRun, 0, nRun * sizeof(SqlitejsonIndexRun));
+  memset(aTask, 0, nRun * sizeof(SqlitejsonTask));
+  for (i = 0; i < nRun; i++) sqlitejsonBufInit(&aRun[i].text);
+
+  // Index is created in one transaction, which also keeps table unchanged while runs start
+  if (sqlite3_get_autocommit(db))
+  {
+    rc = sqlite3_exec(db, "BEGIN", 0, 0, 0);
+    if (rc != SQLITE_OK) goto index_end;
+    bTrans = 1;
+  }
+  {
+    SqlitejsonScanPart aPart[SQLITEJSON_SCAN_MAX_THREADS];
+    memset(aPart, 0, nRun * sizeof(SqlitejsonScanPart));
+    rc = sqlitejsonScanSplit(db, zTable, aPart, nRun);
+    if (rc != SQLITE_OK) goto index_end;
+    for (i = 0; i < nRun; i++) aRun[i].scan = aPart[i];
+  }
+  zSql = sqlite3_mprintf("SELECT json_get(\"%w\"%.*s), rowid FROM main.\"%w\" WHERE rowid BETWEEN ?1 AND ?2",
+    zColumn, args.n, args.z, zTable);
+  if (!zSql)
+  {
+    rc = SQLITE_NOMEM;
+    goto index_end;
+  }
+  for (i = 0; i < nRun; i++)
+  {
+    aRun[i].scan.zSql = zSql;
+    aRun[i].scan.zFile = nRun > 1 ? zFile : 0;
+    aRun[i].scan.db = nRun > 1 ? 0 : db;
+  }
+  for (i = nRun - 1; i >= 0; i--) sqlitejsonTaskStart(&aTask[i], sqlitejsonIndexWork, &aRun[i], i > 0);
+  for (i = 0; i < nRun; i++) sqlitejsonTaskJoin(&aTask[i]);
+  sqlite3_free(zSql);
+  zSql = 0;
+  for (i = 0; i < nRun && rc == SQLITE_OK; i++)
+  {
+    if (aRun[i].scan.rc == SQLITE_OK) continue;
+    rc = aRun[i].scan.rc;
+    if (pzErrMsg) *pzErrMsg = aRun[i].scan.zErr, aRun[i].scan.zErr = 0;
+  }
+  if (rc != SQLITE_OK) goto index_end;
+
+  // Index table and triggers keeping it up to date
+  zSql = sqlite3_mprintf(
+    "CREATE TABLE main.\"%w\"(key, rid INTEGER, PRIMARY KEY(key, rid)) WITHOUT ROWID;"
+    "CREATE TRIGGER main.\"%w_insert\" AFTER INSERT ON \"%w\" WHEN json_get(new.\"%w\"%.*s) IS NOT NULL"
+    " BEGIN INSERT INTO \"%w\" VALUES(json_get(new.\"%w\"%.*s), new.rowid); END;"
+    "CREATE TRIGGER main.\"%w_delete\" AFTER DELETE ON \"%w\""
+    " BEGIN DELETE FROM \"%w\" WHERE key = json_get(old.\"%w\"%.*s) AND rid = old.rowid; END;"
+    "CREATE TRIGGER main.\"%w_update\" AFTER UPDATE ON \"%w\""
+    " BEGIN DELETE FROM \"%w\" WHERE key = json_get(old.\"%w\"%.*s) AND rid = old.rowid;"
+    " INSERT INTO \"%w\" SELECT json_get(new.\"%w\"%.*s), new.rowid WHERE json_get(new.\"%w\"%.*s) IS NOT NULL; END;",
+    zIndex,
+    zIndex, zTable, zColumn, args.n, args.z, zIndex, zColumn, args.n, args.z,
+    zIndex, zTable, zIndex, zColumn, args.n, args.z,
+    zIndex, zTable, zIndex, zColumn, args.n, args.z, zIndex, zColumn, args.n, args.z, zColumn, args.n, args.z);
+  rc = zSql ? sqlite3_exec(db, zSql, 0, 0, pzErrMsg) : SQLITE_NOMEM;
+  sqlite3_free(zSql);
+  zSql = 0;
+  if (rc != SQLITE_OK) goto index_end;
+
+  // Merge cursors of runs in files and of chunks left in memory
+  for (i = 0; i < nRun; i++) nCur += aRun[i].nSpill + 1;
+  aCur = sqlite3_malloc(nCur * (int)sizeof(SqlitejsonIndexCursor));
+  aHeap = sqlite3_malloc(nCur * (int)sizeof(SqlitejsonIndexCursor*));
+  if (!aCur || !aHeap)
+  {
+    rc = SQLITE_NOMEM;
+    goto index_end;
+  }
+  memset(aCur, 0, nCur * sizeof(SqlitejsonIndexCursor));
+  for (i = 0, nCur = 0; i < nRun; i++)
+  {
+    for (j = 0; j < aRun[i].nSpill; j++, nCur++)
+    {
+      aCur[nCur].pFile = aRun[i].pFile;
+      aCur[nCur].iOff = aRun[i].aSpill[j].iOff;
+      aCur[nCur].iEnd = aRun[i].aSpill[j].iOff + aRun[i].aSpill[j].nByte;
+    }
+    aCur[nCur].aKey = aRun[i].aKey;
+    aCur[nCur].nKey = aRun[i].nKey;
+    nCur++;
+  }
+  for (i = 0; i < nCur && rc == SQLITE_OK; i++)
+  {
+    rc = sqlitejsonIndexNext(&aCur[i]);
+    if (rc == SQLITE_OK) aHeap[nHeap++] = &aCur[i];
+    else if (rc == SQLITE_DONE) rc = SQLITE_OK;
+  }
+  for (i = nHeap / 2 - 1; i >= 0; i--) sqlitejsonIndexHeapDown(aHeap, nHeap, i);
+
+  // Runs are merged, so b-tree of index is written in order
+  if (rc == SQLITE_OK)
+  {
+    zSql = sqlite3_mprintf("INSERT INTO main.\"%w\"(key, rid) VALUES(?1, ?2)", zIndex);
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+  }
+  while (rc == SQLITE_OK && nHeap > 0)
+  {
+    const SqlitejsonIndexKey *pKey = &aHeap[0]->key;
+    switch (pKey->eType)
+    {
+      case SQLITE_INTEGER: sqlite3_bind_int64(pStmt, 1, pKey->i); break;
+      case SQLITE_FLOAT: sqlite3_bind_double(pStmt, 1, pKey->r); break;
+      case SQLITE_TEXT: sqlite3_bind_text(pStmt, 1, pKey->z, pKey->n, SQLITE_STATIC); break;
+      default: sqlite3_bind_blob(pStmt, 1, pKey->z, pKey->n, SQLITE_STATIC);
+    }
+    sqlite3_bind_int64(pStmt, 2, pKey->iRowid);
+    sqlite3_step(pStmt);
+    rc = sqlite3_reset(pStmt);
+    if (rc != SQLITE_OK) break;
+    // Key of file run is overwritten by the next key, it was copied by INSERT
+    rc = sqlitejsonIndexNext(aHeap[0]);
+    if (rc == SQLITE_DONE)
+    {
+      aHeap[0] = aHeap[--nHeap];
+      rc = SQLITE_OK;
+    }
+    sqlitejsonIndexHeapDown(aHeap, nHeap, 0);
+  }
+
+index_end:
+  if (rc != SQLITE_OK && pzErrMsg && !*pzErrMsg) *pzErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  sqlite3_finalize(pStmt);
+  if (bTrans) sqlite3_exec(db, rc == SQLITE_OK ? "COMMIT" : "ROLLBACK", 0, 0, 0);
+  for (i = 0; aRun && i < nRun; i++)
+  {
+    sqlitejsonScanClose(&aRun[i].scan);
+    sqlite3_free(aRun[i].scan.zErr);
+    sqlite3_free(aRun[i].aKey);
+    sqlitejsonBufReset(&aRun[i].text);
+    if (aRun[i].pFile && aRun[i].pFile->pMethods) aRun[i].pFile->pMethods->xClose(aRun[i].pFile);
+    sqlite3_free(aRun[i].pFile);
+    sqlite3_free(aRun[i].aSpill);
+  }
+  for (i = 0; aCur && i < nCur; i++) sqlite3_free(aCur[i].aBuf);
+  sqlite3_free(aCur);
+  sqlite3_free(aHeap);
+  sqlite3_free(aRun);
+  sqlite3_free(aTask);
+  sqlite3_free(zSql);
+  sqlite3_free(zKeys);
+  sqlitejsonBufReset(&args);
+  return rc;
+}
+
+/*
+** Take number under path from json document in column iCol of current row
+** of pStmt: json text, raw json blob, encoded or compressed json. Value is
+** read in place by jsonget_batch, compressed json is decompressed into pBuf.
+** Return 1 if value is a number or boolean, 0 if it is missing or other
+** type, -1 if out of memory
+*/
+static int sqlitejsonFetchPath(
+  sqlite3_stmt *pStmt,
+  int iCol,
+  const JsonGetPath *pPath,
+  SqlitejsonBuf *pBuf,
+  sqlite3_int64 *piVal,
+  double *prVal
+){
+  SqlitejsonDoc doc;
+  JsonGetBatchColumns out;
+  const char *zJson;
+  jsonget_int64 iVal;
+  int type;
+  memset(&doc, 0, sizeof(doc));
+  memset(&out, 0, sizeof(out));
+  if (sqlite3_column_type(pStmt, iCol) == SQLITE_BLOB)
+  {
+    const unsigned char *a = (const unsigned char*)sqlite3_column_blob(pStmt, iCol);
+    int n = sqlite3_column_bytes(pStmt, iCol);
+    if (n > SQLITEJSON_COMPRESSED_HEADER && memcmp(a, SQLITEJSON_COMPRESSED_MAGIC, 4) == 0)
+    {
+      unsigned size = sqlitejsonGet4(a + 4);
+      if (size >= 0x7fffffff) return 0;
+      pBuf->n = 0;
+      if (!sqlitejsonBufReserve(pBuf, (int)size + 1)) return -1;
+      if (!sqlitejsonLzDecompress(a + SQLITEJSON_COMPRESSED_HEADER, n - SQLITEJSON_COMPRESSED_HEADER,
+                                  (unsigned char*)pBuf->z, (int)size)) return 0;
+      pBuf->z[size] = 0;
+      a = (const unsigned char*)pBuf->z;
+      n = (int)size;
+    }
+    // Encoded json is walked on its text, navigation index is not needed for one path
+    if (sqlitejsonDocFromBytes(&doc, a, (unsigned)n)) zJson = doc.zJson;
+    else if (a == (const unsigned char*)pBuf->z) zJson = pBuf->z;
+    else zJson = (const char*)sqlite3_column_text(pStmt, iCol);
+  }
+  else zJson = (const char*)sqlite3_column_text(pStmt, iCol);
+  if (!zJson) return sqlite3_column_type(pStmt, iCol) == SQLITE_NULL ? 0 : -1;
+
+  out.type = &type;
+  out.as_int = &iVal;
+  out.as_double = prVal;
+  if (!jsonget_batch(&zJson, 1, pPath, &out)) return 0;
+  if (type != JSONGET_INTEGER && type != JSONGET_DOUBLE && type != JSONGET_BOOLEAN) return 0;
+  *piVal = iVal;
+  return 1;
+}
+
+/*
+** Step pStmt and write numbers of column iCol, or under path zPath of json
+** in column iCol, of up to nMaxRow rows to vector. See sqlitejson.h
+*/
+int sqlite3_json_fetch_column(
+  sqlite3_stmt *pStmt,
+  int iCol,
+  const char *zPath,
+  int nMaxRow,
+  sqlite3_json_vector *pVector
+){
+  JsonGetPath path;
+  SqlitejsonBuf buf;
+  int rc = SQLITE_ROW;
+
+  pVector->nRow = 0;
+  if (nMaxRow <= 0 || iCol < 0 || iCol >= sqlite3_column_count(pStmt)) return SQLITE_MISUSE;
+  if (zPath && !jsonget_path_compile(&path, zPath, -1)) return SQLITE_MISUSE;
+  if (pVector->aValid) memset(pVector->aValid, 0, (nMaxRow + 7) / 8);
+  sqlitejsonBufInit(&buf);
+  while (pVector->nRow < nMaxRow)
+  {
+    sqlite3_int64 iVal = 0;
+    double rVal = 0.0;
+    int i = pVector->nRow, bValid;
+    rc = sqlite3_step(pStmt);
+    if (rc != SQLITE_ROW) break;
+    if (zPath) bValid = sqlitejsonFetchPath(pStmt, iCol, &path, &buf, &iVal, &rVal);
+    else
+    {
+      // Value is used as is, e.g. result of "->" expression
+      int eType = sqlite3_column_type(pStmt, iCol);
+      bValid = eType == SQLITE_INTEGER || eType == SQLITE_FLOAT;
+      if (bValid)
+      {
+        iVal = sqlite3_column_int64(pStmt, iCol);
+        rVal = sqlite3_column_double(pStmt, iCol);
+      }
+    }
+    if (bValid < 0)
+    {
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    if (pVector->aInt) pVector->aInt[i] = bValid ? iVal : 0;
+    if (pVector->aDouble) pVector->aDouble[i] = bValid ? rVal : 0.0;
+    if (pVector->aValid && bValid) pVector->aValid[i / 8] |= (unsigned char)(1 << (i % 8));
+    pVector->nRow++;
+  }
+  sqlitejsonBufReset(&buf);
+  return rc;
+}
+
+/*
+** Destructor of function user data. Connection state is freed with the
+** last function registered with it
+*/
+static void sqlitejsonFuncDestroy(void *p){
+  SqlitejsonConn *pConn = ((SqlitejsonFunc*)p)->pConn;
+  int i;
+  if (--pConn->nRef > 0) return;
+  for (i = 0; i < SQLITEJSON_CACHE_SIZE; i++) sqlitejsonCacheClear(&pConn->aCache[i]);
+  sqlite3_free(pConn);
 }
 
 /*
@@ -157,21 +5129,73 @@ int sqlite3JsonInit(sqlite3 *db){
     void (*xFunc)(sqlite3_context*,int,sqlite3_value**);
   } scalars[] = {
     {"json_get",   -1, SQLITE_ANY,         0, sqlitejsonGetFunc},
+    {"json_raw",   -1, SQLITE_ANY, SQLITEJSON_INT_TO_PTR(1), sqlitejsonGetFunc},
+    {"json_step",   1, SQLITE_UTF8,        0, sqlitejsonStepFunc},
+    {"json_get_rowid", -1, SQLITE_UTF8,    0, sqlitejsonGetRowidFunc},
+    {"json_has",   -1, SQLITE_ANY,         0, sqlitejsonHasFunc},
+    {"json_eq",    -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_OP_EQ), sqlitejsonCompareFunc},
+    {"json_ne",    -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_OP_NE), sqlitejsonCompareFunc},
+    {"json_lt",    -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_OP_LT), sqlitejsonCompareFunc},
+    {"json_le",    -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_OP_LE), sqlitejsonCompareFunc},
+    {"json_gt",    -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_OP_GT), sqlitejsonCompareFunc},
+    {"json_ge",    -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_OP_GE), sqlitejsonCompareFunc},
+    {"json_in",    -1, SQLITE_UTF8,        0, sqlitejsonInFunc},
+    {"json_type",  -1, SQLITE_ANY,         0, sqlitejsonTypeFunc},
+    {"json_is_array",  -1, SQLITE_ANY, SQLITEJSON_INT_TO_PTR(JSONGET_ARRAY), sqlitejsonIsTypeFunc},
+    {"json_is_object", -1, SQLITE_ANY, SQLITEJSON_INT_TO_PTR(JSONGET_OBJECT), sqlitejsonIsTypeFunc},
+    {"json_set",     -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_MODIFY_SET), sqlitejsonModifyFunc},
+    {"json_replace", -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_MODIFY_REPLACE), sqlitejsonModifyFunc},
+    {"json_insert",  -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_MODIFY_INSERT), sqlitejsonModifyFunc},
+    {"json_remove",  -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(SQLITEJSON_MODIFY_REMOVE), sqlitejsonModifyFunc},
+    {"json_patch",    2, SQLITE_UTF8, 0, sqlitejsonPatchFunc},
+    {"json_diff",     2, SQLITE_UTF8, 0, sqlitejsonDiffFunc},
+    {"json_minify",   1, SQLITE_UTF8, 0, sqlitejsonMinifyFunc},
+    {"json_encode",   1, SQLITE_ANY,  0, sqlitejsonEncodeFunc},
+    {"json_text",     1, SQLITE_ANY,  0, sqlitejsonTextFunc},
+    {"json_compress", 1, SQLITE_ANY,  0, sqlitejsonCompressFunc},
+    {"json_compress", 2, SQLITE_ANY,  0, sqlitejsonCompressFunc},
+    {"json_object",  -1, SQLITE_UTF8, SQLITEJSON_INT_TO_PTR(1), sqlitejsonBuildFunc},
+    {"json_array",   -1, SQLITE_UTF8, 0, sqlitejsonBuildFunc},
   };
 
+  int nScalar = (int)(sizeof(scalars)/sizeof(scalars[0]));
   int rc = SQLITE_OK;
   int i;
+  SqlitejsonConn *pConn;
+  SqlitejsonFunc *aFunc;
+
+  /* Connection state is followed by user data of every function */
+  pConn = sqlite3_malloc(sizeof(SqlitejsonConn) + nScalar*sizeof(SqlitejsonFunc));
+  if( !pConn ) return SQLITE_NOMEM;
+  memset(pConn, 0, sizeof(SqlitejsonConn));
+  aFunc = (SqlitejsonFunc*)&pConn[1];
+  pConn->nRef = 1;
 
-  for(i=0; rc==SQLITE_OK && i<(int)(sizeof(scalars)/sizeof(scalars[0])); i++){
+  for(i=0; rc==SQLITE_OK && i<nScalar; i++){
     struct JsonScalar *p = &scalars[i];
-    rc = sqlite3_create_function(
-        db, p->zName, p->nArg, p->enc, p->pContext, p->xFunc, 0, 0
+    aFunc[i].pConn = pConn;
+    aFunc[i].xFunc = p->xFunc;
+    aFunc[i].pArg = p->pContext;
+    pConn->nRef++;
+    rc = sqlite3_create_function_v2(
+        db, p->zName, p->nArg, p->enc, &aFunc[i], sqlitejsonCall, 0, 0,
+        sqlitejsonFuncDestroy
     );
   }
+  sqlitejsonFuncDestroy(aFunc);
 
   return rc;
 }
 
+/*
+** Register virtual table json_file with database db. It reads any file
+** the process can read, so it is not registered by sqlite3JsonInit and
+** must be enabled by application explicitly
+*/
+int sqlite3JsonFileInit(sqlite3 *db){
+  return sqlite3_create_module(db, "json_file", &sqlitejsonFileModule, 0);
+}
+
 #if !SQLITE_CORE
 #ifdef _WIN32
 __declspec(dllexport)
@@ -184,6 +5208,19 @@ int sqlite3_json_init(
   SQLITE_EXTENSION_INIT2(pApi)
   return sqlite3JsonInit(db);
 }
+
+/* Entry point of json_file, load it as load_extension(file, 'sqlite3_json_file_init') */
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_json_file_init(
+  sqlite3 *db, 
+  char **pzErrMsg,
+  const sqlite3_api_routines *pApi
+){
+  SQLITE_EXTENSION_INIT2(pApi)
+  return sqlite3JsonFileInit(db);
+}
 #endif
 
 #endif
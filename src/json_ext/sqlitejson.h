@@ -19,6 +19,125 @@ extern "C" {
 
 int sqlite3JsonInit(sqlite3 *db);
 
+/*
+** Register virtual table json_file. It can read any file readable by the
+** process, so it is not registered by sqlite3JsonInit
+*/
+int sqlite3JsonFileInit(sqlite3 *db);
+
+/*
+** Formats of documents stored by sqlite3_json_bulk_load
+*/
+#define SQLITE_JSON_BULK_TEXT    0    /* Json text as is */
+#define SQLITE_JSON_BULK_MINIFY  1    /* Json text without whitespace, see json_minify() */
+#define SQLITE_JSON_BULK_ENCODE  2    /* Encoded json blob, see json_encode() */
+
+/*
+** Load json documents into database. xNext is called until it returns
+** SQLITE_DONE and must set *pzDoc and *pnDoc (-1 if zero terminated) to next
+** document when it returns SQLITE_ROW, other code stops the load with that
+** error. Document is copied, so it may be overwritten by the next call.
+** Worker threads (up to nThread) validate documents, convert them to eFormat
+** and take values under nPath paths ("key.0.key", like json_file() columns)
+** while the calling thread runs INSERT statement zSql with document bound
+** to ?1 and path values to ?2, ?3 ...
+** Load is one transaction unless a transaction is already open, invalid
+** document is an error. Error message is written to *pzErrMsg, it must be
+** freed with sqlite3_free()
+*/
+int sqlite3_json_bulk_load(
+  sqlite3 *db,                       /* Database connection */
+  const char *zSql,                  /* INSERT statement */
+  const char *const *azPath,         /* Paths of values bound to ?2, ?3 ... */
+  int nPath,                         /* Number of paths */
+  int eFormat,                       /* SQLITE_JSON_BULK_TEXT, MINIFY or ENCODE */
+  int nThread,                       /* Number of worker threads, 0 for none */
+  int (*xNext)(void *pArg, const char **pzDoc, int *pnDoc),
+  void *pArg,                        /* First argument of xNext */
+  char **pzErrMsg                    /* OUT: Error message */
+);
+
+/*
+** Compute aggregates over table zTable of main database with nThread threads.
+** Aggregates are written as in SELECT: "sum(doc->total)", "count(*)" ...,
+** supported are count, sum, total, min, max and avg of one argument, DISTINCT
+** and expressions over several aggregates are not. zWhere is filter of rows
+** or NULL. Rowid range is split into nThread parts, every part is aggregated
+** by its own read-only connection, and partial results are merged. Result row
+** is passed to xCallback as by sqlite3_exec(), column names are azAgg.
+** zWhere and azAgg run on new connections to the database file: temporary
+** tables, attached databases and functions registered with db are not
+** available to them. Table is scanned with db only, without threads, when
+** database is in memory, temporary or in WAL mode, or db has open transaction
+*/
+int sqlite3_json_parallel_aggregate(
+  sqlite3 *db,                       /* Database connection */
+  const char *zTable,                /* Table name */
+  const char *zWhere,                /* Filter or NULL */
+  const char *const *azAgg,          /* Aggregate expressions */
+  int nAgg,                          /* Number of aggregates */
+  int nThread,                       /* Number of threads */
+  int (*xCallback)(void*, int, char**, char**),
+  void *pArg,                        /* First argument of xCallback */
+  char **pzErrMsg                    /* OUT: Error message */
+);
+
+/*
+** Create index of values under zPath ("key.0.key", like json_file() columns)
+** in column zColumn of table zTable in main database. Index is table zIndex
+** with columns key and rid (rowid of zTable), stored WITHOUT ROWID in key
+** order, and triggers zIndex_insert, zIndex_delete and zIndex_update keep it
+** up to date. nThread threads extract and sort keys of rowid ranges with own
+** read-only connections in chunks of up to 64 MB, chunks beyond the last are
+** written to temporary files. Runs are merged into index in key order.
+** Rows without value under path are not indexed. Triggers call json_get(),
+** so json functions must be registered with every connection that writes
+** to zTable
+*/
+int sqlite3_json_create_index(
+  sqlite3 *db,                       /* Database connection */
+  const char *zIndex,                /* Name of index table */
+  const char *zTable,                /* Indexed table */
+  const char *zColumn,               /* Json column */
+  const char *zPath,                 /* Path of key */
+  int nThread,                       /* Number of threads */
+  char **pzErrMsg                    /* OUT: Error message */
+);
+
+/*
+** Column vector filled by sqlite3_json_fetch_column. Caller provides arrays
+** of nMaxRow elements, aValid of (nMaxRow + 7) / 8 bytes, any of them may be
+** NULL if it is not needed
+*/
+typedef struct sqlite3_json_vector sqlite3_json_vector;
+struct sqlite3_json_vector {
+  sqlite3_int64 *aInt;               /* Integer values, truncated floats, 0 if no number */
+  double *aDouble;                   /* Float values, 0.0 if no number */
+  unsigned char *aValid;             /* Bit (i % 8) of byte (i / 8) is set if row i has number */
+  int nRow;                          /* OUT: Number of rows written */
+};
+
+/*
+** Step statement up to nMaxRow times and write number of each row to pVector.
+** If zPath is NULL, number is the value of column iCol, e.g. of "doc->price".
+** Otherwise column iCol is json document (text, json_raw() blob, encoded or
+** compressed json) and number is value under zPath (keys and indexes
+** separated by '.', see jsonget_path_compile), read from document in place
+** without a function call per row. true and false are 1 and 0, other values
+** are not numbers and leave bit of aValid clear.
+** Return SQLITE_ROW after nMaxRow rows: statement may have more rows, call
+** again for them. Return SQLITE_DONE when statement is complete, nRow may
+** be greater than 0 then. SQLITE_MISUSE means invalid iCol, zPath or
+** nMaxRow, other codes are errors of sqlite3_step()
+*/
+int sqlite3_json_fetch_column(
+  sqlite3_stmt *pStmt,               /* Statement to step */
+  int iCol,                          /* Column to fetch */
+  const char *zPath,                 /* Path in json of column, or NULL */
+  int nMaxRow,                       /* Size of arrays of pVector */
+  sqlite3_json_vector *pVector       /* OUT: Values of rows */
+);
+
 #ifdef __cplusplus
 }  /* extern "C" */
-#endif  /* __cplusplus */
\ No newline at end of file
+#endif  /* __cplusplus */
@@ -0,0 +1,129 @@
+/*
+** Tests of jsonget batch extraction
+**
+** Each case compiles a path and takes it from a set of documents, more than
+** one group of jsonget_batch. Every column of every document is printed as
+** "type:int:double:slice" or "-" if value is missing or null, and compared
+** with the expected text together with validity bitmap and returned count.
+**
+** Build and run from src/json_ext:
+**
+**    cc -Wall -I. -o batch_test test/batch_test.c jsonget.c && ./batch_test
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "jsonget.h"
+
+#define MAX_DOCS 16
+#define MAX_OUT 2048
+
+static const char *const docs[] =
+{
+	"{\"user\": {\"id\": 1}, \"items\": [{\"price\": 2.5}, {\"price\": 3}]}",
+	"{\"user\": {\"id\": -7}}",
+	"{\"user\": {\"id\": null}}",
+	"{\"user\": {}}",
+	0,
+	"{\"user\": {\"id\": \"a\\\"b\"}}",
+	"{\"user\": {\"id\": true}}",
+	"{\"user\": {\"id\": 1e30}, \"items\": []}",
+	"{\"user\": {\"id\": 9007199254740993}}",
+	"[",
+	"{\"user\": {\"id\": [1, 2]}}",
+	"{\"user\": {\"id\": -2.5}, \"2024\": 1, \"-0\": 5, \"items\": [7, 8]}",
+};
+
+typedef struct
+{
+	const char *path;		// path to compile
+	const char *expected;		// values of documents separated by ' ', then "= count"
+} BatchCase;
+
+static const BatchCase cases[] =
+{
+	{"user.id",
+		"3:1:1:1 3:-7:-7:-7 - - - 5:0:0:a\\\"b 2:1:1:true 3:9223372036854775807:1e+30:1e30"
+		" 3:9007199254740993:9.0072e+15:9007199254740993 - 7:0:0:[1, 2] 4:-2:-2.5:-2.5 = 8"},
+	{"items.-1.price",
+		"3:3:3:3 - - - - - - - - - - - = 1"},
+	{"items.0",
+		"6:0:0:{\"price\": 2.5} - - - - - - - - - - 3:7:7:7 = 2"},
+	// Digit step is index, so key "2024" is missing, "-0" is key
+	{"2024",
+		"- - - - - - - - - - - - = 0"},
+	{"-0",
+		"- - - - - - - - - - - 3:5:5:5 = 1"},
+};
+
+// Paths that don't compile
+static const char *const bad_paths[] = {"", ".", "a..b", "a.", "1.2.3.4.5.6.7.8.9.10.11.12.13.14.15.16.17"};
+
+static void batch_run(const BatchCase *test, char *out)
+{
+	int count = (int)(sizeof(docs) / sizeof(docs[0]));
+	int type[MAX_DOCS];
+	jsonget_int64 as_int[MAX_DOCS];
+	double as_double[MAX_DOCS];
+	const char *slice[MAX_DOCS];
+	int slice_length[MAX_DOCS];
+	unsigned char valid[MAX_DOCS / 8];
+	JsonGetBatchColumns columns;
+	JsonGetPath path;
+	int i, valid_count;
+
+	out[0] = 0;
+	if (!jsonget_path_compile(&path, test->path, -1))
+	{
+		strcpy(out, "not compiled");
+		return;
+	}
+	columns.type = type;
+	columns.as_int = as_int;
+	columns.as_double = as_double;
+	columns.slice = slice;
+	columns.slice_length = slice_length;
+	columns.valid = valid;
+	memset(valid, 0xff, sizeof(valid));
+	valid_count = jsonget_batch(docs, count, &path, &columns);
+	for (i = 0; i < count; i++)
+	{
+		char value[256];
+		int is_valid = (valid[i / 8] >> (i % 8)) & 1;
+		if (is_valid != (type[i] != JSONGET_INVALID && type[i] != JSONGET_NULL)) sprintf(value, "bitmap?");
+		else if (!is_valid) sprintf(value, "-");
+		else sprintf(value, "%d:%lld:%g:%.*s", type[i], (long long)as_int[i], as_double[i], slice_length[i], slice[i]);
+		if (i) strcat(out, " ");
+		strcat(out, value);
+	}
+	sprintf(out + strlen(out), " = %d", valid_count);
+}
+
+int main(void)
+{
+	int count = 0, failed = 0, i;
+	for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+	{
+		char out[MAX_OUT];
+		batch_run(&cases[i], out);
+		count++;
+		if (strcmp(out, cases[i].expected) != 0)
+		{
+			printf("FAIL %s\n  result: %s\n  expected: %s\n", cases[i].path, out, cases[i].expected);
+			failed++;
+		}
+	}
+	for (i = 0; i < (int)(sizeof(bad_paths) / sizeof(bad_paths[0])); i++)
+	{
+		JsonGetPath path;
+		count++;
+		if (jsonget_path_compile(&path, bad_paths[i], -1))
+		{
+			printf("FAIL path \"%s\" is compiled\n", bad_paths[i]);
+			failed++;
+		}
+	}
+
+	printf("%d of %d batch tests failed\n", failed, count);
+	return failed != 0;
+}
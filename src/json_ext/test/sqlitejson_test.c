@@ -0,0 +1,720 @@
+/*
+** Tests of json extension functions
+**
+** Each test is one SQL statement and its expected result: rows separated by
+** newline, columns by '|', NULL is "NULL" and error is "ERR " followed by
+** error message. Tests that need the C API are functions in aFuncTest.
+**
+** Build and run from src/json_ext, linked with SQLite library:
+**
+**    cc -Wall -DSQLITE_CORE -DSQLITE_ENABLE_JSON -I. -o sqlitejson_test \
+**       test/sqlitejson_test.c sqlitejson.c jsonget.c -lsqlite3 -lpthread
+**    ./sqlitejson_test
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "sqlite3.h"
+#include "sqlitejson.h"
+
+#define MAX_OUT 4096
+
+typedef struct SqlitejsonTest SqlitejsonTest;
+struct SqlitejsonTest {
+  const char *zSql;        /* Statement */
+  const char *zExpected;   /* Expected result */
+};
+
+static const SqlitejsonTest aTest[] = {
+  /* json_get */
+  {"SELECT json_get('{\"a\": true, \"b\": 2}', 'b'), json_get('[true, false, null, 5]', 3)", "2|5"},
+  {"SELECT json_get('[0.5, -0.5, 12345678901.5, 0.5e2]', 0), json_get('[0.5, -0.5, 12345678901.5, 0.5e2]', 1),"
+   " json_get('[0.5, -0.5, 12345678901.5, 0.5e2]', 2), json_get('[0.5, -0.5, 12345678901.5, 0.5e2]', 3)",
+   "0.5|-0.5|12345678901.5|50.0"},
+  {"SELECT json_get('{\"a\": {\"x\": 1}}', 'a') = '{\"x\": 1}'", "1"},
+  {"SELECT json_get('{\"a\": ', 'a'), json_get('{\"keyword\": 1}', 'key')", "NULL|NULL"},
+
+  /* Fused comparisons, "->" comparisons are rewritten to them by the parser */
+  {"SELECT json_eq('{\"status\":\"active\"}', 'status', 'active'), json_ne('{\"status\":\"active\"}', 'status', 'active')",
+   "1|0"},
+  {"SELECT json_eq('{\"s\":\"ab\"}', 's', 'abc'), json_lt('{\"s\":\"ab\"}', 's', 'abc'), json_gt('{\"s\":\"b\"}', 's', 'abc')",
+   "0|1|1"},
+  {"SELECT json_eq('{\"s\":\"caf\\u00e9 \\\"x\\\"\"}', 's', 'caf' || char(233) || ' \"x\"')", "1"},
+  {"SELECT json_lt('{\"total\": 400}', 'total', 1000), json_ge('{\"total\": 400}', 'total', 400.0),"
+   " json_gt('{\"t\": 0.5}', 't', 0), json_le('{\"t\": -2}', 't', -3)",
+   "1|1|1|0"},
+  {"SELECT json_lt('{\"a\": 5}', 'a', 'x'), json_gt('{\"a\": \"x\"}', 'a', 5), json_eq('{\"a\": true}', 'a', 1)",
+   "1|1|1"},
+  {"SELECT json_eq('{\"a\": null}', 'a', 1), json_eq('{\"a\": 1}', 'b', 1), json_eq('{\"a\": 1}', 'a', NULL)",
+   "NULL|NULL|NULL"},
+  {"SELECT json_eq('{\"a\": [1, {\"b\": \"x\"}]}', 'a', 1, 'b', 'x'), json_eq('{\"a\":{\"x\":1}}', 'a', '{\"x\":1}')",
+   "1|1"},
+
+  /* IN-lists: set is rebuilt when value that is not constant changes */
+  {"SELECT json_in(doc, 1, 'c', v, 'XX') FROM (SELECT '{\"c\":\"DE\"}' AS doc, 'DE' AS v"
+   " UNION ALL SELECT '{\"c\":\"DE\"}', 'FR' UNION ALL SELECT '{\"c\":\"FR\"}', 'FR'"
+   " UNION ALL SELECT '{\"c\":\"IT\"}', NULL)",
+   "1\n0\n1\nNULL"},
+  {"SELECT json_in(doc, 1, 'c', 'DE', 'FR') FROM (SELECT '{\"c\":\"FR\"}' AS doc UNION ALL SELECT '{\"c\":\"IT\"}')",
+   "1\n0"},
+  {"SELECT json_in('{\"a\":{\"b\":2.0}}', 2, 'a', 'b', 1, 2), json_in('{\"a\":\"x\\u0041\"}', 1, 'a', 'xA'),"
+   " json_in('{\"a\":1}', 1, 'a', 2, NULL), json_in('{\"a\":1}', 1, 'b', 1)",
+   "1|1|NULL|NULL"},
+  {"SELECT json_in(doc, 1, 'c', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',"
+   " 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', v)"
+   " FROM (SELECT '{\"c\":\"DE\"}' AS doc, 'DE' AS v UNION ALL SELECT '{\"c\":\"DE\"}', 'FR')",
+   "1\n0"},
+  {"SELECT json_in('{\"a\":1}', 5, 'a')", "ERR Invalid number of arguments"},
+
+  /* Key existence */
+  {"SELECT json_has('{\"a\":{\"b\":null}}', 'a', 'b'), json_has('{\"a\":{\"b\":null}}', 'a', 'c'),"
+   " json_has('{\"a\":1}', 'a', 'x'), json_has('{\"a\":1}')",
+   "1|0|0|1"},
+  {"SELECT json_has('[1,2]', 1), json_has('[1,2]', 2), json_has(NULL, 'a'), json_has('x', 'a')",
+   "1|0|NULL|0"},
+
+  /* Types */
+  {"SELECT json_type('[1,2.5,\"s\",true,null,{},[]]', 0), json_type('[1,2.5,\"s\",true,null,{},[]]', 1),"
+   " json_type('[1,2.5,\"s\",true,null,{},[]]', 2), json_type('[1,2.5,\"s\",true,null,{},[]]', 3),"
+   " json_type('[1,2.5,\"s\",true,null,{},[]]', 4), json_type('[1,2.5,\"s\",true,null,{},[]]', 5),"
+   " json_type('[1,2.5,\"s\",true,null,{},[]]', 6), json_type('{\"a\":1}', 'b')",
+   "integer|double|string|boolean|null|object|array|NULL"},
+  {"SELECT json_is_array('[1]'), json_is_array('{}'), json_is_object('{}'), json_is_object('[1]', 'x'), json_is_array(NULL)",
+   "1|0|1|0|NULL"},
+
+
+  /* Path elements from expressions and columns */
+  {"SELECT json_get('{\"ab\":{\"x\":[5,6,7]}}', 'a' || 'b', 'x', 1 + 1), json_get('{\"1\":\"key\"}', '1')", "7|key"},
+  {"SELECT json_get(doc, k) FROM (SELECT '{\"a\":1,\"b\":2}' AS doc, 'a' AS k"
+   " UNION ALL SELECT '{\"a\":1,\"b\":2}', 'b' UNION ALL SELECT '[7,8]', 1)",
+   "1\n2\n8"},
+
+  /* Wildcard steps */
+  {"SELECT json_get('{\"items\":[{\"price\":1},{\"price\":2},{\"x\":3}]}', 'items', json_step('*'), 'price')",
+   "[1,2]"},
+  {"SELECT json_get('{\"a\":{\"x\":1,\"y\":[2,3]}}', 'a', json_step('*')),"
+   " json_get('{\"a\":[[1,2],[3]]}', 'a', json_step('*'), json_step('*')),"
+   " json_get('{\"a\":5}', 'b', json_step('*')), json_get('[]', json_step('*'))",
+   "[1,[2,3]]|[1,2,3]|[]|[]"},
+  {"SELECT json_step(NULL), hex(json_step('*')), json_get('{\"JS\":1}', x'4a53')", "NULL|004A532A|1"},
+  {"SELECT json_step('x')", "ERR Invalid path step"},
+
+  /* Filter steps */
+  {"SELECT json_get('{\"items\":[{\"q\":1,\"n\":\"a\"},{\"q\":0,\"n\":\"b\"},{\"q\":5,\"n\":\"c\"}]}',"
+   " 'items', json_step('?(@.q > 0)'), 'n')",
+   "[\"a\",\"c\"]"},
+  {"SELECT json_get('{\"items\":[{\"q\":1,\"n\":\"a\"},{\"q\":0,\"n\":\"b\"},{\"q\":5}]}',"
+   " 'items', json_step('?(@.n)'), 'q')",
+   "[1,0]"},
+  {"SELECT json_get('{\"items\":[{\"t\":\"x\"},{\"t\":\"y\"}]}', 'items', json_step('?(@.t == ''y'')'), 't')",
+   "[\"y\"]"},
+  {"SELECT json_get('{\"a\":{\"b\":[{\"c\":null},{\"c\":2}]}}', 'a', 'b', json_step('?(@.c == null)')),"
+   " json_get('[{\"a\":true},{\"a\":false}]', json_step('?(@.a == true)'))",
+   "[{\"c\":null}]|[{\"a\":true}]"},
+  {"SELECT json_get('{\"a\":[{\"c\":{\"d\":[1,7]}},{\"c\":{\"d\":[2]}}]}', 'a', json_step('?(@.c.d.1 >= 5)'))",
+   "[{\"c\":{\"d\":[1,7]}}]"},
+  {"SELECT json_get('[1]', json_step('?(@.c ~ 1)'))", "ERR Invalid path step"},
+
+  /* Recursive descent steps */
+  {"SELECT json_get('{\"a\": {\"id\": 1, \"b\": {\"id\": 2}}, \"c\": [{\"id\": 3}]}', json_step('..id')),"
+   " json_get('{\"a\": {\"id\": 1, \"b\": {\"id\": 2}}, \"c\": [{\"id\": 3}]}', json_step('[..id]'))",
+   "1|[1,2,3]"},
+  {"SELECT json_get('{\"x\": {\"b\": {\"id\": 2}}, \"id\": 9}', json_step('..id')),"
+   " json_get('{\"a\":[{\"b\":{\"n\":1}},{\"b\":{\"n\":2}}]}', json_step('..b'), 'n'),"
+   " json_get('{\"a\":1}', json_step('..z')), json_get('{\"a\":1}', json_step('[..z]'))",
+   "2|1|NULL|[]"},
+  {"SELECT json_has('{\"a\":{\"id\":null}}', json_step('..id')), json_eq('{\"a\":{\"id\":5}}', json_step('..id'), 5)",
+   "1|1"},
+  {"SELECT json_get('{\"a\":{\"id\":1}}', json_step('[?(@.id)]')), json_get('[0,1]', json_step('[*]'))",
+   "[{\"id\":1}]|[0,1]"},
+
+  /* Negative indexes and slice steps */
+  {"SELECT json_get('[0,1,2]', -1), json_get('[0,1,2]', -3), json_get('[0,1,2]', -4), json_get('{\"a\":[1,2]}', 'a', -1)",
+   "2|0|NULL|2"},
+  {"SELECT json_get('[0,1,2,3,4,5,6,7,8,9]', json_step('[2:5]'))", "[2,3,4]"},
+  {"SELECT json_get('[0,1,2,3,4,5,6,7,8,9]', json_step('[::3]'))", "[0,3,6,9]"},
+  {"SELECT json_get('[0,1,2,3,4,5,6,7,8,9]', json_step('[-3:]'))", "[7,8,9]"},
+  {"SELECT json_get('[0,1,2,3,4,5,6,7,8,9]', json_step('[:-8]'))", "[0,1]"},
+  {"SELECT json_get('[{\"a\":1},{\"a\":2},{\"a\":3}]', json_step('[1:]'), 'a')", "[2,3]"},
+  {"SELECT json_get('[0,1,2]', json_step('[5:9]'))", "[]"},
+  {"SELECT json_step('[1:2:0]')", "ERR Invalid path step"},
+
+  /* Modification functions splice unchanged text */
+  {"SELECT json_set('{\"status\": \"new\", \"n\": 1}', 'status', 'done'), json_set('{\"a\":1}', 'b', 2.5),"
+   " json_set('{\"a\":{}}', 'a', 'k', NULL)",
+   "{\"status\": \"done\", \"n\": 1}|{\"a\":1,\"b\":2.5}|{\"a\":{\"k\":null}}"},
+  {"SELECT json_set('[1]', 1, 'x'), json_set('[1]', 3, 'x'), json_set('{\"a\":1}', 'x', 'y', 1),"
+   " json_set('{\"a\":[1,{\"b\":2}]}', 'a', 1, 'b', 3)",
+   "[1,\"x\"]|[1]|{\"a\":1}|{\"a\":[1,{\"b\":3}]}"},
+  {"SELECT json_replace('{\"a\":1}', 'a', 2), json_replace('{\"a\":1}', 'b', 2),"
+   " json_insert('{\"a\":1}', 'a', 2), json_insert('{\"a\":1}', 'b', 'q\"')",
+   "{\"a\":2}|{\"a\":1}|{\"a\":1}|{\"a\":1,\"b\":\"q\\\"\"}"},
+  {"SELECT json_remove('[1, 2, 3]', -1), json_remove('[1, 2, 3]', 0), json_remove('{\"a\":1, \"b\":2}', 'a'),"
+   " json_remove('{\"a\":1, \"b\":2}', 'b'), json_remove('{\"a\":1}', 'z'), json_remove('{\"a\":1}', 'a')",
+   "[1, 2]|[2, 3]|{\"b\":2}|{\"a\":1}|{\"a\":1}|{}"},
+  {"SELECT json_set('{\"a\":1}', 'a', x'5b315d'), json_set('x', 'a', 1), json_set(NULL, 'a', 1)", "{\"a\":[1]}|x|NULL"},
+
+  /* Merge patch */
+  {"SELECT json_patch('{\"a\":1,\"b\":{\"c\":2,\"d\":3}}', '{\"b\":{\"d\":4,\"x\":5},\"a\":null}')",
+   "{\"b\":{\"c\":2,\"d\":4,\"x\":5}}"},
+  {"SELECT json_patch('{\"a\":1,\"b\":2}', '{\"c\":3,\"b\":5}'), json_patch('{\"a\":1,\"b\":2}', '{\"a\":null,\"b\":3}'),"
+   " json_patch('{\"a\":1}', '{\"b\":{\"c\":null,\"d\":1}}')",
+   "{\"a\":1,\"b\":5,\"c\":3}|{\"b\":3}|{\"a\":1,\"b\":{\"d\":1}}"},
+  {"SELECT json_patch('{\"a\":1}', '[1,2]'), json_patch('{\"a\":[1,2]}', '{\"a\":{\"b\":1}}'), json_patch('[1]', '{\"a\":1}'),"
+   " json_patch('{\"a\":1}', 'x'), json_patch(NULL, '{}')",
+   "[1,2]|{\"a\":{\"b\":1}}|{\"a\":1}|NULL|NULL"},
+  {"WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c WHERE i < 19999),"
+   " d AS (SELECT '{' || group_concat('\"k' || i || '\":' || i, ',') || '}' AS t,"
+   " '{' || group_concat('\"k' || i || '\":' || (i + 1), ',') || '}' AS p FROM c)"
+   " SELECT json_get(json_patch(t, p), 'k19999'), length(json_patch(t, p)) FROM d",
+   "20000|277785"},
+
+  /* Constructors, measured and written lengths match */
+  {"SELECT json_array(json_raw('{\"a\":[1,2]}','a')), json_array(), json_object()", "[[1,2]]|[]|{}"},
+  {"SELECT json_object('k', json_raw('{\"a\":{\"b\":\"x\"}}','a'), 'n', 1.5, 'z', NULL)",
+   "{\"k\":{\"b\":\"x\"},\"n\":1.5,\"z\":null}"},
+  {"SELECT json_array(1,2,3,4,5,6,7,8,9,'x\"\\',json_raw('[1]'), 1e400, 9223372036854775807)",
+   "[1,2,3,4,5,6,7,8,9,\"x\\\"\\\\\",[1],null,9223372036854775807]"},
+  {"SELECT json_object('a')", "ERR json_object() requires an even number of arguments"},
+  {"SELECT json_object(1, 2)", "ERR json_object() keys must be text"},
+  {"SELECT json_raw('{\"a\":\"x\\\"y\"}', 'a'), typeof(json_raw('{\"a\":1}', 'a')), json_raw('{\"a\":1}', 'b')",
+   "\"x\\\"y\"|blob|NULL"},
+
+  /* Diff: patch of diff gives the new document */
+  {"SELECT json_diff('{\"a\":1,\"b\":{\"c\":2,\"d\":3},\"e\":[1]}',"
+   " '{\"a\":1,\"b\":{\"c\":2,\"d\":4},\"e\":[1,2],\"f\":null}')",
+   "{\"b\":{\"d\":4},\"e\":[1,2],\"f\":null}"},
+  {"SELECT json_diff('{\"a\":1,\"b\":2}', '{\"b\":2}'), json_diff('{\"a\":1}', '{\"a\":1}'),"
+   " json_diff('{\"a\":{\"x\":1}}', '{\"a\":{ \"x\" : 1 }}')",
+   "{\"a\":null}|{}|{}"},
+  {"SELECT json_diff('[1]', '{\"a\":1}'), json_diff('{\"a\":1}', 'x')", "{\"a\":1}|NULL"},
+  {"SELECT json_patch('{\"a\":1,\"b\":{\"c\":2,\"d\":3},\"e\":[1]}',"
+   " json_diff('{\"a\":1,\"b\":{\"c\":2,\"d\":3},\"e\":[1]}', '{\"b\":{\"c\":2},\"e\":[1,2],\"f\":\"x\"}'))",
+   "{\"b\":{\"c\":2},\"e\":[1,2],\"f\":\"x\"}"},
+  {"WITH RECURSIVE c(i, a, b) AS (SELECT 0, '1', '2' UNION ALL"
+   " SELECT i + 1, '{\"k\":' || a || ',\"x\":1}', '{\"k\":' || b || ',\"x\":1}' FROM c WHERE i < 24)"
+   " SELECT length(json_diff(a, b)) FROM c WHERE i = 24",
+   "145"},
+
+  /* Minify, and minify-on-write triggers from README */
+  {"SELECT json_minify(' { \"a\" : [ 1 , \"x y\" , { } ] , \"b\\\" c\" : null } '), json_minify('[1,2]'),"
+   " json_minify('x'), json_minify(NULL), json_minify('  \"s\"  ')",
+   "{\"a\":[1,\"x y\",{}],\"b\\\" c\":null}|[1,2]|x|NULL|\"s\""},
+  {"CREATE TABLE minify_t(doc);"
+   " CREATE TRIGGER doc_minify_insert AFTER INSERT ON minify_t WHEN new.doc <> json_minify(new.doc)"
+   " BEGIN UPDATE minify_t SET doc = json_minify(doc) WHERE rowid = new.rowid; END;"
+   " CREATE TRIGGER doc_minify_update AFTER UPDATE OF doc ON minify_t WHEN new.doc <> json_minify(new.doc)"
+   " BEGIN UPDATE minify_t SET doc = json_minify(doc) WHERE rowid = new.rowid; END;"
+   " INSERT INTO minify_t VALUES ('{ \"a\" : 1 }'), ('[1, 2]');"
+   " UPDATE minify_t SET doc = '{ \"b\" : [ ] }' WHERE rowid = 2;"
+   " SELECT doc FROM minify_t ORDER BY rowid",
+   "{\"a\":1}\n{\"b\":[]}"},
+
+  /* Encoded json: index lookups, text in place, triggers from README */
+  {"SELECT json_get(json_encode('{\"a\": [1, {\"b\": 2}]}'), 'a', 1, 'b'),"
+   " json_get(json_encode('{\"a\": [1, {\"b\": 2}]}'), 'a', -2),"
+   " json_text(json_encode('{\"a\": [1, {\"b\": 2}]}')), typeof(json_encode('[1]'))",
+   "2|1|{\"a\":[1,{\"b\":2}]}|blob"},
+  {"SELECT json_has(json_encode('{\"a\":null}'), 'a'), json_type(json_encode('[1,\"x\"]'), 1),"
+   " json_get(json_encode('{\"a\":1}'), 'b'), json_text('[1]'), json_encode(NULL)",
+   "1|string|NULL|[1]|NULL"},
+  {"SELECT json_encode('[1] x')", "ERR json_encode() argument is not valid json"},
+  {"SELECT json_encode('{\"a\":')", "ERR json_encode() argument is not valid json"},
+  {"SELECT json_get(x'004a4901000000ff00000000', 'a')", "NULL"},
+  {"SELECT json_set(json_encode('{\"a\":1}'), 'b', 2),"
+   " json_array(json_encode('{\"a\":1}'), json_raw('{\"a\":[1,2]}', 'a')),"
+   " json_array(1, 2, 3, 4, 5, 6, 7, 8, 9, 'x')",
+   "{\"a\":1,\"b\":2}|[{\"a\":1},[1,2]]|[1,2,3,4,5,6,7,8,9,\"x\"]"},
+  {"CREATE TABLE encode_t(doc);"
+   " CREATE TRIGGER doc_encode_insert AFTER INSERT ON encode_t WHEN typeof(new.doc) = 'text'"
+   " BEGIN UPDATE encode_t SET doc = json_encode(doc) WHERE rowid = new.rowid; END;"
+   " CREATE TRIGGER doc_encode_update AFTER UPDATE OF doc ON encode_t WHEN typeof(new.doc) = 'text'"
+   " BEGIN UPDATE encode_t SET doc = json_encode(doc) WHERE rowid = new.rowid; END;"
+   " INSERT INTO encode_t VALUES ('{ \"a\" : 1 }');"
+   " UPDATE encode_t SET doc = '{\"a\": 2}';"
+   " SELECT typeof(doc), json_get(doc, 'a'), json_text(doc) FROM encode_t",
+   "blob|2|{\"a\":2}"},
+
+  /* Key table of encoded json, version check, key hash kept per statement */
+  {"SELECT json_get(json_encode('{\"a\":{\"b\":1,\"a\":2},\"c\":[{\"a\":3},{\"b\":4}]}'), 'c', 1, 'b'),"
+   " json_get(json_encode('{\"a\":{\"b\":1,\"a\":2}}'), 'a', 'a'),"
+   " json_get(json_encode('{\"a\":{\"b\":1}}'), 'x'), json_get(json_encode('{\"a\":{\"b\":1}}'), 'a', 'x'),"
+   " hex(substr(json_encode('{\"a\":1}'), 1, 4))",
+   "4|2|NULL|NULL|004A4902"},
+  {"SELECT json_get(x'004a4901000000070000000000000000' || '{\"a\":1}' || x'00', 'a')", "NULL"},
+  {"WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c WHERE i < 99)"
+   " SELECT sum(json_get(json_encode('{\"k' || (i % 3) || '\":' || i || ',\"x\":1}'), 'k1')),"
+   " sum(json_get(json_encode('{\"k0\":1,\"k1\":2}'), 'k' || (i % 2))) FROM c",
+   "1617|150"},
+
+  /* Compressed json: small values stay text, cache keeps values used by call */
+  {"WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c WHERE i < 199),"
+   " d(doc) AS (SELECT '{\"items\":[{\"id\":' || i || '}],\"pad\":\"' || hex(zeroblob(300)) || '\"}' FROM c)"
+   " SELECT sum(typeof(json_compress(doc)) = 'blob'), sum(length(json_compress(doc)) < length(doc)),"
+   " sum(json_get(json_compress(doc), 'items', 0, 'id')), sum(json_text(json_compress(doc)) = doc) FROM d",
+   "200|200|19900|200"},
+  {"SELECT json_compress('{\"a\":1}'), typeof(json_compress('{\"a\":1}', 0)), json_compress(NULL),"
+   " json_get(x'004a5a01000000ff0102', 'a')",
+   "{\"a\":1}|text|NULL|NULL"},
+  {"SELECT json_get(json_encode(json_compress('{\"a\":[1,2]}', 0)), 'a', 1),"
+   " json_get(json_compress(json_encode('{\"a\":[1,2]}'), 0), 'a', 1)",
+   "2|2"},
+  {"CREATE TABLE compress_t(i, doc);"
+   " WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c WHERE i < 5)"
+   " INSERT INTO compress_t SELECT i, json_compress('[\"' || hex(zeroblob(200)) || '\",' || i || ']', 0) FROM c;"
+   " SELECT json_get(json_array((SELECT doc FROM compress_t WHERE i = 0), (SELECT doc FROM compress_t WHERE i = 1),"
+   " (SELECT doc FROM compress_t WHERE i = 2), (SELECT doc FROM compress_t WHERE i = 3),"
+   " (SELECT doc FROM compress_t WHERE i = 4), (SELECT doc FROM compress_t WHERE i = 5)), 5, 1),"
+   " (SELECT sum(json_get(doc, 1)) + sum(length(json_get(doc, 0))) FROM compress_t)",
+   "5|2415"},
+
+  /* json_get_rowid: prefix reads, whole value reads, rows that blob I/O can't open */
+  {"CREATE TABLE rowid_t(doc);"
+   " INSERT INTO rowid_t VALUES ('{\"meta\":{\"id\":7},\"pad\":\"' || hex(zeroblob(5000)) || '\",\"tail\":[1,2,12345]}');"
+   " INSERT INTO rowid_t VALUES (NULL), (42);"
+   " INSERT INTO rowid_t VALUES (json_compress('{\"meta\":{\"id\":8},\"pad\":\"' || hex(zeroblob(5000)) || '\"}'));"
+   " INSERT INTO rowid_t VALUES (json_encode('{\"meta\":{\"id\":9}}'));"
+   " SELECT rowid, json_get_rowid('rowid_t', 'doc', rowid, 'meta', 'id'), json_get_rowid('rowid_t', 'doc', rowid, 'tail', 2),"
+   " json_get_rowid('rowid_t', 'doc', rowid, 'tail', -1), json_get_rowid('rowid_t', 'doc', rowid, 'missing') FROM rowid_t",
+   "1|7|12345|12345|NULL\n2|NULL|NULL|NULL|NULL\n3|NULL|NULL|NULL|NULL\n4|8|NULL|NULL|NULL\n5|9|NULL|NULL|NULL"},
+  {"SELECT json_get_rowid('rowid_t', 'doc', 99, 'meta'), json_get_rowid('rowid_t', 'doc', 3),"
+   " json_get_rowid('rowid_t', 'doc', NULL, 'meta'), json_get_rowid('rowid_t', 'doc', 1, json_step('*'), 'id')",
+   "NULL|42|NULL|[7]"},
+  {"SELECT json_get_rowid('nosuch', 'doc', 1, 'meta')", "ERR no such table: main.nosuch"},
+  {"SELECT json_get_rowid('rowid_t', 'nosuch', 1, 'meta')", "ERR no such column: t.nosuch"},
+  {"SELECT json_get_rowid('rowid_t', 'doc')", "ERR Invalid number of arguments"},
+  {"SELECT json_array(x'00ff')", "ERR Blob value is not valid json"},
+  {"SELECT json_array(x'41')", "ERR Blob value is not valid json"},
+  {"SELECT json_object('a', CAST('[1, 2]' AS BLOB)), json_array(json_raw('{\"a\":[1,2]}', 'a'))", "{\"a\":[1, 2]}|[[1,2]]"},
+  {"SELECT json_set('{\"a\":1}', 'b', x'7b')", "ERR Blob value is not valid json"},
+  {"SELECT json_set('{\"a\":1}', 'b', CAST('{\"c\":true}' AS BLOB))", "{\"a\":1,\"b\":{\"c\":true}}"},
+  {"SELECT json_encode('01')", "ERR json_encode() argument is not valid json"},
+  {"SELECT json_encode('[1.]')", "ERR json_encode() argument is not valid json"},
+  {"SELECT json_encode('[1,]')", "ERR json_encode() argument is not valid json"},
+  {"SELECT json_encode('{\"a\":1e}')", "ERR json_encode() argument is not valid json"},
+  {"SELECT json_text(json_encode(' [-0.5e+3, 1E2] '))", "[-0.5e+3,1E2]"},
+};
+
+/* Append row of result to output buffer */
+static int sqlitejsonTestRow(void *pArg, int nCol, char **azVal, char **azCol){
+  char *zOut = (char*)pArg;
+  int i;
+  (void)azCol;
+  if (zOut[0]) strncat(zOut, "\n", MAX_OUT - strlen(zOut) - 1);
+  for (i = 0; i < nCol; i++)
+  {
+    if (i) strncat(zOut, "|", MAX_OUT - strlen(zOut) - 1);
+    strncat(zOut, azVal[i] ? azVal[i] : "NULL", MAX_OUT - strlen(zOut) - 1);
+  }
+  return 0;
+}
+
+/*
+** Run zSql and compare its result with zExpected like tests of aTest.
+** Print result and return 1 if it differs
+*/
+static int sqlitejsonTestExpect(sqlite3 *db, const char *zSql, const char *zExpected){
+  char zOut[MAX_OUT];
+  char *zErr = 0;
+  zOut[0] = 0;
+  if (sqlite3_exec(db, zSql, sqlitejsonTestRow, zOut, &zErr) != SQLITE_OK)
+  {
+    snprintf(zOut, sizeof(zOut), "ERR %s", zErr ? zErr : "");
+    sqlite3_free(zErr);
+  }
+  if (strcmp(zOut, zExpected) == 0) return 0;
+  printf("  %s\n  result: %s\n  expected: %s\n", zSql, zOut, zExpected);
+  return 1;
+}
+
+/* Path elements bound as parameters are read again after reset */
+static int sqlitejsonTestBind(sqlite3 *db){
+  static const struct {
+    const char *zJson;        /* Document bound to ?1 */
+    const char *zKey;         /* Key bound to ?2, or NULL to bind iIndex */
+    int iIndex;               /* Index bound to ?2 */
+    int iExpected;            /* Expected result */
+  } aBind[] = {
+    {"{\"a\":1,\"b\":2}", "a", 0, 1},
+    {"{\"a\":1,\"b\":2}", "b", 0, 2},
+    {"[10,20]", 0, 1, 20},
+    {"{\"1\":30}", "1", 0, 30},
+  };
+  sqlite3_stmt *pStmt;
+  int i, rc = 0;
+  if (sqlite3_prepare_v2(db, "SELECT json_get(?1, ?2)", -1, &pStmt, 0) != SQLITE_OK) return 1;
+  for (i = 0; i < (int)(sizeof(aBind) / sizeof(aBind[0])); i++)
+  {
+    sqlite3_bind_text(pStmt, 1, aBind[i].zJson, -1, SQLITE_STATIC);
+    if (aBind[i].zKey) sqlite3_bind_text(pStmt, 2, aBind[i].zKey, -1, SQLITE_STATIC);
+    else sqlite3_bind_int(pStmt, 2, aBind[i].iIndex);
+    if (sqlite3_step(pStmt) != SQLITE_ROW || sqlite3_column_int(pStmt, 0) != aBind[i].iExpected) rc = 1;
+    sqlite3_reset(pStmt);
+  }
+  sqlite3_finalize(pStmt);
+  return rc;
+}
+
+/*
+** Decompressed value is cached while statement that read it runs and is
+** freed by the next call after the statement is finalized
+*/
+static int sqlitejsonTestCache(sqlite3 *db){
+  sqlite3_stmt *pStmt;
+  sqlite3_int64 nBase;
+  int rc = 0;
+  if (sqlite3_exec(db, "CREATE TABLE cache_t(doc);"
+      " INSERT INTO cache_t VALUES (json_compress('[\"' || hex(zeroblob(100000)) || '\", 7]'))", 0, 0, 0) != SQLITE_OK
+   || sqlite3_prepare_v2(db, "SELECT json_get(doc, 1), json_get(doc, 1) + json_get(doc, 1) FROM cache_t", -1, &pStmt, 0) != SQLITE_OK)
+    return 1;
+  nBase = sqlite3_memory_used();
+  if (sqlite3_step(pStmt) != SQLITE_ROW || sqlite3_column_int(pStmt, 0) != 7 || sqlite3_column_int(pStmt, 1) != 14) rc = 1;
+  if (sqlite3_memory_used() < nBase + 200000) rc = 1;
+  sqlite3_finalize(pStmt);
+  if (sqlite3_exec(db, "SELECT json_get('[1]', 0)", 0, 0, 0) != SQLITE_OK) rc = 1;
+  if (sqlite3_memory_used() > nBase + 100000) rc = 1;
+  return rc;
+}
+
+/*
+** json_file is registered by sqlite3JsonFileInit only and reads lines of
+** file split across reads, blank lines are skipped
+*/
+static int sqlitejsonTestFile(sqlite3 *db){
+  static const char zFile[] = "sqlitejson_test.ndjson";
+  FILE *f = fopen(zFile, "w");
+  int i, rc = 0;
+  if (!f) return 1;
+  fputs("{\"a\":1,\"user\":{\"id\":\"u1\"},\"tags\":[\"x\",\"y\"],\"first name\":\"Ann\"}\n"
+        "\n"
+        "{\"a\":2,\"user\":{\"id\":\"u2\"},\"tags\":[\"z\"]}\r\n"
+        "not json\n", f);
+  for (i = 0; i < 30000; i++) fprintf(f, "{\"a\":%d,\"pad\":\"%040d\"}\n", i, i);
+  fputs("{\"a\":0.5}", f);
+  fclose(f);
+
+  rc |= sqlitejsonTestExpect(db, "CREATE VIRTUAL TABLE temp.f USING json_file('sqlitejson_test.ndjson')",
+    "ERR no such module: json_file");
+  if (sqlite3JsonFileInit(db) != SQLITE_OK) rc = 1;
+  rc |= sqlitejsonTestExpect(db, "CREATE VIRTUAL TABLE temp.f USING json_file('sqlitejson_test.ndjson',"
+    " a, user_id user.id, tag1 tags.1, [first name] first name)", "");
+  rc |= sqlitejsonTestExpect(db, "SELECT rowid, a, user_id, tag1, \"first name\" FROM f WHERE rowid < 5",
+    "1|1|u1|y|Ann\n3|2|u2|NULL|NULL\n4|NULL|NULL|NULL|NULL");
+  rc |= sqlitejsonTestExpect(db, "SELECT count(*), sum(a), max(length(line)), max(rowid) FROM f",
+    "30004|449985003.5|62|30005");
+  rc |= sqlitejsonTestExpect(db, "SELECT length(line) FROM f WHERE rowid = 3", "39");
+  rc |= sqlitejsonTestExpect(db, "SELECT line FROM f WHERE rowid = 30005", "{\"a\":0.5}");
+  rc |= sqlitejsonTestExpect(db, "SELECT max(line) FROM f", "{\"a\":9999,\"pad\":\"0000000000000000000000000000000000009999\"}");
+  // Message has absolute path of file
+  if (sqlite3_exec(db, "DROP TABLE f; CREATE VIRTUAL TABLE temp.f USING json_file('nosuch.ndjson');"
+      " SELECT * FROM f", 0, 0, 0) != SQLITE_CANTOPEN
+   || strncmp(sqlite3_errmsg(db), "json_file: cannot open ", 23) != 0) rc = 1;
+  sqlite3_exec(db, "DROP TABLE f", 0, 0, 0);
+  remove(zFile);
+  return rc;
+}
+
+/* Documents of bulk load test: n documents, document iBad is not json */
+typedef struct SqlitejsonTestDocs SqlitejsonTestDocs;
+struct SqlitejsonTestDocs {
+  int i;                      /* Next document */
+  int n;                      /* Number of documents */
+  int iBad;                   /* Invalid document or -1 */
+  char zDoc[100];             /* Text of the last document */
+};
+
+static int sqlitejsonTestNextDoc(void *pArg, const char **pzDoc, int *pnDoc){
+  SqlitejsonTestDocs *p = (SqlitejsonTestDocs*)pArg;
+  if (p->i == p->n) return SQLITE_DONE;
+  if (p->i == p->iBad) strcpy(p->zDoc, "{\"id\": }");
+  else sprintf(p->zDoc, "{ \"id\": %d, \"user\": {\"name\": \"u%d\"}, \"r\": %d.5 }", p->i, p->i % 7, p->i);
+  *pzDoc = p->zDoc;
+  *pnDoc = -1;
+  p->i++;
+  return SQLITE_ROW;
+}
+
+/*
+** sqlite3_json_bulk_load inserts documents converted to the format and path
+** values with worker threads and without them, invalid document rolls back
+*/
+static int sqlitejsonTestBulkLoad(sqlite3 *db){
+  static const char *const azPath[] = {"id", "user.name", "r", "nosuch"};
+  SqlitejsonTestDocs docs = {0, 5000, -1, ""};
+  char *zErr = 0;
+  int rc = 0;
+  if (sqlite3_exec(db, "CREATE TABLE bulk_t(doc, id, name, r, x)", 0, 0, 0) != SQLITE_OK) return 1;
+  if (sqlite3_json_bulk_load(db, "INSERT INTO bulk_t VALUES (?1, ?2, ?3, ?4, ?5)", azPath, 4,
+      SQLITE_JSON_BULK_ENCODE, 4, sqlitejsonTestNextDoc, &docs, &zErr) != SQLITE_OK) rc = 1;
+  rc |= sqlitejsonTestExpect(db, "SELECT count(*), sum(id), sum(typeof(doc) = 'blob'), count(x),"
+    " sum(json_get(doc, 'id') = id AND json_get(doc, 'user', 'name') = name AND json_get(doc, 'r') = r)"
+    " FROM bulk_t", "5000|12497500|5000|0|5000");
+  rc |= sqlitejsonTestExpect(db, "SELECT id, name, r, json_text(doc) FROM bulk_t WHERE id = 4999",
+    "4999|u1|4999.5|{\"id\":4999,\"user\":{\"name\":\"u1\"},\"r\":4999.5}");
+
+  docs.i = 0;
+  docs.n = 3;
+  sqlite3_exec(db, "DELETE FROM bulk_t", 0, 0, 0);
+  if (sqlite3_json_bulk_load(db, "INSERT INTO bulk_t(doc, id) VALUES (?1, ?2)", azPath, 1,
+      SQLITE_JSON_BULK_MINIFY, 0, sqlitejsonTestNextDoc, &docs, &zErr) != SQLITE_OK) rc = 1;
+  rc |= sqlitejsonTestExpect(db, "SELECT id, doc FROM bulk_t WHERE id = 2",
+    "2|{\"id\":2,\"user\":{\"name\":\"u2\"},\"r\":2.5}");
+
+  // Document 1501 is invalid, nothing is inserted
+  docs.i = 0;
+  docs.n = 2000;
+  docs.iBad = 1500;
+  if (sqlite3_json_bulk_load(db, "INSERT INTO bulk_t(doc) VALUES (?1)", 0, 0,
+      SQLITE_JSON_BULK_TEXT, 2, sqlitejsonTestNextDoc, &docs, &zErr) != SQLITE_ERROR
+   || !zErr || strcmp(zErr, "json_bulk_load: document 1501 is not valid json") != 0) rc = 1;
+  sqlite3_free(zErr);
+  rc |= sqlitejsonTestExpect(db, "SELECT count(*) FROM bulk_t", "3");
+  if (sqlite3_json_bulk_load(db, "INSERT INTO bulk_t(doc, id) VALUES (?1, ?2)", azPath, 2,
+      SQLITE_JSON_BULK_TEXT, 0, sqlitejsonTestNextDoc, &docs, &zErr) != SQLITE_RANGE
+   || !zErr || strcmp(zErr, "json_bulk_load: statement has less than 3 parameters") != 0) rc = 1;
+  sqlite3_free(zErr);
+  sqlite3_exec(db, "DROP TABLE bulk_t", 0, 0, 0);
+  return rc;
+}
+
+/* Entry point of json functions for connections opened by the extension */
+static int sqlitejsonTestAutoInit(sqlite3 *db, char **pzErrMsg, const void *pApi){
+  (void)pzErrMsg;
+  (void)pApi;
+  return sqlite3JsonInit(db);
+}
+
+/*
+** sqlite3_json_parallel_aggregate merges parts scanned by own connections
+** of database file, and scans database in WAL mode with caller's connection
+*/
+static int sqlitejsonTestParallelAggregate(sqlite3 *db){
+  static const char zFile[] = "sqlitejson_test.db";
+  static const char *const azAgg[] = {
+    "sum(json_get(doc, 'total'))", "count(*)", "min(json_get(doc, 'total'))",
+    "max(json_get(doc, 'total'))", "avg(json_get(doc, 'total'))", "total(json_get(doc, 'x'))",
+  };
+  static const char *const azBad[] = {"max(rowid) - min(rowid)", "count(DISTINCT doc)", "group_concat(doc)"};
+  static const char zWhere[] = "json_get(doc, 'status') = 'paid'";
+  char zOut[MAX_OUT];
+  char *zErr = 0;
+  int i, rc = 0;
+  (void)db;
+  // Library of the test has no json functions built in, so connections
+  // of parts get them as automatic extension
+  sqlite3_auto_extension((void(*)(void))sqlitejsonTestAutoInit);
+  remove(zFile);
+  if (sqlite3_open(zFile, &db) != SQLITE_OK || sqlite3JsonInit(db) != SQLITE_OK
+   || sqlite3_exec(db, "CREATE TABLE bill(doc); CREATE TEMP TABLE paid(status);"
+      " INSERT INTO paid VALUES ('paid');"
+      " WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10000)"
+      " INSERT INTO bill SELECT json_object('total', i, 'status', CASE WHEN i % 2 THEN 'open' ELSE 'paid' END) FROM n",
+      0, 0, 0) != SQLITE_OK)
+  {
+    sqlite3_close(db);
+    sqlite3_reset_auto_extension();
+    remove(zFile);
+    return 1;
+  }
+  zOut[0] = 0;
+  if (sqlite3_json_parallel_aggregate(db, "bill", zWhere, azAgg, 6, 4, sqlitejsonTestRow, zOut, &zErr) != SQLITE_OK
+   || strcmp(zOut, "25005000|5000|2|10000|5001.0|0.0") != 0) rc = 1;
+  zOut[0] = 0;
+  if (sqlite3_json_parallel_aggregate(db, "bill", 0, azAgg, 2, 3, sqlitejsonTestRow, zOut, &zErr) != SQLITE_OK
+   || strcmp(zOut, "50005000|10000") != 0) rc = 1;
+  for (i = 0; i < 3; i++)
+  {
+    if (sqlite3_json_parallel_aggregate(db, "bill", 0, &azBad[i], 1, 4, sqlitejsonTestRow, zOut, &zErr) != SQLITE_ERROR
+     || !zErr || strncmp(zErr, "json_parallel_aggregate: unsupported aggregate", 46) != 0) rc = 1;
+    sqlite3_free(zErr);
+    zErr = 0;
+  }
+
+  // Temporary table is not visible to connections of parts
+  zOut[0] = 0;
+  if (sqlite3_json_parallel_aggregate(db, "bill", "json_get(doc, 'status') IN paid", azAgg + 1, 1, 4,
+      sqlitejsonTestRow, zOut, &zErr) != SQLITE_ERROR
+   || !zErr || strcmp(zErr, "no such table: paid") != 0) rc = 1;
+  sqlite3_free(zErr);
+  zErr = 0;
+  // Caller's connection scans database in WAL mode, so it sees the table
+  zOut[0] = 0;
+  if (sqlite3_exec(db, "PRAGMA journal_mode = wal", 0, 0, 0) != SQLITE_OK
+   || sqlite3_json_parallel_aggregate(db, "bill", "json_get(doc, 'status') IN paid", azAgg, 2, 4,
+      sqlitejsonTestRow, zOut, &zErr) != SQLITE_OK
+   || strcmp(zOut, "25005000|5000") != 0) rc = 1;
+  sqlite3_free(zErr);
+  sqlite3_close(db);
+  sqlite3_reset_auto_extension();
+  remove(zFile);
+  return rc;
+}
+
+/*
+** sqlite3_json_create_index builds index table with parts scanned by own
+** connections, triggers keep it up to date
+*/
+static int sqlitejsonTestCreateIndex(sqlite3 *db){
+  static const char zFile[] = "sqlitejson_test.db";
+  static const char zCheck[] =
+    "SELECT count(*), sum(json_get(doc, 'user', 'id') = key), count(DISTINCT rid) FROM ev_user JOIN ev ON ev.rowid = rid";
+  char *zErr = 0;
+  int rc = 0;
+  (void)db;
+  sqlite3_auto_extension((void(*)(void))sqlitejsonTestAutoInit);
+  remove(zFile);
+  if (sqlite3_open(zFile, &db) != SQLITE_OK || sqlite3JsonInit(db) != SQLITE_OK
+   || sqlite3_exec(db, "CREATE TABLE ev(doc);"
+      " WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10000)"
+      " INSERT INTO ev SELECT CASE WHEN i % 10 THEN '{\"user\": {\"id\": ' || (i % 100) || '}}' ELSE '{}' END FROM n;"
+      " INSERT INTO ev VALUES ('{\"user\": {\"id\": \"x\"}}'), ('{\"user\": {\"id\": 2.5}}')",
+      0, 0, 0) != SQLITE_OK)
+  {
+    sqlite3_close(db);
+    sqlite3_reset_auto_extension();
+    remove(zFile);
+    return 1;
+  }
+  if (sqlite3_json_create_index(db, "ev_user", "ev", "doc", "user.id", 3, &zErr) != SQLITE_OK) rc = 1;
+  sqlite3_free(zErr);
+  zErr = 0;
+  rc |= sqlitejsonTestExpect(db, zCheck, "9002|9002|9002");
+  rc |= sqlitejsonTestExpect(db, "SELECT count(*) FROM ev_user WHERE key = 42", "100");
+  rc |= sqlitejsonTestExpect(db, "SELECT DISTINCT key FROM ev_user WHERE key > 98", "99\nx");
+  rc |= sqlitejsonTestExpect(db, "SELECT key, rid FROM ev_user WHERE key BETWEEN 2 AND 3 LIMIT 1 OFFSET 100", "2.5|10002");
+
+  // Triggers
+  rc |= sqlitejsonTestExpect(db, "INSERT INTO ev VALUES ('{\"user\": {\"id\": 42}}');"
+    " UPDATE ev SET doc = '{}' WHERE rowid = 42; UPDATE ev SET doc = '{\"user\": {\"id\": 7}}' WHERE rowid = 10;"
+    " DELETE FROM ev WHERE rowid = 142;"
+    " SELECT count(*) FROM ev_user WHERE key = 42", "99");
+  rc |= sqlitejsonTestExpect(db, zCheck, "9002|9002|9002");
+  rc |= sqlitejsonTestExpect(db, "SELECT rid FROM ev_user WHERE key = 7 AND rid < 20", "7\n10");
+  if (sqlite3_json_create_index(db, "ev_bad", "ev", "doc", "", 3, &zErr) != SQLITE_ERROR
+   || !zErr || strcmp(zErr, "json_create_index: invalid path ") != 0) rc = 1;
+  sqlite3_free(zErr);
+  sqlite3_close(db);
+  sqlite3_reset_auto_extension();
+  remove(zFile);
+  return rc;
+}
+
+/*
+** Fetch all rows of zSql with sqlite3_json_fetch_column in calls of nMaxRow
+** rows. Each call is written to zOut as its code and values of rows, "-" if
+** row has no number, calls are separated by " | "
+*/
+static int sqlitejsonTestFetch(sqlite3 *db, const char *zSql, const char *zPath, int nMaxRow, char *zOut){
+  sqlite3_stmt *pStmt;
+  sqlite3_int64 aInt[4];
+  double aDouble[4];
+  unsigned char aValid[1];
+  sqlite3_json_vector v;
+  int i, rc;
+  zOut[0] = 0;
+  if (sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0) != SQLITE_OK) return SQLITE_ERROR;
+  v.aInt = aInt;
+  v.aDouble = aDouble;
+  v.aValid = aValid;
+  do
+  {
+    rc = sqlite3_json_fetch_column(pStmt, 0, zPath, nMaxRow, &v);
+    if (zOut[0]) strcat(zOut, " | ");
+    strcat(zOut, rc == SQLITE_ROW ? "ROW" : rc == SQLITE_DONE ? "DONE" : "ERR");
+    for (i = 0; i < v.nRow; i++)
+    {
+      if (!(aValid[i / 8] & (1 << (i % 8)))) strcat(zOut, aInt[i] || aDouble[i] ? " ?" : " -");
+      else sprintf(zOut + strlen(zOut), " %lld/%g", (long long)aInt[i], aDouble[i]);
+    }
+  } while (rc == SQLITE_ROW);
+  sqlite3_finalize(pStmt);
+  return rc;
+}
+
+/*
+** sqlite3_json_fetch_column reads numbers under path from json of every
+** format, or numbers of column, and marks rows without number in bitmap
+*/
+static int sqlitejsonTestFetchColumn(sqlite3 *db){
+  static const char zSelect[] = "SELECT doc FROM fetch_t ORDER BY rowid";
+  char zOut[MAX_OUT];
+  int rc = 0;
+  if (sqlite3_exec(db, "CREATE TABLE fetch_t(doc);"
+      " INSERT INTO fetch_t VALUES ('{\"items\": [{\"price\": 2.5}], \"n\": 1}');"
+      " INSERT INTO fetch_t VALUES ('{\"items\": [{\"price\": 3}], \"n\": -2}');"
+      " INSERT INTO fetch_t VALUES (NULL);"
+      " INSERT INTO fetch_t VALUES ('{\"items\": []}');"
+      " INSERT INTO fetch_t VALUES (json_encode('{\"items\": [{\"price\": 4.25}], \"n\": 9007199254740993}'));"
+      " INSERT INTO fetch_t VALUES (json_compress('{\"items\": [{\"price\": 6}], \"pad\": \"' || hex(zeroblob(200)) || '\"}', 0));"
+      " INSERT INTO fetch_t VALUES ('{\"items\": [{\"price\": \"7\"}]}');"
+      " INSERT INTO fetch_t VALUES ('{\"items\": [{\"price\": true}]}');"
+      " INSERT INTO fetch_t VALUES ('not json')", 0, 0, 0) != SQLITE_OK) return 1;
+
+  if (sqlitejsonTestFetch(db, zSelect, "items.0.price", 4, zOut) != SQLITE_DONE
+   || strcmp(zOut, "ROW 2/2.5 3/3 - - | ROW 4/4.25 6/6 - 1/1 | DONE -") != 0) rc = 1;
+  if (sqlitejsonTestFetch(db, zSelect, "n", 3, zOut) != SQLITE_DONE
+   || strcmp(zOut, "ROW 1/1 -2/-2 - | ROW - 9007199254740993/9.0072e+15 - | ROW - - - | DONE") != 0) rc = 1;
+  if (sqlitejsonTestFetch(db, "SELECT json_get(doc, 'items', -1, 'price') FROM fetch_t ORDER BY rowid", 0, 4, zOut) != SQLITE_DONE
+   || strcmp(zOut, "ROW 2/2.5 3/3 - - | ROW 4/4.25 6/6 - 1/1 | DONE -") != 0) rc = 1;
+  if (sqlitejsonTestFetch(db, zSelect, "items..price", 4, zOut) != SQLITE_MISUSE) rc = 1;
+  if (sqlitejsonTestFetch(db, zSelect, 0, 0, zOut) != SQLITE_MISUSE) rc = 1;
+  if (rc) printf("  %s\n", zOut);
+  sqlite3_exec(db, "DROP TABLE fetch_t", 0, 0, 0);
+  return rc;
+}
+
+typedef struct SqlitejsonFuncTest SqlitejsonFuncTest;
+struct SqlitejsonFuncTest {
+  const char *zName;          /* Test name */
+  int (*xTest)(sqlite3*);     /* Test function, return 0 on success */
+};
+
+static const SqlitejsonFuncTest aFuncTest[] = {
+  {"bind", sqlitejsonTestBind},
+  {"cache", sqlitejsonTestCache},
+  {"file", sqlitejsonTestFile},
+  {"bulk_load", sqlitejsonTestBulkLoad},
+  {"parallel_aggregate", sqlitejsonTestParallelAggregate},
+  {"create_index", sqlitejsonTestCreateIndex},
+  {"fetch_column", sqlitejsonTestFetchColumn},
+};
+
+int main(void){
+  sqlite3 *db;
+  int nFail = 0, i;
+  int nTest = (int)(sizeof(aTest) / sizeof(aTest[0]));
+  int nFuncTest = (int)(sizeof(aFuncTest) / sizeof(aFuncTest[0]));
+
+  if (sqlite3_open(":memory:", &db) != SQLITE_OK || sqlite3JsonInit(db) != SQLITE_OK)
+  {
+    printf("cannot open database\n");
+    return 1;
+  }
+  for (i = 0; i < nTest; i++)
+  {
+    char zOut[MAX_OUT];
+    char *zErr = 0;
+    zOut[0] = 0;
+    if (sqlite3_exec(db, aTest[i].zSql, sqlitejsonTestRow, zOut, &zErr) != SQLITE_OK)
+    {
+      snprintf(zOut, sizeof(zOut), "ERR %s", zErr ? zErr : "");
+      sqlite3_free(zErr);
+    }
+    if (strcmp(zOut, aTest[i].zExpected) != 0)
+    {
+      printf("FAIL %s\n  result: %s\n  expected: %s\n", aTest[i].zSql, zOut, aTest[i].zExpected);
+      nFail++;
+    }
+  }
+  for (i = 0; i < nFuncTest; i++)
+  {
+    if (aFuncTest[i].xTest(db) != 0)
+    {
+      printf("FAIL %s\n", aFuncTest[i].zName);
+      nFail++;
+    }
+  }
+  sqlite3_close(db);
+  printf("%d of %d tests failed\n", nFail, nTest + nFuncTest);
+  return nFail != 0;
+}
@@ -0,0 +1,195 @@
+/*
+** Tests of jsonget stream parser
+**
+** Every document is fed in two chunks split at each byte position, then one
+** byte per chunk. Matched values, their root index and the final result
+** must not depend on where input is split.
+**
+** Build and run from src/json_ext:
+**
+**    cc -Wall -I. -o stream_test test/stream_test.c jsonget.c && ./stream_test
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "jsonget.h"
+
+#define MAX_OUT 1024
+
+typedef struct
+{
+	const char *json;		// input document
+	JsonGetStreamStep path[4];		// path to match
+	int path_length;		// number of path steps
+	int buffer_size;		// size of value buffer, 0 for default
+	const char *expected;		// matched values and final result, see stream_run
+} StreamCase;
+
+static const StreamCase cases[] =
+{
+	// Every element of array under key
+	{"{\"items\": [1, \"a\", {\"b\": 2}, [3, 4], null], \"x\": true}",
+		{{"items", 5, 0}, {0, 0, JSONGET_STREAM_ANY_INDEX}}, 2, 0,
+		"0:1 0:\"a\" 0:{\"b\": 2} 0:[3, 4] 0:null END"},
+	// One element by index, nested key after it
+	{"{\"a\": [{\"k\": 1}, {\"k\": 2.5e1}, {\"k\": -3}]}",
+		{{"a", 1, 0}, {0, 0, 1}, {"k", 1, 0}}, 3, 0,
+		"0:2.5e1 END"},
+	// Keys sharing prefix with path key
+	{"{\"a\": 1, \"abc\": 2, \"ab\": 3, \"b\": {\"ab\": 4}}",
+		{{"ab", 2, 0}}, 1, 0,
+		"0:3 END"},
+	// Escapes in strings and keys
+	{"{\"k\\\"\": 0, \"k\": \"a\\u00e9\\\"b\\\\\"}",
+		{{"k", 1, 0}}, 1, 0,
+		"0:\"a\\u00e9\\\"b\\\\\" END"},
+	// NDJSON: path of 0 steps matches every root value, last number completes at end
+	{"1 \"x\"\n[2, {}]\n{\"a\": null}\ntrue -0.5",
+		{{0, 0, 0}}, 0, 0,
+		"0:1 1:\"x\" 2:[2, {}] 3:{\"a\": null} 4:true 5:-0.5 END"},
+	// Path matched in every line
+	{"{\"id\": 1}\n{\"id\": 2}\n{\"x\": 3}\n{\"id\": [4]}",
+		{{"id", 2, 0}}, 1, 0,
+		"0:1 1:2 3:[4] END"},
+	// Long value is truncated, real length is reported
+	{"{\"s\": \"0123456789abcdef\"}",
+		{{"s", 1, 0}}, 1, 8,
+		"0:\"012345(18) END"},
+	// Empty containers and whitespace everywhere
+	{" { \"a\" : [ ] , \"b\" : { } } ",
+		{{"b", 1, 0}}, 1, 0,
+		"0:{ } END"},
+	// Number forms
+	{"[0, -0, 1E2, 0.5e-3, -12.75E+1, 10]",
+		{{0, 0, JSONGET_STREAM_ANY_INDEX}}, 1, 0,
+		"0:0 0:-0 0:1E2 0:0.5e-3 0:-12.75E+1 0:10 END"},
+	// Invalid documents
+	{"{\"a\": [1, 2}", {{"a", 1, 0}}, 1, 0, "ERROR"},
+	{"{\"a\" 1}", {{"a", 1, 0}}, 1, 0, "ERROR"},
+	{"[1, 2,]", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"{\"a\": tru}", {{"a", 1, 0}}, 1, 0, "ERROR"},
+	{"{\"a\": \"abc", {{"a", 1, 0}}, 1, 0, "ERROR"},
+	{"{\"a\": 1", {{"a", 1, 0}}, 1, 0, "0:1 ERROR"},
+	{"[1] x", {{0, 0, 0}}, 0, 0, "0:[1] ERROR"},
+	{"\"\\x\"", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"\"\\u12g4\"", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"01", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"[-01]", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"-", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"[1.]", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"1e", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"[1e+]", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"[1.2.3]", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"[1-2]", {{0, 0, 0}}, 0, 0, "ERROR"},
+	{"[.5]", {{0, 0, 0}}, 0, 0, "ERROR"},
+};
+
+// Append formatted match or result to out
+static void stream_append(char *out, const char *str)
+{
+	size_t len = strlen(out);
+	if (len) out[len++] = ' ';
+	snprintf(out + len, MAX_OUT - len, "%s", str);
+}
+
+// Feed chunks of test document and write matches to out as "root_index:value" separated
+// by space, followed by END or ERROR. Truncated value is followed by its real length.
+// First chunk has _split_ bytes, the rest is fed in chunks of _step_ bytes (0 for all of it)
+static void stream_run(const StreamCase *test, int split, int step, char *out)
+{
+	JsonGetStream stream;
+	char value[256], item[300];
+	int length = (int)strlen(test->json);
+	int pos = 0, first = 1, rc = JSONGET_STREAM_MORE;
+	int buffer_size = test->buffer_size ? test->buffer_size : (int)sizeof(value);
+
+	out[0] = 0;
+	jsonget_stream_init(&stream, test->path, test->path_length, value, buffer_size);
+	while ((first || pos < length) && rc != JSONGET_STREAM_ERROR)
+	{
+		// Empty chunk is fed too, it must change nothing
+		int chunk = first ? split : step ? step : length - pos;
+		first = 0;
+		if (chunk > length - pos) chunk = length - pos;
+		if (chunk == 0) rc = jsonget_stream_feed(&stream, test->json + pos, 0, &chunk);
+		while (chunk > 0)
+		{
+			int consumed = 0;
+			rc = jsonget_stream_feed(&stream, test->json + pos, chunk, &consumed);
+			pos += consumed;
+			chunk -= consumed;
+			if (rc != JSONGET_STREAM_MATCH) break;
+			if (stream.value_length > buffer_size - 1)
+				snprintf(item, sizeof(item), "%d:%s(%d)", stream.root_index, value, stream.value_length);
+			else
+				snprintf(item, sizeof(item), "%d:%s", stream.root_index, value);
+			stream_append(out, item);
+		}
+		if (rc == JSONGET_STREAM_ERROR) break;
+	}
+	if (rc != JSONGET_STREAM_ERROR)
+	{
+		while ((rc = jsonget_stream_end(&stream)) == JSONGET_STREAM_MATCH)
+		{
+			snprintf(item, sizeof(item), "%d:%s", stream.root_index, value);
+			stream_append(out, item);
+		}
+	}
+	stream_append(out, rc == JSONGET_STREAM_END ? "END" : "ERROR");
+}
+
+// Nesting deeper than JSONGET_STREAM_MAX_DEPTH is an error, not an overflow
+static int test_max_depth(void)
+{
+	static char json[2 * JSONGET_STREAM_MAX_DEPTH + 8];
+	JsonGetStream stream;
+	int i, consumed, rc;
+
+	for (i = 0; i <= JSONGET_STREAM_MAX_DEPTH; i++) json[i] = '[';
+	jsonget_stream_init(&stream, 0, 0, 0, 0);
+	rc = jsonget_stream_feed(&stream, json, i, &consumed);
+	if (rc != JSONGET_STREAM_ERROR)
+	{
+		printf("FAIL max depth: result %d\n", rc);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int failed = 0, count = 0;
+	size_t i;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		const StreamCase *test = &cases[i];
+		int length = (int)strlen(test->json);
+		int split;
+		char out[MAX_OUT];
+
+		for (split = 0; split <= length; split++)
+		{
+			stream_run(test, split, 0, out);
+			count++;
+			if (strcmp(out, test->expected) != 0)
+			{
+				printf("FAIL %s\n  split %d: %s\n  expected: %s\n", test->json, split, out, test->expected);
+				failed++;
+				break;
+			}
+		}
+		stream_run(test, 1, 1, out);
+		count++;
+		if (strcmp(out, test->expected) != 0)
+		{
+			printf("FAIL %s\n  byte by byte: %s\n  expected: %s\n", test->json, out, test->expected);
+			failed++;
+		}
+	}
+	count++;
+	failed += test_max_depth();
+
+	printf("%d of %d stream tests failed\n", failed, count);
+	return failed != 0;
+}